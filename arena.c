@@ -0,0 +1,103 @@
+#include <errno.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "error.h"
+
+/** The default size of a chunk */
+#define CHUNK_SIZE 16384
+
+/**
+ * The size an arena may grow to before resetting it returns its memory to the
+ * system
+ */
+#define MAX_RETAINED_SIZE (1024 * 1024)
+
+/** Round a size up to the alignment of allocations */
+#define ALIGN(size) (((size) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+/* See arena.h */
+struct Arena cmdline_arena = ARENA_INIT;
+
+/**
+ * Allocate a new chunk with room for the given number of bytes and insert it
+ * after the current chunk
+ */
+static struct ArenaChunk *new_chunk(struct Arena *arena, size_t size);
+
+/* See arena.h */
+void *arena_alloc(struct Arena *arena, size_t size)
+{
+    struct ArenaChunk *chunk;
+    void *ptr;
+
+    size = ALIGN(size);
+    while (!arena->current ||
+           arena->current->size - arena->current->used < size) {
+        /* Chunks after the current one are left over from before a reset */
+        if (arena->current && arena->current->next) {
+            arena->current = arena->current->next;
+            arena->current->used = 0;
+        } else
+            arena->current = new_chunk(arena,
+                                       size < CHUNK_SIZE ? CHUNK_SIZE : size);
+    }
+
+    chunk = arena->current;
+    ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+/* See arena.h */
+void arena_reserve(struct Arena *arena, size_t size)
+{
+    if (!arena->current || arena->current->size - arena->current->used < size)
+        arena->current = new_chunk(arena, size);
+}
+
+/* See arena.h */
+void arena_reset(struct Arena *arena)
+{
+    if (arena->size > MAX_RETAINED_SIZE)
+        arena_free(arena);
+    else if (arena->head) {
+        arena->current = arena->head;
+        arena->head->used = 0;
+    }
+}
+
+/* See arena.h */
+void arena_free(struct Arena *arena)
+{
+    struct ArenaChunk *chunk = arena->head;
+    while (chunk) {
+        struct ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = arena->current = NULL;
+    arena->size = 0;
+}
+
+/* See above */
+static struct ArenaChunk *new_chunk(struct Arena *arena, size_t size)
+{
+    struct ArenaChunk *chunk;
+
+    if (!(chunk = malloc(sizeof(*chunk) + size)))
+        error(1, errno, "fatal error");
+    ++arena->mallocs;
+    chunk->size = size;
+    chunk->used = 0;
+    arena->size += size;
+
+    if (arena->current) {
+        chunk->next = arena->current->next;
+        arena->current->next = chunk;
+    } else {
+        chunk->next = NULL;
+        arena->head = chunk;
+    }
+    return chunk;
+}
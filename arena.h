@@ -0,0 +1,79 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/** The alignment of allocations from an arena, which is suitable for any type */
+#define ARENA_ALIGNMENT __BIGGEST_ALIGNMENT__
+
+/** A chunk of memory which allocations from an arena are carved out of */
+struct ArenaChunk {
+    /** The next chunk in the arena */
+    struct ArenaChunk *next;
+
+    /** The number of bytes of data in the chunk */
+    size_t size;
+
+    /** The number of bytes of data already allocated */
+    size_t used;
+
+    /** The data */
+    char data[] __attribute__((aligned(ARENA_ALIGNMENT)));
+};
+
+/**
+ * A bump allocator for objects which all share the same lifetime. Objects are
+ * allocated contiguously and can't be freed individually; instead, the whole
+ * arena is reset at once
+ */
+struct Arena {
+    /** The first chunk of the arena */
+    struct ArenaChunk *head;
+
+    /** The chunk which is currently being allocated from */
+    struct ArenaChunk *current;
+
+    /** The total number of bytes in all of the chunks */
+    size_t size;
+
+    /**
+     * The number of times a chunk was allocated with malloc, i.e., the number
+     * of calls to malloc made on behalf of the arena
+     */
+    size_t mallocs;
+};
+
+/** An initializer for an empty arena */
+#define ARENA_INIT {NULL, NULL, 0, 0}
+
+/**
+ * The arena for the command line which is currently being parsed and
+ * executed, which is reset after each command line
+ */
+extern struct Arena cmdline_arena;
+
+/**
+ * Allocate memory from an arena, aligned for any type. Exits the program if
+ * memory cannot be allocated
+ */
+void *arena_alloc(struct Arena *arena, size_t size);
+
+/**
+ * Make sure that the next allocations from an arena totalling at most the
+ * given size (including alignment) are carved out of a single chunk, which is
+ * allocated with exactly that size if needed. This keeps small, long-lived
+ * arenas from wasting most of a default-sized chunk
+ */
+void arena_reserve(struct Arena *arena, size_t size);
+
+/**
+ * Free all of the allocations from an arena at once. The memory is kept for
+ * reuse, so this takes constant time unless the arena had grown large (e.g.,
+ * for a huge command line), in which case it is returned to the system
+ */
+void arena_reset(struct Arena *arena);
+
+/** Free all of the memory of an arena */
+void arena_free(struct Arena *arena);
+
+#endif /* ARENA_H */
@@ -0,0 +1,74 @@
+/*
+ * Command line cache benchmark. Build with `make bench CFLAGS=-O2' and run
+ * build/bench_cache
+ *
+ * Reports the time per line to run builtin-only command lines of a few sizes
+ * repeatedly with the cache of parsed command lines disabled and enabled.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cache.h"
+#include "shell.h"
+
+/** The command lines, which only run the cd builtin */
+static const char *lines[] = {
+    "cd .\n",
+    "cd . && cd . || (cd . ; cd .) ; cd . \"a b\" 'c d' e\\ f\n",
+    "cd . a b c d e f g h i j k l m n o p q r s t u v w x y z && "
+    "cd . a b c d e f g h i j k l m n o p q r s t u v w x y z && "
+    "cd . a b c d e f g h i j k l m n o p q r s t u v w x y z && "
+    "cd . a b c d e f g h i j k l m n o p q r s t u v w x y z && "
+    "cd . a b c d e f g h i j k l m n o p q r s t u v w x y z\n",
+};
+
+/** Return the current time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Run a line repeatedly for at least a fixed amount of time
+ * @return The time per line in nanoseconds
+ */
+static double measure(const char *line)
+{
+    size_t len = strlen(line), reps = 0;
+    char *copy = malloc(len + 1);
+    double start = now(), elapsed;
+
+    do {
+        for (int i = 0; i < 64; ++i) {
+            /* run_line() modifies the line, so run a fresh copy */
+            memcpy(copy, line, len + 1);
+            run_line(copy);
+        }
+        reps += 64;
+    } while ((elapsed = now() - start) < 0.5);
+
+    free(copy);
+    return elapsed / reps * 1e9;
+}
+
+int main(void)
+{
+    printf("%6s %14s %14s %14s\n", "bytes", "uncached ns", "cached ns",
+           "saved ns");
+    for (int i = 0; i < sizeof(lines) / sizeof(*lines); ++i) {
+        double uncached, cached;
+
+        cache_set_max_size(0);
+        uncached = measure(lines[i]);
+        cache_set_max_size(1024 * 1024);
+        cached = measure(lines[i]);
+
+        printf("%6zu %14.0f %14.0f %14.0f\n", strlen(lines[i]), uncached,
+               cached, uncached - cached);
+    }
+    return 0;
+}
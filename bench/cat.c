@@ -0,0 +1,127 @@
+/*
+ * Data mover benchmark. Build with `make bench CFLAGS=-O2' and run
+ * build/bench_cat [size of the input in MiB] [directory for the files]
+ *
+ * Reports the throughput of command lines moving a large file around with the
+ * cat and tee built-ins and with /bin/cat and /bin/tee. The input is written
+ * first, so it is read from the page cache as long as it fits in memory, and
+ * the best of a few runs is reported. The defaults are 2048 MiB in $TMPDIR or
+ * /tmp.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shell.h"
+
+/** The number of times each command line is run */
+#define REPS 3
+
+/** A command line run with the built-ins and with the external commands */
+struct Case {
+    /** What the command line does */
+    const char *name;
+
+    /**
+     * The command line, where %1$s is the input, %2$s the output file, %3$s
+     * the prefix of cat and tee (empty or /bin/)
+     */
+    const char *format;
+};
+
+/** The command lines */
+static const struct Case cases[] = {
+    {"file to file", "%3$scat %1$s > %2$s"},
+    {"file to pipe", "%3$scat %1$s | /bin/cat > /dev/null"},
+    {"pipe to file and pipe", "/bin/cat %1$s | %3$stee %2$s | /bin/cat "
+     "> /dev/null"},
+};
+
+/** Return the current time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Write a file of a number of MiB of text */
+static void write_input(const char *path, long mib)
+{
+    static char buf[1 << 20];
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+    if (fd == -1) {
+        perror(path);
+        exit(1);
+    }
+    for (size_t i = 0; i < sizeof(buf); ++i)
+        buf[i] = i % 64 == 63 ? '\n' : 'a' + i % 26;
+    for (long i = 0; i < mib; ++i) {
+        if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+            perror(path);
+            exit(1);
+        }
+    }
+    /* Writing it back must not slow down the first command line */
+    fsync(fd);
+    close(fd);
+}
+
+/** Run a command line and return how long it took in seconds */
+static double time_line(const char *format, const char *in, const char *out,
+                        const char *prefix)
+{
+    char *line;
+    double start;
+
+    unlink(out);
+    sync();
+    if (asprintf(&line, format, in, out, prefix) == -1)
+        abort();
+    start = now();
+    run_line(line);
+    start = now() - start;
+    free(line);
+    return start;
+}
+
+int main(int argc, char **argv)
+{
+    long mib = argc > 1 ? atol(argv[1]) : 2048;
+    const char *dir = argc > 2 ? argv[2] : getenv("TMPDIR");
+    char in[4096], out[4096];
+
+    if (!dir)
+        dir = "/tmp";
+    snprintf(in, sizeof(in), "%s/bench_cat.%d.in", dir, (int)getpid());
+    snprintf(out, sizeof(out), "%s/bench_cat.%d.out", dir, (int)getpid());
+    write_input(in, mib);
+
+    printf("%-24s %10s %10s %10s %10s\n", "", "built-in", "GiB/s",
+           "/bin", "GiB/s");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); ++i) {
+        double builtin = 1e9, external = 1e9;
+
+        /* The best of a few runs, alternating between the two */
+        for (int rep = 0; rep < REPS; ++rep) {
+            double t = time_line(cases[i].format, in, out, "");
+            if (t < builtin)
+                builtin = t;
+            t = time_line(cases[i].format, in, out, "/bin/");
+            if (t < external)
+                external = t;
+        }
+        printf("%-24s %9.2fs %10.2f %9.2fs %10.2f\n", cases[i].name,
+               builtin, mib / 1024.0 / builtin, external,
+               mib / 1024.0 / external);
+    }
+
+    unlink(in);
+    unlink(out);
+    return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Glob benchmark. Build with `make bench CFLAGS=-O2' and run
+ * build/bench_glob [number of files]
+ *
+ * Creates a temporary directory of files (100000 by default) and reports the
+ * time to expand a command line with several patterns over it, both with the
+ * directory listings cached for the command line and without, against
+ * expanding the same patterns with readdir, fnmatch, and qsort.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "glob.h"
+
+/** The number of command lines expanded per measurement */
+#define REPEATS 20
+
+/** The patterns of the command line, relative to the directory */
+static const char *patterns[] = {
+    "*.log", "file01*.txt", "*[05].log", "file?????7.*",
+};
+
+/** The number of patterns */
+#define NUM_PATTERNS (sizeof(patterns) / sizeof(*patterns))
+
+/** The temporary directory */
+static char dir[] = "/tmp/osh_bench_glob.XXXXXX";
+
+/** Return the current time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Expand the command line with the shell's globbing
+ * @return The average time per command line in milliseconds
+ */
+static double measure_glob(bool cache, size_t *matches)
+{
+    char *argv[NUM_PATTERNS];
+    bool is_pattern[NUM_PATTERNS];
+    double start;
+    size_t argc;
+
+    glob_set_cache(cache);
+    start = now();
+    for (int i = 0; i < REPEATS; ++i) {
+        for (size_t j = 0; j < NUM_PATTERNS; ++j) {
+            argv[j] = arena_alloc(&cmdline_arena,
+                                  strlen(dir) + strlen(patterns[j]) + 2);
+            sprintf(argv[j], "%s/%s", dir, patterns[j]);
+            is_pattern[j] = true;
+        }
+        glob_args(NUM_PATTERNS, argv, is_pattern, &argc);
+        *matches = argc;
+        arena_reset(&cmdline_arena);
+        glob_forget();
+    }
+    return (now() - start) / REPEATS * 1e3;
+}
+
+/** Compare strings for qsort */
+static int compare_strings(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * Expand the command line by reading the directory with readdir for every
+ * pattern, matching with fnmatch, and sorting with qsort
+ * @return The average time per command line in milliseconds
+ */
+static double measure_baseline(size_t *matches)
+{
+    size_t capacity = 1024;
+    char **paths = malloc(sizeof(*paths) * capacity);
+    double start = now();
+
+    for (int i = 0; i < REPEATS; ++i) {
+        *matches = 0;
+        for (size_t j = 0; j < NUM_PATTERNS; ++j) {
+            DIR *d = opendir(dir);
+            struct dirent *entry;
+            size_t first = *matches;
+
+            while ((entry = readdir(d))) {
+                if (entry->d_name[0] == '.' ||
+                    fnmatch(patterns[j], entry->d_name, FNM_PERIOD) != 0)
+                    continue;
+                if (*matches >= capacity) {
+                    capacity *= 2;
+                    paths = realloc(paths, sizeof(*paths) * capacity);
+                }
+                if (asprintf(&paths[(*matches)++], "%s/%s", dir,
+                             entry->d_name) == -1)
+                    abort();
+            }
+            closedir(d);
+            qsort(&paths[first], *matches - first, sizeof(*paths),
+                  compare_strings);
+        }
+        for (size_t j = 0; j < *matches; ++j)
+            free(paths[j]);
+    }
+    free(paths);
+    return (now() - start) / REPEATS * 1e3;
+}
+
+int main(int argc, char **argv)
+{
+    long num_files = argc > 1 ? atol(argv[1]) : 100000;
+    size_t cached_matches, uncached_matches, baseline_matches;
+    double cached, uncached, baseline;
+    char path[sizeof(dir) + 32];
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    /* Created in a scrambled order so that the listing isn't sorted */
+    for (long i = 0; i < num_files; ++i) {
+        long n = (i * 7919) % num_files;
+        int fd;
+        snprintf(path, sizeof(path), "%s/file%06ld.%s", dir, n,
+                 n % 2 ? "log" : "txt");
+        if ((fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644)) == -1) {
+            perror("open");
+            return 1;
+        }
+        close(fd);
+    }
+
+    cached = measure_glob(true, &cached_matches);
+    uncached = measure_glob(false, &uncached_matches);
+    baseline = measure_baseline(&baseline_matches);
+
+    printf("%ld files, %zu patterns, %zu matches\n", num_files, NUM_PATTERNS,
+           cached_matches);
+    printf("%-28s %10s\n", "expansion", "per line");
+    printf("%-28s %8.2fms\n", "cached listings", cached);
+    printf("%-28s %8.2fms\n", "uncached listings", uncached);
+    printf("%-28s %8.2fms\n", "readdir, fnmatch, and qsort", baseline);
+    if (uncached_matches != cached_matches ||
+        baseline_matches != cached_matches)
+        printf("mismatch: %zu and %zu matches\n", uncached_matches,
+               baseline_matches);
+
+    for (long i = 0; i < num_files; ++i) {
+        snprintf(path, sizeof(path), "%s/file%06ld.%s", dir, i,
+                 i % 2 ? "log" : "txt");
+        unlink(path);
+    }
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * Background job benchmark. Build with `make bench CFLAGS=-O2' and run
+ * build/bench_jobs [number of jobs]
+ *
+ * Launches many short background jobs with the job limit off and set to the
+ * number of online processors, then waits for all of them. Reports the
+ * throughput and the distribution of the latency of each job from the moment
+ * the shell was given it to the moment it finished. Each job is this program
+ * itself, which records when it finished in a file shared by all of the jobs.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "jobs.h"
+#include "shell.h"
+
+/** Return the current time in seconds, comparable between processes */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Compare two latencies for qsort */
+static int compare(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/** Run as a job: record the time at which job number index finished */
+static int stamp(const char *path, long index)
+{
+    double t = now();
+    int fd = open(path, O_WRONLY);
+    if (fd == -1 ||
+        pwrite(fd, &t, sizeof(t), sizeof(t) * index) != sizeof(t))
+        return 1;
+    close(fd);
+    return 0;
+}
+
+/** Run a number of jobs with a job limit and print the results */
+static void run(const char *self, const char *path, int num_jobs,
+                size_t limit)
+{
+    double *submitted = calloc(num_jobs, sizeof(double));
+    double *latencies = calloc(num_jobs, sizeof(double));
+    char line[4096], wait_line[] = "wait";
+    double start, elapsed;
+    int fd;
+
+    /* The file holds the time at which each job finished */
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1 || ftruncate(fd, sizeof(double) * num_jobs) == -1)
+        abort();
+
+    jobs_set_limit(limit);
+    start = now();
+    for (int i = 0; i < num_jobs; ++i) {
+        snprintf(line, sizeof(line), "%s --stamp %s %d &", self, path, i);
+        submitted[i] = now();
+        run_line(line);
+    }
+    run_line(wait_line);
+    elapsed = now() - start;
+
+    if (pread(fd, latencies, sizeof(double) * num_jobs, 0) !=
+        sizeof(double) * num_jobs)
+        abort();
+    close(fd);
+    for (int i = 0; i < num_jobs; ++i)
+        latencies[i] -= submitted[i];
+    qsort(latencies, num_jobs, sizeof(double), compare);
+
+    printf("%8s %8d %10.2f %10.0f %10.2f %10.2f %10.2f\n",
+           limit ? "on" : "off", num_jobs, elapsed, num_jobs / elapsed,
+           latencies[num_jobs / 2] * 1e3,
+           latencies[(size_t)(num_jobs * 0.99)] * 1e3,
+           latencies[num_jobs - 1] * 1e3);
+    free(latencies);
+    free(submitted);
+}
+
+int main(int argc, char **argv)
+{
+    char self[4096], path[] = "/tmp/bench_jobs.XXXXXX";
+    int num_jobs;
+    ssize_t len;
+    long cpus;
+    int fd;
+
+    if (argc == 4 && strcmp(argv[1], "--stamp") == 0)
+        return stamp(argv[2], atol(argv[3]));
+
+    num_jobs = argc > 1 ? atoi(argv[1]) : 10000;
+    if ((len = readlink("/proc/self/exe", self, sizeof(self) - 1)) == -1)
+        abort();
+    self[len] = '\0';
+    if ((fd = mkstemp(path)) == -1)
+        abort();
+    close(fd);
+
+    jobs_init();
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("limit %ld\n", cpus);
+    printf("%8s %8s %10s %10s %10s %10s %10s\n", "limiter", "jobs", "s",
+           "jobs/s", "p50 ms", "p99 ms", "max ms");
+    run(self, path, num_jobs, 0);
+    run(self, path, num_jobs, cpus > 0 ? cpus : 1);
+    unlink(path);
+    return 0;
+}
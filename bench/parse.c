@@ -0,0 +1,95 @@
+/*
+ * Parser scaling benchmark. Build with `make bench CFLAGS=-O2' and run
+ * build/bench_parse [maximum number of tokens]
+ *
+ * Reports the time to parse (and free) generated command lines of increasing
+ * numbers of tokens, which should grow linearly with the number of tokens, and
+ * the number of calls to malloc made per parse once the arena has warmed up,
+ * followed by the time to compile the parsed trees into execution plans.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "parser.h"
+#include "plan.h"
+
+/** The tokens which the command lines are generated from */
+static struct Token pattern[] = {
+    {OP_NONE, "grep", 4}, {OP_NONE, "-v", 2}, {OP_NONE, "foo", 3},
+    {OP_REDIR_IN, "<", 1}, {OP_NONE, "in", 2}, {OP_PIPE, "|", 1},
+    {OP_NONE, "sort", 4}, {OP_REDIR_OUT, ">", 1}, {OP_NONE, "out", 3},
+    {OP_AND, "&&", 2}, {OP_LPAREN, "(", 1}, {OP_NONE, "true", 4},
+    {OP_OR, "||", 2}, {OP_NONE, "false", 5}, {OP_RPAREN, ")", 1},
+    {OP_SEMICOLON, ";", 1},
+};
+
+/** The number of tokens in the pattern */
+#define PATTERN_LEN (sizeof(pattern) / sizeof(*pattern))
+
+/** Return the current time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    size_t max_tokens = argc > 1 ? atol(argv[1]) : 1000000;
+    struct Token *tokens = malloc(sizeof(*tokens) * (max_tokens + 1));
+
+    for (size_t i = 0; i < max_tokens; ++i)
+        tokens[i] = pattern[i % PATTERN_LEN];
+
+    printf("%10s %12s %12s %12s %12s %12s\n", "tokens", "parse ms",
+           "ns/token", "mallocs", "compile ms", "ns/token");
+    for (size_t n = 100; n <= max_tokens; n *= 10) {
+        /* Cut the line off after a whole number of repetitions */
+        size_t len = n - n % PATTERN_LEN, reps = 0, mallocs;
+        struct Arena arena = ARENA_INIT, plan_arena = ARENA_INIT;
+        struct SyntaxTree *tree;
+        double start, elapsed, compile_elapsed;
+
+        /* Warm up the arena */
+        parse(&arena, len, tokens);
+        arena_reset(&arena);
+        arena_reset(&cmdline_arena);
+        mallocs = arena.mallocs + cmdline_arena.mallocs;
+
+        start = now();
+        do {
+            if (!parse(&arena, len, tokens))
+                abort();
+            arena_reset(&arena);
+            /* The parser's scratch space comes from the command line arena */
+            arena_reset(&cmdline_arena);
+            ++reps;
+        } while ((elapsed = now() - start) < 0.2);
+
+        printf("%10zu %12.3f %12.1f %12.1f", len, elapsed / reps * 1e3,
+               elapsed / reps / len * 1e9,
+               (double)(arena.mallocs + cmdline_arena.mallocs - mallocs) /
+                   reps);
+
+        tree = parse(&arena, len, tokens);
+        reps = 0;
+        start = now();
+        do {
+            compile(&plan_arena, tree);
+            arena_reset(&plan_arena);
+            arena_reset(&cmdline_arena);
+            ++reps;
+        } while ((compile_elapsed = now() - start) < 0.2);
+
+        printf(" %12.3f %12.1f\n", compile_elapsed / reps * 1e3,
+               compile_elapsed / reps / len * 1e9);
+        arena_free(&arena);
+        arena_free(&plan_arena);
+    }
+
+    free(tokens);
+    return 0;
+}
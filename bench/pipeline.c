@@ -0,0 +1,79 @@
+/*
+ * Pipeline benchmark. Build with `make bench CFLAGS=-O2' and run
+ * build/bench_pipeline [maximum number of stages]
+ *
+ * Reports the number of processes created and the wall time to run pipelines
+ * of `cat' commands of increasing numbers of stages. The number of processes
+ * is estimated from how far process IDs advance, so it is only accurate on an
+ * otherwise idle system.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+
+#include "shell.h"
+
+/** Return the current time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Return the process ID of a new, short-lived process */
+static pid_t probe_pid(void)
+{
+    pid_t pid = fork();
+    if (pid == -1)
+        abort();
+    if (pid == 0)
+        _exit(0);
+    waitpid(pid, NULL, 0);
+    return pid;
+}
+
+/** Generate a pipeline of a number of stages */
+static char *generate_line(int stages)
+{
+    char *line = malloc(16 * stages + 32), *p = line;
+    p = stpcpy(p, "echo x");
+    for (int i = 1; i < stages; ++i)
+        p = stpcpy(p, " | cat");
+    strcpy(p, " > /dev/null");
+    return line;
+}
+
+int main(int argc, char **argv)
+{
+    int max_stages = argc > 1 ? atoi(argv[1]) : 64;
+
+    printf("%8s %12s %12s\n", "stages", "processes", "ms");
+    for (int stages = 2; stages <= max_stages; stages *= 2) {
+        char *line = generate_line(stages), *copy = strdup(line);
+        size_t reps = 0;
+        double start, elapsed;
+        pid_t before;
+
+        /* Count the processes of one run, then time repeated runs */
+        before = probe_pid();
+        run_line(copy);
+        printf("%8d %12d", stages, probe_pid() - before - 1);
+
+        start = now();
+        do {
+            strcpy(copy, line);
+            run_line(copy);
+            ++reps;
+        } while ((elapsed = now() - start) < 0.5);
+        printf(" %12.2f\n", elapsed / reps * 1e3);
+
+        free(copy);
+        free(line);
+    }
+    return 0;
+}
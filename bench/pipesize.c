@@ -0,0 +1,104 @@
+/*
+ * Pipe capacity benchmark. Build with `make bench CFLAGS=-O2' and run
+ * build/bench_pipesize [size of the input in MiB] [directory for the input]
+ *
+ * Reports the throughput of a pipeline of /bin/cat commands for a range of
+ * pipe capacities given with the pipesize prefix, including auto, along with
+ * the context switches of the stages per MiB moved. The input is written
+ * first, so it is read from the page cache as long as it fits in memory, and
+ * the best of a few runs is reported. The defaults are 1024 MiB in $TMPDIR or
+ * /tmp.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/resource.h>
+
+#include "jobs.h"
+#include "shell.h"
+
+/** The number of times each pipeline is run */
+#define REPS 3
+
+/** The capacities compared, as given to pipesize */
+static const char *capacities[] = {
+    "4k", "16k", "64k", "256k", "1m", "auto",
+};
+
+/** Return the current time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Write a file of a number of MiB of text */
+static void write_input(const char *path, long mib)
+{
+    static char buf[1 << 20];
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+    if (fd == -1) {
+        perror(path);
+        exit(1);
+    }
+    for (size_t i = 0; i < sizeof(buf); ++i)
+        buf[i] = i % 64 == 63 ? '\n' : 'a' + i % 26;
+    for (long i = 0; i < mib; ++i) {
+        if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+            perror(path);
+            exit(1);
+        }
+    }
+    fsync(fd);
+    close(fd);
+}
+
+int main(int argc, char **argv)
+{
+    long mib = argc > 1 ? atol(argv[1]) : 1024;
+    const char *dir = argc > 2 ? argv[2] : getenv("TMPDIR");
+    char in[4096];
+
+    if (!dir)
+        dir = "/tmp";
+    snprintf(in, sizeof(in), "%s/bench_pipesize.%d.in", dir, (int)getpid());
+    write_input(in, mib);
+    jobs_init();
+
+    printf("%8s %10s %10s %14s\n", "capacity", "s", "GiB/s", "switches/MiB");
+    for (size_t i = 0; i < sizeof(capacities) / sizeof(*capacities); ++i) {
+        double best = 1e9, switches = 0;
+
+        for (int rep = 0; rep < REPS; ++rep) {
+            struct rusage *usage = jobs_usage();
+            long before = usage->ru_nvcsw + usage->ru_nivcsw;
+            char *line;
+            double start;
+
+            if (asprintf(&line, "pipesize %s /bin/cat %s | /bin/cat | "
+                         "/bin/cat > /dev/null", capacities[i], in) == -1)
+                abort();
+            start = now();
+            run_line(line);
+            start = now() - start;
+            if (start < best) {
+                best = start;
+                switches = (double)(usage->ru_nvcsw + usage->ru_nivcsw -
+                                    before) / mib;
+            }
+            free(line);
+        }
+        printf("%8s %9.2fs %10.2f %14.1f\n", capacities[i], best,
+               mib / 1024.0 / best, switches);
+    }
+
+    unlink(in);
+    return 0;
+}
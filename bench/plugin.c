@@ -0,0 +1,86 @@
+/*
+ * Plugin benchmark. Build with `make bench CFLAGS=-O2' and run
+ * build/bench_plugin
+ *
+ * Loads the probe built-in from build/plugin_probe.so (next to the benchmark)
+ * and reports the time to run a command line with it against running the
+ * same check with the external test command, and the time to look up
+ * built-ins in the hash table of built-ins.
+ */
+#define _GNU_SOURCE
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "builtin.h"
+#include "jobs.h"
+#include "shell.h"
+
+/** Return the current time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Run a command line repeatedly for at least a fixed amount of time
+ * @return The time per command line in microseconds
+ */
+static double measure_line(const char *line)
+{
+    size_t len = strlen(line), reps = 0;
+    char *copy = malloc(len + 1);
+    double start = now(), elapsed;
+
+    do {
+        /* run_line() may modify the line, so work on a fresh copy */
+        memcpy(copy, line, len + 1);
+        if (run_line(copy) != 0)
+            abort();
+        ++reps;
+    } while ((elapsed = now() - start) < 0.5);
+    free(copy);
+    return elapsed / reps * 1e6;
+}
+
+/**
+ * Look up names among the built-ins repeatedly
+ * @return The time per lookup in nanoseconds
+ */
+static double measure_lookup(void)
+{
+    static const char *names[] = {"cd", "probe", "wait", "ls", "grep", "set"};
+    size_t reps = 0, found = 0;
+    double start = now(), elapsed;
+
+    do {
+        for (int i = 0; i < 1024; ++i)
+            found += is_builtin(names[i % (sizeof(names) / sizeof(*names))]);
+        reps += 1024;
+    } while ((elapsed = now() - start) < 0.5);
+    if (!found)
+        abort();
+    return elapsed / reps * 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    char *dir = dirname(strdup(argv[0])), *enable;
+
+    jobs_init();
+    if (asprintf(&enable, "enable -f %s/plugin_probe.so probe", dir) == -1 ||
+        run_line(enable) != 0)
+        return 1;
+
+    printf("%-28s %10s\n", "command", "time");
+    printf("%-28s %8.2fus\n", "probe / (plugin)", measure_line("probe /"));
+    printf("%-28s %8.2fus\n", "test -e / (external)",
+           measure_line("test -e /"));
+    printf("%-28s %8.1fns\n", "built-in lookup", measure_lookup());
+    free(enable);
+    return 0;
+}
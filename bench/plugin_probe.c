@@ -0,0 +1,23 @@
+/*
+ * An example plugin for the plugin benchmark, built by `make bench' as
+ * build/plugin_probe.so. It provides `probe path...', which succeeds if all of
+ * the paths exist, like `test -e' for each of them.
+ */
+#include <unistd.h>
+
+#include "plugin.h"
+
+/** Return whether all of the given paths exist */
+static int probe(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (access(argv[i], F_OK) != 0)
+            return 1;
+    }
+    return 0;
+}
+
+/** The built-in */
+const struct OshBuiltin osh_builtin_probe = {
+    OSH_PLUGIN_ABI_VERSION, "probe", probe
+};
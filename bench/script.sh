@@ -0,0 +1,37 @@
+#!/bin/sh
+# Script execution benchmark. Build osh first (`make CFLAGS=-O2') and run
+# bench/script.sh [number of lines]
+#
+# Reports the number of lines per second osh executes for a script consisting
+# only of builtin commands, run as a script file, with -c, and from a pipe.
+
+OSH=${OSH:-build/osh}
+LINES=${1:-200000}
+SCRIPT=$(mktemp)
+trap 'rm -f "$SCRIPT"' EXIT
+
+i=0
+while [ $i -lt "$LINES" ]; do
+	echo 'cd . && cd .'
+	i=$((i + 1))
+done > "$SCRIPT"
+
+# Print the lines per second of running the given command on the given number
+# of lines
+measure() {
+	lines=$1
+	shift
+	start=$(date +%s%N)
+	"$@" > /dev/null
+	end=$(date +%s%N)
+	echo $((lines * 1000000000 / (end - start)))
+}
+
+# The argument of -c is limited in size, so only use part of the script
+C_LINES=5000
+
+printf '%-8s %12s\n' mode lines/sec
+printf '%-8s %12s\n' file "$(measure "$LINES" "$OSH" "$SCRIPT")"
+printf '%-8s %12s\n' stdin "$(measure "$LINES" sh -c "'$OSH' < '$SCRIPT'")"
+printf '%-8s %12s\n' -c \
+	"$(measure $C_LINES "$OSH" -c "$(head -n $C_LINES "$SCRIPT")")"
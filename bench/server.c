@@ -0,0 +1,169 @@
+/*
+ * Server benchmark. Build with `make bench CFLAGS=-O2' and run
+ * build/bench_server [number of workers]
+ *
+ * Starts a server with a pool of workers (one per online processor by
+ * default) on a temporary socket and reports the requests per second it
+ * serves for a built-in command line and for one running /bin/true, with
+ * growing numbers of concurrent clients, each with a connection of its own.
+ * For comparison, it reports the command lines per second when each one gets
+ * a freshly executed process of its own instead, as with `osh -c'.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+
+#include "jobs.h"
+#include "server.h"
+#include "shell.h"
+#include "vars.h"
+
+/** The time spent on each measurement in seconds */
+#define DURATION 1.0
+
+/** The command lines which are measured */
+static const char *lines[] = {"cd .", "/bin/true"};
+
+/** The number of command lines */
+#define NUM_LINES (sizeof(lines) / sizeof(*lines))
+
+/** The temporary directory holding the socket, and the socket */
+static char dir[] = "/tmp/osh_bench_server.XXXXXX";
+static char path[sizeof(dir) + 8];
+
+/** Return the current time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Send a command line to the server over and over from a number of client
+ * processes at once
+ * @return The requests served per second
+ */
+static double measure_server(const char *line, int clients)
+{
+    pid_t pids[clients];
+    int fds[2];
+    long total = 0, count;
+
+    if (pipe(fds) == -1)
+        abort();
+    for (int i = 0; i < clients; ++i) {
+        if ((pids[i] = fork()) == 0) {
+            int sock = server_connect(path);
+            double start = now();
+
+            count = 0;
+            if (sock == -1)
+                abort();
+            do {
+                if (server_request(sock, line, strlen(line), NULL) != 0)
+                    abort();
+                ++count;
+            } while (now() - start < DURATION);
+            if (write(fds[1], &count, sizeof(count)) != sizeof(count))
+                abort();
+            _exit(0);
+        }
+    }
+    close(fds[1]);
+    while (read(fds[0], &count, sizeof(count)) == sizeof(count))
+        total += count;
+    close(fds[0]);
+    for (int i = 0; i < clients; ++i)
+        waitpid(pids[i], NULL, 0);
+    return total / DURATION;
+}
+
+/**
+ * Run a command line over and over in a freshly executed process each time
+ * @return The command lines run per second
+ */
+static double measure_exec(const char *self, const char *line)
+{
+    double start = now(), elapsed;
+    long count = 0;
+
+    do {
+        pid_t pid = fork();
+        int status;
+
+        if (pid == 0) {
+            execl(self, self, "-c", line, (char *)NULL);
+            _exit(127);
+        }
+        if (pid == -1 || waitpid(pid, &status, 0) == -1 ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            abort();
+        ++count;
+    } while ((elapsed = now() - start) < DURATION);
+    return count / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers;
+    pid_t server;
+    int sock;
+
+    /* Run as a fresh shell for the comparison */
+    if (argc == 3 && strcmp(argv[1], "-c") == 0) {
+        vars_init();
+        jobs_init();
+        return run_string(argv[2]);
+    }
+    workers = argc > 1 ? atoi(argv[1]) : cpus > 0 ? cpus : 1;
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/sock", dir);
+    vars_init();
+    jobs_init();
+    if ((server = fork()) == 0) {
+        server_run(path, workers);
+        perror("server_run");
+        _exit(1);
+    }
+    /* Wait for the server to listen */
+    while ((sock = server_connect(path)) == -1) {
+        if (errno != ENOENT && errno != ECONNREFUSED)
+            abort();
+        usleep(1000);
+    }
+    close(sock);
+
+    printf("%d workers\n%-10s", workers, "clients");
+    for (size_t i = 0; i < NUM_LINES; ++i)
+        printf(" %14s", lines[i]);
+    printf("\n");
+    for (int clients = 1; clients <= 2 * workers; clients *= 2) {
+        printf("%-10d", clients);
+        for (size_t i = 0; i < NUM_LINES; ++i)
+            printf(" %12.0f/s", measure_server(lines[i], clients));
+        printf("\n");
+    }
+    printf("%-10s", "exec");
+    for (size_t i = 0; i < NUM_LINES; ++i)
+        printf(" %12.0f/s", measure_exec("/proc/self/exe", lines[i]));
+    printf("\n");
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    unlink(path);
+    rmdir(dir);
+    return 0;
+}
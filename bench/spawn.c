@@ -0,0 +1,79 @@
+/*
+ * Process launch benchmark. Build with `make bench CFLAGS=-O2' and run
+ * build/bench_spawn [maximum resident size in MiB]
+ *
+ * Reports the time to launch /bin/true and wait for it with each backend of
+ * spawn() as the resident memory of the launching process grows, which makes
+ * fork slower as it copies more page tables.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/wait.h>
+
+#include "spawn.h"
+
+/** The command which is launched */
+static char *true_argv[] = {"/bin/true", NULL};
+
+/** Return the current time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Launch the command repeatedly for at least a fixed amount of time
+ * @return The time per launch in microseconds
+ */
+static double measure(void)
+{
+    size_t reps = 0;
+    double start = now(), elapsed;
+
+    do {
+        pid_t pid = spawn(true_argv, NULL, 0);
+        if (pid == -1 || waitpid(pid, NULL, 0) == -1)
+            abort();
+        ++reps;
+    } while ((elapsed = now() - start) < 0.5);
+    return elapsed / reps * 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    static const char *backends[] = {"fork", "vfork", "posix_spawn"};
+    size_t max_mib = argc > 1 ? atol(argv[1]) : 1024, mib = 0;
+    char *memory = NULL;
+
+    printf("%8s", "RSS MiB");
+    for (int i = 0; i < sizeof(backends) / sizeof(*backends); ++i)
+        printf(" %14s", backends[i]);
+    printf("\n");
+
+    for (size_t target = 0; target <= max_mib;
+            target = target ? 4 * target : 16) {
+        /* Touch the new memory so that it is resident */
+        if (target > mib) {
+            if (!(memory = realloc(memory, target << 20)))
+                abort();
+            memset(memory + (mib << 20), 1, (target - mib) << 20);
+            mib = target;
+        }
+
+        printf("%8zu", target);
+        for (int i = 0; i < sizeof(backends) / sizeof(*backends); ++i) {
+            spawn_select(backends[i]);
+            printf(" %11.1f us", measure());
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    free(memory);
+    return 0;
+}
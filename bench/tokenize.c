@@ -0,0 +1,89 @@
+/*
+ * Tokenizer throughput benchmark. Build with `make bench CFLAGS=-O2' and run
+ * build/bench_tokenize [huge line size in KiB]
+ *
+ * Reports the throughput of tokenize() in MB/s for a short, typical command
+ * line and for one huge generated line, using each available implementation
+ * of the word scanner.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "scan.h"
+#include "tokenizer.h"
+
+/** The short command line */
+static const char short_line[] =
+    "grep -r --include='*.c' \"struct Token\" src | sort -u > tokens.txt\n";
+
+/** The words which the huge command line is generated from */
+static const char *words[] = {
+    "/usr/lib/x86_64-linux-gnu/libfoo.so.1", "--output-directory=build",
+    "-DNDEBUG", "'quoted argument'", "a\\ b", "|", "&&", ";", ">", "x",
+};
+
+/** Return the current time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Generate a line of roughly the given size from the list of words */
+static char *generate_line(size_t size)
+{
+    char *line = malloc(size + 64), *p = line;
+    for (size_t i = 0; p - line < size; ++i) {
+        p = stpcpy(p, words[(i * 7) % (sizeof(words) / sizeof(*words))]);
+        *p++ = ' ';
+    }
+    strcpy(p, "\n");
+    return line;
+}
+
+/**
+ * Tokenize a line repeatedly for at least a fixed amount of time
+ * @return The throughput in MB/s
+ */
+static double measure(const char *line)
+{
+    size_t len = strlen(line), n = 0, bytes = 0;
+    struct Token *tokens = NULL;
+    char *copy = malloc(len + 1);
+    double start = now(), elapsed;
+
+    do {
+        for (int i = 0; i < 16; ++i) {
+            /* tokenize() may modify the line, so work on a fresh copy */
+            memcpy(copy, line, len + 1);
+            if (tokenize(&cmdline_arena, &tokens, &n, copy) == -1)
+                abort();
+            bytes += len;
+        }
+    } while ((elapsed = now() - start) < 0.5);
+
+    free(copy);
+    free(tokens);
+    return bytes / elapsed / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    static const char *impls[] = {"scalar", "sse2", "avx2"};
+    size_t huge_size = (argc > 1 ? atoi(argv[1]) : 512) * 1024;
+    char *huge_line = generate_line(huge_size);
+
+    printf("%-8s %12s %12s\n", "scanner", "short MB/s", "huge MB/s");
+    for (int i = 0; i < sizeof(impls) / sizeof(*impls); ++i) {
+        if (scan_select(impls[i]) == -1)
+            continue;
+        printf("%-8s %12.1f %12.1f\n", impls[i], measure(short_line),
+               measure(huge_line));
+    }
+
+    free(huge_line);
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Variable benchmark. Build with `make bench CFLAGS=-O2' and run
+ * build/bench_vars [number of variables in the large environment]
+ *
+ * Reports the throughput of tokenize() for a line full of expansions against
+ * the same line with the values written out, and the time to spawn /bin/true
+ * with the inherited environment and with a large one (10000 exported
+ * variables by default), both when the environment is unchanged between
+ * commands and when an exported variable changes before each one, so that
+ * the environment has to be rebuilt every time, along with the time the
+ * rebuilding itself takes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "jobs.h"
+#include "shell.h"
+#include "tokenizer.h"
+#include "vars.h"
+
+/** The number of commands spawned per measurement */
+#define SPAWNS 2000
+
+/** The line full of expansions */
+static const char expanded_line[] =
+    "$CC $CFLAGS -I\"$SRCDIR/include\" -o ${OUT}.o -c $SRC \"$DEFS\" "
+    "$LDFLAGS${LIBS} > $LOG\n";
+
+/** The same line with the values of the variables written out */
+static const char literal_line[] =
+    "cc -O2 -Wall -I\"/home/user/src/project/include\" -o build/main.o -c "
+    "main.c \"-DNDEBUG -DVERSION=3\" -L/usr/local/lib-lm > build.log\n";
+
+/** The variables expanded by the line */
+static const char *line_vars[][2] = {
+    {"CC", "cc"}, {"CFLAGS", "-O2 -Wall"},
+    {"SRCDIR", "/home/user/src/project"}, {"OUT", "build/main"},
+    {"SRC", "main.c"},
+    {"DEFS", "-DNDEBUG -DVERSION=3"}, {"LDFLAGS", "-L/usr/local/lib"},
+    {"LIBS", "-lm"}, {"LOG", "build.log"},
+};
+
+/** Return the current time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Tokenize a line repeatedly for at least a fixed amount of time
+ * @return The number of lines tokenized per second
+ */
+static double measure_tokenize(const char *line)
+{
+    size_t len = strlen(line), n = 0, lines = 0;
+    struct Token *tokens = NULL;
+    char *copy = malloc(len + 1);
+    double start = now(), elapsed;
+
+    do {
+        for (int i = 0; i < 256; ++i) {
+            /* tokenize() may modify the line, so work on a fresh copy */
+            memcpy(copy, line, len + 1);
+            if (tokenize(&cmdline_arena, &tokens, &n, copy) == -1)
+                abort();
+            arena_reset(&cmdline_arena);
+        }
+        lines += 256;
+    } while ((elapsed = now() - start) < 0.5);
+
+    free(copy);
+    free(tokens);
+    return lines / elapsed;
+}
+
+/**
+ * Spawn /bin/true a number of times, changing an exported variable before each
+ * one if asked
+ * @return The average time per command in microseconds
+ */
+static double measure_spawn(bool change)
+{
+    char line[] = "/bin/true";
+    double start = now();
+
+    for (int i = 0; i < SPAWNS; ++i) {
+        if (change)
+            var_set("BENCH_CHANGED", strlen("BENCH_CHANGED"),
+                    i % 2 ? "odd" : "even", true);
+        run_line(line);
+    }
+    return (now() - start) / SPAWNS * 1e6;
+}
+
+/**
+ * Change an exported variable and rebuild the environment repeatedly
+ * @return The average time per rebuild in microseconds
+ */
+static double measure_rebuild(void)
+{
+    double start = now();
+
+    for (int i = 0; i < SPAWNS; ++i) {
+        var_set("BENCH_CHANGED", strlen("BENCH_CHANGED"),
+                i % 2 ? "odd" : "even", true);
+        vars_environ();
+    }
+    return (now() - start) / SPAWNS * 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    long num_vars = argc > 1 ? atol(argv[1]) : 10000;
+
+    vars_init();
+    jobs_init();
+    for (size_t i = 0; i < sizeof(line_vars) / sizeof(*line_vars); ++i)
+        var_set(line_vars[i][0], strlen(line_vars[i][0]), line_vars[i][1],
+                false);
+
+    printf("%-24s %12s\n", "tokenize", "lines/s");
+    printf("%-24s %12.0f\n", "literal", measure_tokenize(literal_line));
+    printf("%-24s %12.0f\n", "expanded", measure_tokenize(expanded_line));
+
+    printf("\n%-24s %12s %12s %12s\n", "spawn /bin/true", "unchanged",
+           "changed", "rebuild");
+    printf("%-24s %10.1fus %10.1fus %10.1fus\n", "inherited environment",
+           measure_spawn(false), measure_spawn(true), measure_rebuild());
+
+    for (long i = 0; i < num_vars; ++i) {
+        char name[32], value[64];
+        snprintf(name, sizeof(name), "BENCH_VAR_%ld", i);
+        snprintf(value, sizeof(value), "value of variable number %ld", i);
+        var_set(name, strlen(name), value, true);
+    }
+    printf("%-18s %5ld %10.1fus %10.1fus %10.1fus\n", "exported variables",
+           num_vars, measure_spawn(false), measure_spawn(true),
+           measure_rebuild());
+    return 0;
+}
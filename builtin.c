@@ -1,15 +1,52 @@
+#include <dlfcn.h>
 #include <error.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <sys/stat.h>
+
+#include "builtin.h"
+#include "cache.h"
+#include "cmdline.h"
+#include "copy.h"
+#include "glob.h"
+#include "hash.h"
+#include "jobs.h"
+#include "path.h"
+#include "plugin.h"
+#include "table.h"
+#include "trace.h"
+#include "vars.h"
+
 /**
  * A built-in command taking an arbitrary number of arguments
  * @return The exit status of the command
  */
 typedef int(*builtin_function)(int, char**);
 
+/**
+ * Set shell variables, given as NAME=value words in place of a command. Words
+ * which are not assignments may not follow them
+ */
+static int builtin_assign(int argc, char **argv);
+
+/**
+ * Continue stopped jobs in the background, given by job specifications (the
+ * current job by default)
+ */
+static int builtin_bg(int argc, char **argv);
+
+/**
+ * Concatenate files (or standard input, given as a dash or by default) to
+ * standard output, moving the data in the kernel where possible. Options
+ * other than -u are left to the external cat
+ */
+static int builtin_cat(int argc, char **argv);
+
 /**
  * Change the current working directory of the shell. If no arguments are
  * given, change to the users home directory based on the HOME environment
@@ -18,12 +55,148 @@ typedef int(*builtin_function)(int, char**);
  */
 static int builtin_cd(int argc, char **argv);
 
+/**
+ * Remove jobs from the job table, so that they are no longer reported or
+ * waited for (the current job by default)
+ */
+static int builtin_disown(int argc, char **argv);
+
+/**
+ * Load built-ins from a plugin (see plugin.h) with -f followed by the path of
+ * the shared object and the names of the built-ins, or remove loaded built-ins
+ * with -d followed by their names (their plugins stay loaded). With no
+ * arguments, print the built-ins as enable commands
+ */
+static int builtin_enable(int argc, char **argv);
+
 /**
  * Exit the shell with an exit status given by an optional first argument
  * (defaults to 0)
  */
 static int builtin_exit(int argc, char **argv);
 
+/**
+ * Export variables to the environment of commands, setting them first if
+ * they are given as NAME=value. With no arguments (or -p), print the exported
+ * variables as export commands
+ */
+static int builtin_export(int argc, char **argv);
+
+/**
+ * Continue a job (the current job by default) in the foreground and wait for
+ * it to exit or stop
+ */
+static int builtin_fg(int argc, char **argv);
+
+/**
+ * Print the statistics of the cache of parsed command lines. With -c, clear
+ * the cache instead, and with -s followed by a number of bytes, set the
+ * maximum size of the cache (zero disables it)
+ */
+static int builtin_cmdcache(int argc, char **argv);
+
+/**
+ * Print the hash table of command locations. With -r, clear the table instead,
+ * and with names of commands, look them up and add them to the table
+ */
+static int builtin_hash(int argc, char **argv);
+
+/** Print the jobs in the job table, removing the ones which are done */
+static int builtin_jobs(int argc, char **argv);
+
+/** Clear the hash table of command locations (the same as hash -r) */
+static int builtin_rehash(int argc, char **argv);
+
+/**
+ * Set options of the shell: with -j followed by a number, the maximum number
+ * of jobs running at once (zero for no limit), above which jobs are queued,
+ * with -p followed by a capacity, the capacity of pipes (as given to the
+ * pipesize prefix), and with -g followed by on or off, whether directory
+ * listings are cached for glob patterns. With no arguments, print the options
+ */
+static int builtin_set(int argc, char **argv);
+
+/**
+ * Copy standard input to standard output and to each of the given files,
+ * appending to them with -a. Other options are left to the external tee
+ */
+static int builtin_tee(int argc, char **argv);
+
+/**
+ * Print how each of the given names would be interpreted as a command: as a
+ * built-in command, a hashed command, or a command found in PATH
+ */
+static int builtin_type(int argc, char **argv);
+
+/**
+ * Print the exit statuses of the stages of the last pipeline, or of the last
+ * command if it wasn't a pipeline
+ */
+static int builtin_pipestatus(int argc, char **argv);
+
+/** Unset variables, which are no longer exported either */
+static int builtin_unset(int argc, char **argv);
+
+/**
+ * Wait for the jobs given by job specifications to exit or stop, or for all of
+ * the jobs if none are given
+ */
+static int builtin_wait(int argc, char **argv);
+
+/** Find the function of a built-in by name, or return NULL if there is none */
+static builtin_function find_builtin(const char *name);
+
+/**
+ * Add the compiled-in built-ins to the hash table if they haven't been added
+ * yet
+ */
+static void init_builtins(void);
+
+/** Return whether a slot of the hash table holds a built-in */
+static bool is_full(const void *slot);
+
+/** Return whether a built-in has a given name */
+static bool matches(const void *slot, const void *name);
+
+/**
+ * Find the slot of a built-in in the hash table, or the empty slot where it
+ * would be inserted if there is no such built-in
+ */
+static struct BuiltinSlot *find_slot(const char *name, uint64_t hash);
+
+/**
+ * Add a built-in to the hash table, replacing any built-in of the same name
+ * @param plugin The path of the plugin the built-in was loaded from, or NULL
+ * if it is compiled in
+ */
+static void add_builtin(const char *name, builtin_function func,
+                        const char *plugin);
+
+/**
+ * Load a built-in from a plugin which was opened with dlopen, printing an
+ * error message if it can't be loaded
+ * @return Zero on success, 1 on failure
+ */
+static int load_builtin(void *handle, const char *path, const char *name);
+
+/**
+ * Return the length of the name of an assignment (NAME=value), or zero if a
+ * word isn't one
+ */
+static size_t assignment_len(const char *word);
+
+/** Print a variable as an export command if it is exported */
+static void print_export(const char *entry, size_t len, bool exported);
+
+/** Print an entry of the hash table of command locations */
+static void print_hashed(const char *name, const char *path, size_t hits);
+
+/**
+ * Find a job by its specification for a built-in (the current job if spec is
+ * NULL), printing an error message if there is no such job
+ */
+static struct Job *find_job(const char *builtin, const char *spec);
+
 /** An entry in the table of built-ins */
 struct builtin_entry {
     /** The command string */
@@ -33,27 +206,162 @@ struct builtin_entry {
     builtin_function func;
 };
 
+/** A slot of the hash table of built-ins */
+struct BuiltinSlot {
+    /** The hash of the name */
+    uint64_t hash;
+
+    /** The name, or NULL if the slot is empty */
+    char *name;
+
+    /** The function */
+    builtin_function func;
+
+    /**
+     * The path of the plugin the built-in was loaded from, or NULL if it is
+     * compiled in
+     */
+    char *plugin;
+};
+
 /** The table of built-in command */
 static struct builtin_entry builtins[] = {
+    {"bg", builtin_bg},
+    {"cat", builtin_cat},
     {"cd", builtin_cd},
+    {"cmdcache", builtin_cmdcache},
+    {"disown", builtin_disown},
+    {"enable", builtin_enable},
     {"exit", builtin_exit},
+    {"export", builtin_export},
+    {"fg", builtin_fg},
+    {"hash", builtin_hash},
+    {"jobs", builtin_jobs},
+    {"pipestatus", builtin_pipestatus},
+    {"rehash", builtin_rehash},
+    {"set", builtin_set},
+    {"tee", builtin_tee},
+    {"type", builtin_type},
+    {"unset", builtin_unset},
+    {"wait", builtin_wait},
 };
 
+/**
+ * The hash table of built-ins, both the ones compiled in (added the first
+ * time a built-in is looked up) and the ones loaded from plugins, whose slots
+ * are struct BuiltinSlot
+ */
+static struct Table table = {NULL, sizeof(struct BuiltinSlot), 0, 0};
+
 /* See builtin.h */
 int exec_builtin(int argc, char **argv)
 {
-    for (int i = 0; i < sizeof(builtins) / sizeof(*builtins); ++i) {
-        if (strcmp(builtins[i].name, argv[0]) == 0)
-            return builtins[i].func(argc, argv);
+    builtin_function func = find_builtin(argv[0]);
+    uint64_t start = trace_start();
+    int status;
+
+    if (!func)
+        return -1;
+    status = func(argc, argv);
+    /* Keep output in order with that of external commands */
+    fflush(stdout);
+    if (tracing)
+        trace_span(argv[0], NULL, start);
+    return status;
+}
+
+/* See builtin.h */
+bool is_builtin(const char *name)
+{
+    return find_builtin(name);
+}
+
+/* See above */
+static int builtin_assign(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (!assignment_len(argv[i])) {
+            error(0, 0, "%s: assignments before a command are not supported",
+                  argv[i]);
+            return 1;
+        }
     }
-    return -1;
+    for (int i = 0; i < argc; ++i) {
+        size_t len = assignment_len(argv[i]);
+        var_set(argv[i], len, argv[i] + len + 1, false);
+    }
+    return 0;
+}
+
+/* See above */
+static int builtin_bg(int argc, char **argv)
+{
+    int status = 0;
+
+    /* With no arguments, argv[1] is NULL, which is the current job */
+    for (int i = 1; i == 1 || i < argc; ++i) {
+        struct Job *job = find_job("bg", argv[i]);
+        if (!job) {
+            status = 1;
+            continue;
+        }
+        job_continue(job);
+        printf("[%d] %s &\n", job->id, job->name);
+    }
+    return status;
+}
+
+/* See above */
+static int builtin_cat(int argc, char **argv)
+{
+    struct stat out_st, st;
+    bool out_regular;
+    int i = 1, status = 0;
+
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "--") == 0) {
+            ++i;
+            break;
+        } else if (strcmp(argv[i], "-u") != 0)
+            return -1;
+    }
+    out_regular = fstat(STDOUT_FILENO, &out_st) == 0 &&
+        S_ISREG(out_st.st_mode);
+
+    /* With no files, argv[argc] is NULL, which is standard input */
+    for (int first = i; i == first || i < argc; ++i) {
+        const char *path = argv[i] ? argv[i] : "-";
+        bool is_stdin = strcmp(path, "-") == 0;
+        int fd = is_stdin ? STDIN_FILENO : open(path, O_RDONLY | O_CLOEXEC);
+        int err;
+
+        if (fd == -1) {
+            error(0, errno, "cat: %s", path);
+            status = 1;
+            continue;
+        }
+
+        /* Appending a file to itself would never reach the end of it */
+        if (out_regular && fstat(fd, &st) == 0 && st.st_size > 0 &&
+            st.st_dev == out_st.st_dev && st.st_ino == out_st.st_ino) {
+            error(0, 0, "cat: %s: input file is output file", path);
+            status = 1;
+        } else if ((err = copy_fd(fd, STDOUT_FILENO))) {
+            error(0, err, "cat: %s", path);
+            status = 1;
+        }
+        if (!is_stdin)
+            close(fd);
+    }
+    return status;
 }
 
 /* See above */
 static int builtin_cd(int argc, char **argv)
 {
     static char *prev_path = NULL;
-    char *cwd = getcwd(NULL, 0), *path = argv[1];
+    char *cwd = getcwd(NULL, 0);
+    const char *path = argv[1];
 
     if (!cwd) {
         error(0, errno, "error");
@@ -64,7 +372,7 @@ static int builtin_cd(int argc, char **argv)
         prev_path = cwd;
 
     if (!argv[1])
-        path = getenv("HOME");
+        path = var_get("HOME");
     else if (strcmp(argv[1], "-") == 0)
         path = prev_path;
 
@@ -77,6 +385,75 @@ static int builtin_cd(int argc, char **argv)
     return 0;
 }
 
+/* See above */
+static int builtin_disown(int argc, char **argv)
+{
+    int status = 0;
+
+    for (int i = 1; i == 1 || i < argc; ++i) {
+        struct Job *job = find_job("disown", argv[i]);
+        if (job)
+            job_remove(job);
+        else
+            status = 1;
+    }
+    return status;
+}
+
+/* See above */
+static int builtin_enable(int argc, char **argv)
+{
+    int status = 0;
+
+    if (argc == 1) {
+        for (size_t i = 0; i < sizeof(builtins) / sizeof(*builtins); ++i)
+            printf("enable %s\n", builtins[i].name);
+        init_builtins();
+        for (size_t i = 0; i < table.num_slots; ++i) {
+            struct BuiltinSlot *slot = table_slot(&table, i);
+            if (slot->name && slot->plugin)
+                printf("enable -f %s %s\n", slot->plugin, slot->name);
+        }
+        return 0;
+    } else if (argc > 3 && strcmp(argv[1], "-f") == 0) {
+        void *handle = dlopen(argv[2], RTLD_NOW | RTLD_LOCAL);
+        bool loaded = false;
+
+        if (!handle) {
+            error(0, 0, "enable: %s", dlerror());
+            return 1;
+        }
+        for (int i = 3; i < argc; ++i) {
+            if (load_builtin(handle, argv[2], argv[i]))
+                status = 1;
+            else
+                loaded = true;
+        }
+        /* Every loaded built-in keeps its plugin open for good */
+        if (!loaded)
+            dlclose(handle);
+        return status;
+    } else if (argc > 2 && strcmp(argv[1], "-d") == 0) {
+        for (int i = 2; i < argc; ++i) {
+            struct BuiltinSlot *slot;
+
+            init_builtins();
+            slot = find_slot(argv[i], hash_string(argv[i], strlen(argv[i])));
+            if (!slot->name || !slot->plugin) {
+                error(0, 0, "enable: %s: not a loaded builtin", argv[i]);
+                status = 1;
+                continue;
+            }
+            free(slot->name);
+            free(slot->plugin);
+            table_remove(&table, slot, is_full);
+        }
+        return status;
+    }
+    error(0, 0, "usage: enable [-f file name... | -d name...]");
+    return 1;
+}
+
 /* See above */
 static int builtin_exit(int argc, char **argv)
 {
@@ -85,3 +462,455 @@ static int builtin_exit(int argc, char **argv)
         status = atoi(argv[1]) % 256;
     exit(status);
 }
+
+/* See above */
+static int builtin_export(int argc, char **argv)
+{
+    int status = 0;
+
+    if (argc == 1 || (argc == 2 && strcmp(argv[1], "-p") == 0)) {
+        vars_foreach(print_export);
+        return 0;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        size_t len = assignment_len(argv[i]);
+
+        if (len)
+            var_set(argv[i], len, argv[i] + len + 1, true);
+        else if ((len = strlen(argv[i])) > 0 &&
+                 var_name_len(argv[i], argv[i] + len) == len)
+            var_set(argv[i], len, NULL, true);
+        else {
+            error(0, 0, "export: %s: not a valid identifier", argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/* See above */
+static int builtin_fg(int argc, char **argv)
+{
+    struct Job *job;
+    int status;
+
+    if (argc > 2) {
+        error(0, 0, "usage: fg [job]");
+        return 1;
+    } else if (!(job = find_job("fg", argv[1])))
+        return 1;
+
+    printf("%s\n", job->name);
+    fflush(stdout);
+    job_continue(job);
+    status = job_wait(job);
+    if (job->state == JOB_DONE)
+        job_remove(job);
+    return status;
+}
+
+/* See above */
+static int builtin_cmdcache(int argc, char **argv)
+{
+    struct CacheStats stats;
+
+    if (argc == 2 && strcmp(argv[1], "-c") == 0) {
+        cache_clear();
+        return 0;
+    } else if (argc == 3 && strcmp(argv[1], "-s") == 0) {
+        char *end;
+        unsigned long long max_size = strtoull(argv[2], &end, 10);
+        if (!*argv[2] || *end) {
+            error(0, 0, "cmdcache: invalid size: %s", argv[2]);
+            return 1;
+        }
+        cache_set_max_size(max_size);
+        return 0;
+    } else if (argc != 1) {
+        error(0, 0, "usage: cmdcache [-c | -s size]");
+        return 1;
+    }
+
+    stats = cache_stats();
+    printf("hits %zu\nmisses %zu\nentries %zu\nsize %zu\nmax_size %zu\n",
+           stats.hits, stats.misses, stats.entries, stats.size,
+           stats.max_size);
+    return 0;
+}
+
+/* See above */
+static int builtin_hash(int argc, char **argv)
+{
+    int status = 0;
+
+    if (argc == 1) {
+        if (path_foreach(NULL) == 0)
+            error(0, 0, "hash: hash table empty");
+        else {
+            printf("hits\tcommand\n");
+            path_foreach(print_hashed);
+        }
+        return 0;
+    } else if (strcmp(argv[1], "-r") == 0) {
+        if (argc != 2) {
+            error(0, 0, "usage: hash [-r | name...]");
+            return 1;
+        }
+        path_clear();
+        return 0;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        if (is_builtin(argv[i]))
+            continue;
+        if (!path_lookup(argv[i])) {
+            error(0, 0, "hash: %s: not found", argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/* See above */
+static int builtin_jobs(int argc, char **argv)
+{
+    struct Job *job = jobs_first();
+
+    jobs_reap();
+    while (job) {
+        struct Job *next = job->next;
+        job_print(job);
+        if (job->state == JOB_DONE)
+            job_remove(job);
+        job = next;
+    }
+    return 0;
+}
+
+/* See above */
+static int builtin_rehash(int argc, char **argv)
+{
+    path_clear();
+    return 0;
+}
+
+/* See above */
+static int builtin_set(int argc, char **argv)
+{
+    if (argc == 1) {
+        size_t capacity = pipe_capacity();
+        printf("set -j %zu\n", jobs_limit());
+        if (capacity == PIPE_ADAPTIVE)
+            printf("set -p auto\n");
+        else
+            printf("set -p %zu\n", capacity);
+        printf("set -g %s\n", glob_cache() ? "on" : "off");
+        return 0;
+    } else if (argc == 3 && strcmp(argv[1], "-p") == 0) {
+        size_t capacity;
+        if (!parse_pipe_size(argv[2], strlen(argv[2]), &capacity)) {
+            error(0, 0, "set: invalid pipe capacity: %s", argv[2]);
+            return 1;
+        }
+        set_pipe_capacity(capacity);
+        return 0;
+    } else if (argc == 3 && strcmp(argv[1], "-j") == 0) {
+        char *end;
+        unsigned long long limit = strtoull(argv[2], &end, 10);
+        if (!*argv[2] || *end) {
+            error(0, 0, "set: invalid number of jobs: %s", argv[2]);
+            return 1;
+        }
+        jobs_set_limit(limit);
+        return 0;
+    } else if (argc == 3 && strcmp(argv[1], "-g") == 0) {
+        if (strcmp(argv[2], "on") != 0 && strcmp(argv[2], "off") != 0) {
+            error(0, 0, "set: invalid glob cache setting: %s", argv[2]);
+            return 1;
+        }
+        glob_set_cache(strcmp(argv[2], "on") == 0);
+        return 0;
+    }
+    error(0, 0, "usage: set [-j jobs | -p capacity | -g on|off]");
+    return 1;
+}
+
+/* See above */
+static int builtin_tee(int argc, char **argv)
+{
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, i = 1, status = 0;
+    int *outs, err;
+    size_t num_outs = 0;
+
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+        if (strcmp(argv[i], "--") == 0) {
+            ++i;
+            break;
+        } else if (strcmp(argv[i], "-a") == 0)
+            flags = (flags & ~O_TRUNC) | O_APPEND;
+        else
+            return -1;
+    }
+
+    if (!(outs = malloc(sizeof(int) * (argc - i + 1))))
+        error(1, errno, "fatal error");
+    outs[num_outs++] = STDOUT_FILENO;
+    for (; i < argc; ++i) {
+        if ((outs[num_outs] = open(argv[i], flags, 0666)) == -1) {
+            error(0, errno, "tee: %s", argv[i]);
+            status = 1;
+        } else
+            ++num_outs;
+    }
+
+    if ((err = tee_fds(STDIN_FILENO, outs, num_outs))) {
+        error(0, err, "tee");
+        status = 1;
+    }
+    for (size_t j = 1; j < num_outs; ++j)
+        close(outs[j]);
+    free(outs);
+    return status;
+}
+
+/* See above */
+static int builtin_type(int argc, char **argv)
+{
+    int status = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *hashed;
+        char *path;
+
+        if (is_builtin(argv[i]))
+            printf("%s is a shell builtin\n", argv[i]);
+        else if ((hashed = path_hashed(argv[i])))
+            printf("%s is hashed (%s)\n", argv[i], hashed);
+        else if (strchr(argv[i], '/')) {
+            if (access(argv[i], X_OK) == 0)
+                printf("%s is %s\n", argv[i], argv[i]);
+            else {
+                error(0, 0, "type: %s: not found", argv[i]);
+                status = 1;
+            }
+        } else if ((path = path_search(argv[i]))) {
+            printf("%s is %s\n", argv[i], path);
+            free(path);
+        } else {
+            error(0, 0, "type: %s: not found", argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/* See above */
+static int builtin_pipestatus(int argc, char **argv)
+{
+    const int *statuses;
+    size_t num_statuses = last_statuses(&statuses);
+
+    for (size_t i = 0; i < num_statuses; ++i)
+        printf("%s%d", i ? " " : "", statuses[i]);
+    printf("\n");
+    return 0;
+}
+
+/* See above */
+static int builtin_unset(int argc, char **argv)
+{
+    int status = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        size_t len = strlen(argv[i]);
+
+        if (len > 0 && var_name_len(argv[i], argv[i] + len) == len)
+            var_unset(argv[i]);
+        else {
+            error(0, 0, "unset: %s: not a valid identifier", argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/* See above */
+static int builtin_wait(int argc, char **argv)
+{
+    struct Job *job, *next;
+    int status = 0;
+
+    if (argc == 1) {
+        for (job = jobs_first(); job; job = next) {
+            next = job->next;
+            job_wait(job);
+            if (job->state == JOB_DONE)
+                job_remove(job);
+        }
+        return 0;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        if (!(job = find_job("wait", argv[i]))) {
+            status = 127;
+            continue;
+        }
+        status = job_wait(job);
+        if (job->state == JOB_DONE)
+            job_remove(job);
+    }
+    return status;
+}
+
+/* See above */
+static builtin_function find_builtin(const char *name)
+{
+    struct BuiltinSlot *slot;
+
+    if (assignment_len(name))
+        return builtin_assign;
+    init_builtins();
+    slot = find_slot(name, hash_string(name, strlen(name)));
+    return slot->name ? slot->func : NULL;
+}
+
+/* See above */
+static void init_builtins(void)
+{
+    if (table.num_slots)
+        return;
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(*builtins); ++i)
+        add_builtin(builtins[i].name, builtins[i].func, NULL);
+}
+
+/* See above */
+static bool is_full(const void *slot)
+{
+    return ((const struct BuiltinSlot *)slot)->name;
+}
+
+/* See above */
+static bool matches(const void *slot, const void *name)
+{
+    return strcmp(((const struct BuiltinSlot *)slot)->name, name) == 0;
+}
+
+/* See above */
+static struct BuiltinSlot *find_slot(const char *name, uint64_t hash)
+{
+    return table_find(&table, hash, is_full, matches, name);
+}
+
+/* See above */
+static void add_builtin(const char *name, builtin_function func,
+                        const char *plugin)
+{
+    uint64_t hash = hash_string(name, strlen(name));
+    struct BuiltinSlot *slot;
+
+    table_reserve(&table, is_full);
+    slot = find_slot(name, hash);
+    if (slot->name) {
+        free(slot->name);
+        free(slot->plugin);
+    } else
+        ++table.num_full;
+    slot->hash = hash;
+    slot->func = func;
+    slot->name = strdup(name);
+    slot->plugin = plugin ? strdup(plugin) : NULL;
+    if (!slot->name || (plugin && !slot->plugin))
+        error(1, errno, "fatal error");
+}
+
+/* See above */
+static int load_builtin(void *handle, const char *path, const char *name)
+{
+    const struct OshBuiltin *builtin;
+    struct BuiltinSlot *slot;
+    char *symbol;
+
+    if (!(symbol = malloc(strlen(OSH_BUILTIN_PREFIX) + strlen(name) + 1)))
+        error(1, errno, "fatal error");
+    strcpy(stpcpy(symbol, OSH_BUILTIN_PREFIX), name);
+    builtin = dlsym(handle, symbol);
+    free(symbol);
+
+    if (!builtin) {
+        error(0, 0, "enable: %s: not found in %s", name, path);
+        return 1;
+    } else if (builtin->abi_version < 1 ||
+               builtin->abi_version > OSH_PLUGIN_ABI_VERSION) {
+        error(0, 0, "enable: %s: unsupported plugin version %u", name,
+              builtin->abi_version);
+        return 1;
+    } else if (!builtin->name || strcmp(builtin->name, name) != 0 ||
+               !builtin->func) {
+        error(0, 0, "enable: %s: invalid builtin in %s", name, path);
+        return 1;
+    }
+
+    /* Loaded built-ins may replace each other but not the compiled-in ones */
+    init_builtins();
+    slot = find_slot(name, hash_string(name, strlen(name)));
+    if (slot->name && !slot->plugin) {
+        error(0, 0, "enable: %s: is a compiled-in builtin", name);
+        return 1;
+    }
+    add_builtin(name, builtin->func, path);
+    return 0;
+}
+
+/* See above */
+static size_t assignment_len(const char *word)
+{
+    const char *equals = strchr(word, '=');
+    size_t len;
+
+    if (!equals)
+        return 0;
+    len = var_name_len(word, equals);
+    return len == equals - word ? len : 0;
+}
+
+/* See above */
+static void print_export(const char *entry, size_t len, bool exported)
+{
+    if (!exported)
+        return;
+    printf("export %.*s", (int)len, entry);
+
+    /* The value is quoted so that the command can be run again */
+    if (entry[len] == '=') {
+        printf("='");
+        for (const char *p = entry + len + 1; *p; ++p) {
+            if (*p == '\'')
+                printf("'\\''");
+            else
+                putchar(*p);
+        }
+        putchar('\'');
+    }
+    putchar('\n');
+}
+
+/* See above */
+static void print_hashed(const char *name, const char *path, size_t hits)
+{
+    printf("%4zu\t%s\n", hits, path);
+}
+
+/* See above */
+static struct Job *find_job(const char *builtin, const char *spec)
+{
+    struct Job *job = job_find(spec);
+
+    if (!job) {
+        if (spec)
+            error(0, 0, "%s: %s: no such job", builtin, spec);
+        else
+            error(0, 0, "%s: no current job", builtin);
+    }
+    return job;
+}
@@ -1,11 +1,17 @@
 #ifndef BUILTIN_H
 #define BUILTIN_H
 
+#include <stdbool.h>
+
 /**
  * Execute a built-in shell command with the given command line arguments
  * @return The return status of the command, or -1 if there was an error (e.g.,
- * the command was not found
+ * the command was not found, or the built-in leaves the arguments it was given
+ * to the external command of the same name)
  */
 int exec_builtin(int argc, char **argv);
 
+/** Return whether there is a built-in command with the given name */
+bool is_builtin(const char *name);
+
 #endif /* BUILTIN_H */
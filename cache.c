@@ -0,0 +1,240 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "error.h"
+#include "hash.h"
+#include "vars.h"
+
+/** The default maximum size of the cache in bytes */
+#define DEFAULT_MAX_SIZE (1024 * 1024)
+
+/** The initial number of buckets in the hash table */
+#define INITIAL_BUCKETS 64
+
+/** The hash table of cache entries */
+static struct CacheEntry **buckets = NULL;
+
+/** The number of buckets in the hash table (always a power of two) */
+static size_t num_buckets = 0;
+
+/** The most and least recently used entries */
+static struct CacheEntry *newest = NULL, *oldest = NULL;
+
+/**
+ * The entry whose plan was last returned, which may still be executing, and
+ * whether it has been evicted and needs to be freed once it is released
+ */
+static struct CacheEntry *in_use = NULL;
+static bool in_use_evicted = false;
+
+/** The statistics of the cache, which also track its size */
+static struct CacheStats stats = {0, 0, 0, 0, DEFAULT_MAX_SIZE};
+
+/** Return the number of bytes of memory used by an entry */
+static inline size_t entry_size(struct CacheEntry *entry);
+
+/** Return the bucket of the hash table which the given hash belongs to */
+static inline struct CacheEntry **bucket(uint64_t hash);
+
+/** Double the number of buckets in the hash table */
+static void grow_table(void);
+
+/** Remove an entry from the recently-used list */
+static void unlink_entry(struct CacheEntry *entry);
+
+/** Add an entry to the recently-used list as the most recently used */
+static void push_entry(struct CacheEntry *entry);
+
+/** Remove an entry from the cache and free it */
+static void evict(struct CacheEntry *entry);
+
+/* See cache.h */
+struct Plan *cache_find(const char *line, size_t len)
+{
+    struct CacheEntry *entry;
+    uint64_t hash;
+
+    if (!stats.max_size)
+        return NULL;
+
+    hash = hash_string(line, len);
+    for (entry = num_buckets ? *bucket(hash) : NULL; entry;
+            entry = entry->chain) {
+        if (entry->hash == hash && entry->len == len &&
+            memcmp(entry->line, line, len) == 0) {
+            if (entry->generation && entry->generation != vars_generation) {
+                evict(entry);
+                break;
+            }
+            ++stats.hits;
+            unlink_entry(entry);
+            push_entry(entry);
+            in_use = entry;
+            return entry->plan;
+        }
+    }
+    ++stats.misses;
+    return NULL;
+}
+
+/* See cache.h */
+struct CacheEntry *cache_entry_new(const char *line, size_t len)
+{
+    struct CacheEntry *entry;
+
+    if (!stats.max_size || sizeof(*entry) + 2 * len > stats.max_size)
+        return NULL;
+
+    /* The entry, the line, and the text to tokenize share one allocation */
+    if (!(entry = malloc(sizeof(*entry) + 2 * (len + 1))))
+        error(1, errno, "fatal error");
+    entry->hash = hash_string(line, len);
+    entry->line = (char *)(entry + 1);
+    entry->len = len;
+    entry->generation = memchr(line, '$', len) ? vars_generation : 0;
+    entry->text = entry->line + len + 1;
+    memcpy(entry->line, line, len + 1);
+    memcpy(entry->text, line, len + 1);
+    entry->arena = (struct Arena)ARENA_INIT;
+    entry->plan = NULL;
+    return entry;
+}
+
+/* See cache.h */
+void cache_insert(struct CacheEntry *entry, struct Plan *plan)
+{
+    size_t size;
+
+    entry->plan = plan;
+    in_use = entry;
+    if ((size = entry_size(entry)) > stats.max_size) {
+        in_use_evicted = true;
+        return;
+    }
+    while (stats.size + size > stats.max_size)
+        evict(oldest);
+
+    if (stats.entries >= num_buckets)
+        grow_table();
+    entry->chain = *bucket(entry->hash);
+    *bucket(entry->hash) = entry;
+    push_entry(entry);
+    ++stats.entries;
+    stats.size += size;
+}
+
+/* See cache.h */
+void cache_release(void)
+{
+    if (in_use_evicted)
+        cache_entry_free(in_use);
+    in_use = NULL;
+    in_use_evicted = false;
+}
+
+/* See cache.h */
+void cache_entry_free(struct CacheEntry *entry)
+{
+    arena_free(&entry->arena);
+    free(entry);
+}
+
+/* See cache.h */
+void cache_clear(void)
+{
+    while (oldest)
+        evict(oldest);
+}
+
+/* See cache.h */
+void cache_set_max_size(size_t max_size)
+{
+    stats.max_size = max_size;
+    while (stats.size > max_size)
+        evict(oldest);
+}
+
+/* See cache.h */
+struct CacheStats cache_stats(void)
+{
+    return stats;
+}
+
+/* See above */
+static inline size_t entry_size(struct CacheEntry *entry)
+{
+    return sizeof(*entry) + 2 * (entry->len + 1) + entry->arena.size;
+}
+
+/* See above */
+static inline struct CacheEntry **bucket(uint64_t hash)
+{
+    return &buckets[hash & (num_buckets - 1)];
+}
+
+/* See above */
+static void grow_table(void)
+{
+    struct CacheEntry **old_buckets = buckets;
+    size_t old_num_buckets = num_buckets;
+
+    num_buckets = num_buckets ? 2 * num_buckets : INITIAL_BUCKETS;
+    if (!(buckets = calloc(num_buckets, sizeof(*buckets))))
+        error(1, errno, "fatal error");
+
+    for (size_t i = 0; i < old_num_buckets; ++i) {
+        struct CacheEntry *entry = old_buckets[i];
+        while (entry) {
+            struct CacheEntry *chain = entry->chain;
+            entry->chain = *bucket(entry->hash);
+            *bucket(entry->hash) = entry;
+            entry = chain;
+        }
+    }
+    free(old_buckets);
+}
+
+/* See above */
+static void unlink_entry(struct CacheEntry *entry)
+{
+    if (entry->newer)
+        entry->newer->older = entry->older;
+    else
+        newest = entry->older;
+    if (entry->older)
+        entry->older->newer = entry->newer;
+    else
+        oldest = entry->newer;
+}
+
+/* See above */
+static void push_entry(struct CacheEntry *entry)
+{
+    entry->newer = NULL;
+    entry->older = newest;
+    if (newest)
+        newest->newer = entry;
+    else
+        oldest = entry;
+    newest = entry;
+}
+
+/* See above */
+static void evict(struct CacheEntry *entry)
+{
+    struct CacheEntry **link = bucket(entry->hash);
+    while (*link != entry)
+        link = &(*link)->chain;
+    *link = entry->chain;
+
+    unlink_entry(entry);
+    --stats.entries;
+    stats.size -= entry_size(entry);
+    if (entry == in_use)
+        in_use_evicted = true;
+    else
+        cache_entry_free(entry);
+}
@@ -0,0 +1,112 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+
+#include "arena.h"
+#include "plan.h"
+
+/**
+ * A cached command line along with its execution plan. Everything the plan
+ * refers to is owned by the entry, so it stays valid as long as the entry is
+ * cached
+ */
+struct CacheEntry {
+    /** The next and previous entries from most to least recently used */
+    struct CacheEntry *older, *newer;
+
+    /** The next entry in the same bucket of the hash table */
+    struct CacheEntry *chain;
+
+    /** The hash of the command line */
+    uint64_t hash;
+
+    /** The command line exactly as it was given */
+    char *line;
+
+    /** The length of the command line */
+    size_t len;
+
+    /**
+     * The generation of the variables the command line was compiled with if
+     * it may expand any, or zero if it doesn't depend on them
+     */
+    uint64_t generation;
+
+    /**
+     * A copy of the command line to be tokenized in place, which the
+     * arguments of the plan refer to
+     */
+    char *text;
+
+    /** The arena which the plan is allocated from */
+    struct Arena arena;
+
+    /** The compiled execution plan */
+    struct Plan *plan;
+};
+
+/** Statistics about the command line cache */
+struct CacheStats {
+    /** The number of lookups which found the command line */
+    size_t hits;
+
+    /** The number of lookups which didn't find the command line */
+    size_t misses;
+
+    /** The number of command lines cached */
+    size_t entries;
+
+    /** The number of bytes used by the cached command lines */
+    size_t size;
+
+    /** The maximum number of bytes to use, or zero if caching is disabled */
+    size_t max_size;
+};
+
+/**
+ * Look up the execution plan of a command line of the given length in the
+ * cache. The plan stays valid until cache_release is called, even if the entry
+ * is evicted in the meantime. An entry which expanded variables that have
+ * changed since is evicted rather than returned
+ * @return The cached plan, or NULL if the command line isn't cached
+ */
+struct Plan *cache_find(const char *line, size_t len);
+
+/**
+ * Create a new cache entry for a command line of the given length. The entry
+ * should be compiled from its text and then passed to cache_insert or
+ * cache_entry_free
+ * @return The new entry, or NULL if the command line should not be cached
+ */
+struct CacheEntry *cache_entry_new(const char *line, size_t len);
+
+/**
+ * Insert an entry with the given execution plan into the cache, evicting the
+ * least recently used entries if the cache is full. As with cache_find, the
+ * plan stays valid until cache_release is called
+ */
+void cache_insert(struct CacheEntry *entry, struct Plan *plan);
+
+/**
+ * Release the plan returned by the last call to cache_find or cache_insert,
+ * e.g., once it has been executed
+ */
+void cache_release(void);
+
+/** Free an entry which is not in the cache */
+void cache_entry_free(struct CacheEntry *entry);
+
+/** Remove all of the entries from the cache */
+void cache_clear(void);
+
+/**
+ * Set the maximum number of bytes of memory the cache may use, evicting
+ * entries as necessary. A size of zero disables the cache
+ */
+void cache_set_max_size(size_t max_size);
+
+/** Get the current statistics of the cache */
+struct CacheStats cache_stats(void);
+
+#endif /* CACHE_H */
@@ -1,269 +1,964 @@
-#include <assert.h>
+#define _GNU_SOURCE
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
-#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
 
+#include "arena.h"
 #include "builtin.h"
 #include "error.h"
 #include "cmdline.h"
+#include "glob.h"
+#include "jobs.h"
+#include "spawn.h"
+#include "tokenizer.h"
+#include "trace.h"
+
+/** The capacity limit used if /proc/sys/fs/pipe-max-size can't be read */
+#define DEFAULT_PIPE_MAX_SIZE (1024 * 1024)
+
+/**
+ * The shortest and longest times in nanoseconds between looks at growing
+ * pipes. The time doubles every time none of them are seen full
+ */
+#define MIN_WATCH_INTERVAL 1000000
+#define MAX_WATCH_INTERVAL 64000000
+
+/** A child launched to run a block of instructions, to be waited for */
+struct Child {
+    /** The process ID, or -1 if the child couldn't be launched */
+    pid_t pid;
+
+    /** The exit status of the child if it couldn't be launched */
+    int status;
+};
 
 /**
- * Execute a command node by first attempting to execute a built-in command and
+ * The read end of a growing pipe, which the shell keeps open while the
+ * pipeline runs to see how much data is queued in it
+ */
+struct Watch {
+    /** The read end */
+    int fd;
+
+    /** The index of the pipe in its pipeline */
+    size_t index;
+};
+
+/** A span of a plan being timed, from INSN_TIME_START to INSN_TIME_END */
+struct Timer {
+    /** The wall-clock time at the start */
+    struct timespec start;
+
+    /** The resources used by the shell itself at the start */
+    struct rusage self;
+
+    /** The resources used by the foreground children at the start */
+    struct rusage children;
+};
+
+/** The capacity of pipes without a pipesize prefix */
+static size_t default_capacity = 0;
+
+/** The exit statuses of the last command or stages of a pipeline */
+static int *statuses = NULL;
+
+/** The number of statuses and the capacity of the array */
+static size_t num_statuses = 0, statuses_capacity = 0;
+
+/**
+ * Execute a plan, either in the shell or in a child which runs it as a block
+ * and exits at its end
+ * @param subshell Whether the plan is executed by such a child
+ * @return The exit status of the plan, in the shell
+ */
+static int run_plan(struct Plan *plan, bool subshell);
+
+/**
+ * Execute a command by first attempting to execute a built-in command and
  * then an external command
  * @return The exit status of the executed command
  */
-static int exec_cmd(struct SyntaxTree *root);
+static int exec_cmd(int argc, char **argv);
 
-/** Redirect the input to a command and then execute it
- * @return The exit status of the executed command
+/**
+ * Return the arguments of a command with its raw words and then its glob
+ * patterns expanded, dropping the raw words which expand to nothing
+ * @param argc Set to the number of arguments
  */
-static int exec_redir_in(struct SyntaxTree *root);
+static char **expand_args(const struct Insn *cmd, int *argc);
 
-/** Redirect the output of a command and then execute it
- * @param append Whether to append to the file (otherwise truncate)
- * @return The exit status of the executed command
+/**
+ * Expand the variables of the raw text of a word by lexing it again, now that
+ * the commands before it have run
+ * @param glob Set to whether the word is a pattern
+ * @return The word, allocated from cmdline_arena, or NULL if it is nothing but
+ * unquoted empty expansions
  */
-static int exec_redir_out(struct SyntaxTree *root, bool append);
+static char *expand_word(const char *raw, bool *glob);
 
 /**
- * Connect two commands with a pipe and then execute them
- * @param err_pipe Whether to redirect stderr of the first command to stdin of
- * the second command (default is stdout to stdin)
- * @return The exit status of the last command in the pipeline
+ * Return whether a command runs as a built-in, which for a command whose name
+ * is a raw word is only known once it's expanded (a command which expands to
+ * nothing is run like a built-in which does nothing)
  */
-static int exec_pipe(struct SyntaxTree *root, bool err_pipe);
+static bool runs_builtin(const struct Insn *cmd);
 
 /**
- * Execute a command, then, if the exit status was zero, execute a second
- * command
- * @return The exit status of the last executed command
+ * Create the pipes of a pipeline, which are closed in any command that is
+ * executed so that only the ends it is connected to stay open
+ * @return The pipes, allocated from cmdline_arena
  */
-static int exec_and(struct SyntaxTree *root);
+static int (*make_pipes(size_t num_pipes))[2];
+
+/** Close the pipes of a pipeline */
+static void close_pipes(int (*pipes)[2], size_t num_pipes);
 
 /**
- * Execute a command, then, if the exit status was non-zero, execute a second
- * command
- * @return The exit status of the last executed command
+ * Set the capacity of a pipe of a pipeline
+ * @param capacity The capacity, where zero leaves the pipe as it is and
+ * PIPE_ADAPTIVE marks it as growing instead
+ * @param growing The flags marking the growing pipes, allocated from
+ * cmdline_arena once a pipe is marked
  */
-static int exec_or(struct SyntaxTree *root);
+static void size_pipe(int (*pipes)[2], size_t num_pipes, size_t index,
+                      size_t capacity, bool **growing);
 
 /**
- * Execute a command and wait for it to terminate, then execute a second
- * command
- * @return The exit status of the last executed command
+ * Take the read ends of the growing pipes of a pipeline out of it before it's
+ * closed, so that they stay open to be watched
+ * @param num_watches Set to the number of read ends taken
+ * @return The read ends, allocated from cmdline_arena
  */
-static int exec_semicolon(struct SyntaxTree *root);
+static struct Watch *take_growing(int (*pipes)[2], size_t num_pipes,
+                                  const bool *growing, size_t *num_watches);
 
 /**
- * Execute a command but don't wait for it to terminate, then execute a second
+ * Watch growing pipes until the stages reading from them have exited,
+ * doubling the capacity of a pipe whenever it's seen full. Each read end is
+ * closed as soon as its reader exits, so that the writer isn't kept from
+ * getting EPIPE, or once the pipe can't grow any further
+ * @param stages The children running the stages of the pipeline
+ */
+static void watch_pipes(struct Watch *watches, size_t num_watches,
+                        const struct Child *stages);
+
+/** Return the largest capacity a pipe may be given */
+static size_t max_pipe_size(void);
+
+/**
+ * Wait for children and remember their exit statuses
+ * @return The exit status of the last child
+ */
+static int wait_children(struct Child *children, size_t num_children);
+
+/** Set the exit statuses to just the status of a single command */
+static void set_status(int status);
+
+/**
+ * Start timing a span of a plan. The maximum resident set size of the
+ * children is reset, to find the largest child within the span
+ */
+static void start_timer(struct Timer *timer);
+
+/**
+ * Stop timing a span of a plan and print the resources used in it to
+ * standard error: the wall-clock time, the user and system CPU time, the
+ * largest resident set size of a child, and the page faults and context
+ * switches, which are those of the shell and its foreground children
+ * @param json Whether to print a JSON object rather than a line for humans
+ * @param status The exit status of the span, which is included in the JSON
+ */
+static void stop_timer(struct Timer *timer, bool json, int status);
+
+/**
+ * Fork a child which runs a block of instructions. The child forgets about
+ * the children and jobs of the shell
+ * @return The process ID of the child in the parent, or zero in the child
+ */
+static pid_t fork_block(void);
+
+/**
+ * Describe a block of instructions run as a job by the arguments of its first
+ * command, followed by an ellipsis if it runs more commands
+ * @return The description, allocated from cmdline_arena
+ */
+static char *describe_block(struct Insn *block, size_t len);
+
+/**
+ * Run the command of a block of instructions in the shell itself if it's a
+ * built-in command and the rest of the block only redirects its standard file
+ * descriptors, so that the command can change the state of the shell. The file
+ * descriptors are saved before they are redirected and restored once the
+ * command returns. A block writing into a pipe is left to a subshell, since
+ * the command could fill the pipe before the command reading from it is even
+ * launched
+ * @param block The instructions of the block
+ * @param len The number of instructions in the block
+ * @param pipes The pipes which the block may connect to
+ * @param num_pipes The number of pipes, set to zero if they are closed
+ * @param child Set to a child which has already exited with the status of the
  * command
- * @return The exit status of the last executed command, or zero if the last
- * executed command was backgrounded
+ * @return Whether the block was run
+ */
+static bool run_builtin_block(struct Insn *block, size_t len, int (*pipes)[2],
+                              size_t *num_pipes, struct Child *child);
+
+/**
+ * Launch the command of a block of instructions directly if the rest of the
+ * block only redirects the file descriptors of an external command. The
+ * redirections are then applied as actions of the new process, rather than by
+ * a forked subshell which would fork again to run the command
+ * @param block The instructions of the block
+ * @param len The number of instructions in the block
+ * @param pipes The pipes which the block may connect to
+ * @param child Set to the launched child
+ * @return Whether the block was launched
+ */
+static bool spawn_block(struct Insn *block, size_t len, int (*pipes)[2],
+                        struct Child *child);
+
+/**
+ * Wait for a child to terminate
+ * @return The exit status of the child
+ */
+static int wait_child(struct Child *child);
+
+/**
+ * Open the file of an INSN_REDIR or INSN_HEREDOC instruction, printing an
+ * error message on failure
+ * @return The file descriptor, or -1 with errno set on failure
  */
-static int exec_background(struct SyntaxTree *root);
+static int open_file(const struct Insn *insn);
+
+/**
+ * Create an anonymous file in memory holding the text of a heredoc, sealed so
+ * that nothing can change it and positioned at its start. Unlike a pipe which
+ * the shell would have to keep feeding, it never blocks however long the text
+ * @param newline Whether to append a newline to the text
+ * @return The file descriptor, or -1 with errno set on failure
+ */
+static int open_heredoc(const char *text, bool newline);
+
+/**
+ * Open the file of an INSN_REDIR or INSN_HEREDOC instruction and move it onto
+ * its file descriptor
+ * @return Zero on success, or the error number if the file couldn't be opened
+ */
+static int redirect(const struct Insn *insn);
 
 /* See cmdline.h */
-int exec_cmdline(struct SyntaxTree *root)
+int exec_cmdline(struct Plan *plan)
 {
-    switch (root->type) {
-        case NODE_CMD:
-            return exec_cmd(root);
-        case NODE_REDIR_IN:
-            return exec_redir_in(root);
-        case NODE_REDIR_OUT:
-            return exec_redir_out(root, false);
-        case NODE_REDIR_APPEND:
-            return exec_redir_out(root, true);
-        case NODE_PIPE:
-            return exec_pipe(root, false);
-        case NODE_ERR_PIPE:
-            return exec_pipe(root, true);
-        case NODE_AND:
-            return exec_and(root);
-        case NODE_OR:
-            return exec_or(root);
-        case NODE_SEMICOLON:
-            return exec_semicolon(root);
-        case NODE_BACKGROUND:
-            return exec_background(root);
-        case NODE_DISOWN:
-            assert(0);
-    }
-    return -1;
+    return run_plan(plan, false);
 }
 
 /* See above */
-static int exec_cmd(struct SyntaxTree *root)
+static int run_plan(struct Plan *plan, bool subshell)
 {
-    int retval;
+    struct Insn *insns = plan->insns;
+    size_t pc = 0, end = plan->len, num_children = 0;
+    struct Child *children = arena_alloc(&cmdline_arena,
+                                         sizeof(struct Child) * plan->len);
+    int (*pipes)[2] = NULL, status = 0;
+    size_t num_pipes = 0, num_timers = 0, num_watches = 0;
+    struct Timer *timers = NULL;
+    struct Watch *watches = NULL;
+    bool *growing = NULL;
 
-    char **argv = malloc(sizeof(char*) * (root->num_tokens + 1));
-    for (int i = 0; i < root->num_tokens; ++i)
-        argv[i] = root->tokens[i].token;
-    argv[root->num_tokens] = NULL;
+    while (pc < end) {
+        struct Insn *insn = &insns[pc++];
+        switch (insn->op) {
+            case INSN_EXEC: {
+                int argc;
+                char **argv = expand_args(insn, &argc);
 
-    if ((retval = exec_builtin(root->num_tokens, argv)) == -1) {
-        int status;
-        pid_t pid;
-        if ((pid = fork()) == -1)
-            error(errno, errno, "error");
-        if (pid) {
-            if (waitpid(pid, &status, 0) == -1)
-                error(errno, errno, "error");
-        } else {
-            if (execvp(argv[0], argv) == -1) {
-                if (errno == ENOENT)
-                    error(errno, 0, "command not found: %s", argv[0]);
-                else
-                    error(errno, errno, "error");
+                /* The last command of a subshell replaces the subshell */
+                if (subshell && pc == end && argc && !is_builtin(argv[0]))
+                    spawn_exec(argv);
+                set_status(status = exec_cmd(argc, argv));
+                break;
             }
+            case INSN_SUBSHELL:
+                if (run_builtin_block(&insns[pc], insn->len, pipes,
+                                      &num_pipes, &children[num_children]) ||
+                    spawn_block(&insns[pc], insn->len, pipes,
+                                &children[num_children])) {
+                    pc += insn->len;
+                    ++num_children;
+                    break;
+                }
+                /* Fall through */
+            case INSN_BACKGROUND: {
+                bool job = insn->op == INSN_BACKGROUND;
+                bool queued = job && !insn->flags && !jobs_can_start();
+                int gate[2];
+                pid_t pid;
+
+                /*
+                 * Jobs over the limit are forked right away to run with the
+                 * file descriptors, directory and variables the shell has
+                 * now, but wait on a socket until they are started
+                 */
+                if (queued && socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC,
+                                         0, gate) == -1)
+                    error(1, errno, "fatal error");
+                pid = fork_block();
+
+                /* Jobs get process groups of their own to be continued by */
+                if (job)
+                    setpgid(pid, pid);
+                if (pid == 0) {
+                    if (queued)
+                        job_hold(gate);
+                    /* The child runs the block and exits at its end */
+                    subshell = true;
+                    end = pc + insn->len;
+                    num_children = 0;
+                    growing = NULL;
+                    break;
+                }
+                if (tracing)
+                    trace_child(pid, describe_block(&insns[pc], insn->len));
+                if (job) {
+                    if (queued)
+                        job_queue(pid, gate,
+                                  describe_block(&insns[pc], insn->len));
+                    else if (!insn->flags)
+                        job_new(pid, describe_block(&insns[pc], insn->len));
+                    pc += insn->len;
+                    status = 0;
+                } else {
+                    jobs_track(pid);
+                    pc += insn->len;
+                    children[num_children++] = (struct Child){pid, 0};
+                }
+                break;
+            }
+            case INSN_WAIT:
+                num_children -= insn->len;
+                if (num_watches) {
+                    watch_pipes(watches, num_watches, &children[num_children]);
+                    num_watches = 0;
+                }
+                status = wait_children(&children[num_children], insn->len);
+                break;
+            case INSN_REDIR:
+            case INSN_HEREDOC:
+                if ((status = redirect(insn)))
+                    pc = end;
+                break;
+            case INSN_PIPE:
+                pipes = make_pipes(num_pipes = insn->len);
+                growing = NULL;
+                for (size_t i = 0; !insn->flags && default_capacity &&
+                         i < num_pipes; ++i)
+                    size_pipe(pipes, num_pipes, i, default_capacity, &growing);
+                break;
+            case INSN_PIPE_SIZE:
+                size_pipe(pipes, num_pipes, insn->len, insn->capacity,
+                          &growing);
+                break;
+            case INSN_PIPE_END:
+                dup2(pipes[insn->len][insn->flags], insn->fd);
+                break;
+            case INSN_CLOSE_PIPE:
+                if (growing)
+                    watches = take_growing(pipes, num_pipes, growing,
+                                           &num_watches);
+                close_pipes(pipes, num_pipes);
+                num_pipes = 0;
+                growing = NULL;
+                break;
+            case INSN_JZ:
+                if (status == 0)
+                    pc += insn->len;
+                break;
+            case INSN_JNZ:
+                if (status != 0)
+                    pc += insn->len;
+                break;
+            case INSN_TRUE:
+                status = 0;
+                break;
+            case INSN_TIME_START:
+                /* Spans nest, so there can't be more than instructions */
+                if (!timers)
+                    timers = arena_alloc(&cmdline_arena,
+                                         sizeof(struct Timer) * plan->len);
+                start_timer(&timers[num_timers++]);
+                break;
+            case INSN_TIME_END:
+                stop_timer(&timers[--num_timers], insn->flags, status);
+                break;
         }
-        retval = WEXITSTATUS(status);
     }
 
-    free(argv);
+    if (subshell)
+        exit(status);
+    return status;
+}
+
+/* See above */
+static int exec_cmd(int argc, char **argv)
+{
+    int retval;
+
+    if (argc == 0)
+        return 0;
+    if ((retval = exec_builtin(argc, argv)) == -1) {
+        struct Child child;
+        if ((child.pid = spawn(argv, NULL, 0)) == -1)
+            child.status = errno;
+        else
+            jobs_track(child.pid);
+        retval = wait_child(&child);
+    }
+
     return retval;
 }
 
 /* See above */
-static int exec_redir_in(struct SyntaxTree *root)
+static char **expand_args(const struct Insn *cmd, int *argc)
 {
-    int fd;
-    pid_t pid;
+    size_t len = 0;
+    char **argv;
+    bool *patterns, any_patterns = false;
 
-    if ((fd = open(root->right->tokens[0].token, O_RDONLY)) == -1) {
-        error(0, errno, "error");
-        return errno;
+    if (!cmd->expand) {
+        *argc = cmd->len;
+        return cmd->argv;
+    }
+    argv = arena_alloc(&cmdline_arena, sizeof(char *) * (cmd->len + 1));
+    patterns = arena_alloc(&cmdline_arena, cmd->len);
+    for (size_t i = 0; i < cmd->len; ++i) {
+        bool glob = cmd->expand[i] & ARG_GLOB;
+        char *arg = cmd->argv[i];
+        if ((cmd->expand[i] & ARG_VARS) && !(arg = expand_word(arg, &glob)))
+            continue;
+        patterns[len] = glob;
+        any_patterns |= glob;
+        argv[len++] = arg;
     }
+    argv[len] = NULL;
+    if (any_patterns)
+        argv = glob_args(len, argv, patterns, &len);
+    *argc = len;
+    return argv;
+}
 
-    if ((pid = fork()) == -1)
-        error(errno, errno, "error");
-    if (pid) {
-        int status;
-        if (waitpid(pid, &status, 0) == -1)
+/* See above */
+static char *expand_word(const char *raw, bool *glob)
+{
+    static struct Token *tokens = NULL;
+    static size_t n = 0;
+    char *word = arena_alloc(&cmdline_arena, strlen(raw) + 1);
+
+    /* The word lexed fine before, and it still has no operators */
+    if (tokenize_quietly(&cmdline_arena, &tokens, &n, strcpy(word, raw)) < 1)
+        return NULL;
+    *glob = tokens[0].glob;
+    return tokens[0].token;
+}
+
+/* See above */
+static bool runs_builtin(const struct Insn *cmd)
+{
+    int argc;
+    char **argv;
+
+    if (!cmd->expand || !(cmd->expand[0] & ARG_VARS))
+        return is_builtin(cmd->argv[0]);
+    argv = expand_args(cmd, &argc);
+    return argc == 0 || is_builtin(argv[0]);
+}
+
+/* See cmdline.h */
+size_t last_statuses(const int **last)
+{
+    *last = statuses;
+    return num_statuses;
+}
+
+/* See cmdline.h */
+void set_pipe_capacity(size_t capacity)
+{
+    default_capacity = capacity;
+}
+
+/* See cmdline.h */
+size_t pipe_capacity(void)
+{
+    return default_capacity;
+}
+
+/* See above */
+static int (*make_pipes(size_t num_pipes))[2]
+{
+    int (*pipes)[2] = arena_alloc(&cmdline_arena, sizeof(*pipes) * num_pipes);
+    for (size_t i = 0; i < num_pipes; ++i) {
+        if (pipe2(pipes[i], O_CLOEXEC) == -1)
             error(errno, errno, "error");
-        return WEXITSTATUS(status);
-    } else {
-        dup2(fd, 0);
-        exit(exec_cmdline(root->left));
     }
+    return pipes;
 }
 
 /* See above */
-static int exec_redir_out(struct SyntaxTree *root, bool append)
+static void close_pipes(int (*pipes)[2], size_t num_pipes)
 {
-    int fd, flags = O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);
-    int mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
-    pid_t pid;
+    for (size_t i = 0; i < num_pipes; ++i) {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+}
 
-    if ((fd = open(root->right->tokens[0].token, flags, mode)) == -1) {
-        error(0, errno, "error");
-        return errno;
+/* See above */
+static void size_pipe(int (*pipes)[2], size_t num_pipes, size_t index,
+                      size_t capacity, bool **growing)
+{
+    if (capacity == PIPE_ADAPTIVE) {
+        if (!*growing) {
+            *growing = arena_alloc(&cmdline_arena, sizeof(bool) * num_pipes);
+            memset(*growing, 0, sizeof(bool) * num_pipes);
+        }
+        (*growing)[index] = true;
+    } else if (capacity) {
+        /* Failing to resize (e.g., over the limit per user) isn't an error */
+        if (capacity > max_pipe_size())
+            capacity = max_pipe_size();
+        fcntl(pipes[index][1], F_SETPIPE_SZ, (int)capacity);
     }
+}
 
-    if ((pid = fork()) == -1)
-        error(errno, errno, "error");
-    if (pid) {
-        int status;
-        if (waitpid(pid, &status, 0) == -1)
-            error(errno, errno, "error");
-        return WEXITSTATUS(status);
-    } else {
-        dup2(fd, 1);
-        exit(exec_cmdline(root->left));
+/* See above */
+static struct Watch *take_growing(int (*pipes)[2], size_t num_pipes,
+                                  const bool *growing, size_t *num_watches)
+{
+    struct Watch *watches = arena_alloc(&cmdline_arena,
+                                        sizeof(struct Watch) * num_pipes);
+
+    *num_watches = 0;
+    for (size_t i = 0; i < num_pipes; ++i) {
+        if (growing[i]) {
+            watches[(*num_watches)++] = (struct Watch){pipes[i][0], i};
+            pipes[i][0] = -1;
+        }
     }
+    return watches;
 }
 
 /* See above */
-static int exec_pipe(struct SyntaxTree *root, bool err_pipe)
+static void watch_pipes(struct Watch *watches, size_t num_watches,
+                        const struct Child *stages)
 {
-    int pipefd[2];
-    pid_t pid1, pid2;
+    long interval = MIN_WATCH_INTERVAL;
+    int max_size = max_pipe_size();
+    sigset_t chld, mask;
 
-    if (pipe(pipefd) == -1)
-        error(errno, errno, "error");
+    /* SIGCHLD only interrupts the sleep, so a reader's exit isn't missed */
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &mask);
+    while (num_watches > 0) {
+        struct timespec timeout = {0, interval};
+        bool grown = false;
 
-    if ((pid1 = fork()) == -1)
-        error(errno, errno, "error");
+        for (size_t i = 0; i < num_watches;) {
+            struct Watch *watch = &watches[i];
+            int capacity = fcntl(watch->fd, F_GETPIPE_SZ), queued;
 
-    if (pid1) {
-        if ((pid2 = fork()) == -1)
-            error(errno, errno, "error");
-        if (pid2) {
-            close(pipefd[0]);
-            close(pipefd[1]);
-        } else {
-            dup2(pipefd[0], 0);
-            close(pipefd[1]);
-            exit(exec_cmdline(root->right));
+            /* Pipe i is read by stage i + 1 */
+            if (capacity == -1 || capacity >= max_size ||
+                jobs_exited(stages[watch->index + 1].pid)) {
+                close(watch->fd);
+                *watch = watches[--num_watches];
+                continue;
+            }
+            if (ioctl(watch->fd, FIONREAD, &queued) == 0 &&
+                queued >= capacity) {
+                fcntl(watch->fd, F_SETPIPE_SZ, capacity < max_size / 2 ?
+                      2 * capacity : max_size);
+                grown = true;
+            }
+            ++i;
+        }
+
+        if (num_watches > 0) {
+            ppoll(NULL, 0, &timeout, &mask);
+            if (grown)
+                interval = MIN_WATCH_INTERVAL;
+            else if (interval < MAX_WATCH_INTERVAL)
+                interval *= 2;
         }
-    } else {
-        if (err_pipe)
-            dup2(pipefd[1], 2);
-        else
-            dup2(pipefd[1], 1);
-        close(pipefd[0]);
-        exit(exec_cmdline(root->left));
     }
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+}
 
-    bool done[2] = {false, false};
-    int retval;
-    while (!done[0] || !done[1]) {
-        int status;
-        pid_t pid = wait(&status);
-        if (pid == pid1)
-            done[0] = true;
-        else if (pid == pid2) {
-            done[1] = true;
-            retval = WEXITSTATUS(status);
+/* See above */
+static size_t max_pipe_size(void)
+{
+    static size_t max_size = 0;
+    FILE *file;
+
+    if (max_size == 0) {
+        if ((file = fopen("/proc/sys/fs/pipe-max-size", "re"))) {
+            if (fscanf(file, "%zu", &max_size) != 1)
+                max_size = 0;
+            fclose(file);
         }
+        if (max_size == 0 || max_size > INT_MAX)
+            max_size = DEFAULT_PIPE_MAX_SIZE;
     }
-    return retval;
+    return max_size;
 }
 
 /* See above */
-static int exec_and(struct SyntaxTree *root)
+static int wait_children(struct Child *children, size_t num_children)
 {
-    int retval = exec_cmdline(root->left);
-    if (retval == 0)
-        retval = exec_cmdline(root->right);
-    return retval;
+    if (num_children > statuses_capacity) {
+        statuses_capacity = num_children;
+        if (!(statuses = realloc(statuses, sizeof(int) * num_children)))
+            error(1, errno, "fatal error");
+    }
+    for (size_t i = 0; i < num_children; ++i)
+        statuses[i] = wait_child(&children[i]);
+    num_statuses = num_children;
+    return statuses[num_children - 1];
 }
 
 /* See above */
-static int exec_or(struct SyntaxTree *root)
+static void set_status(int status)
 {
-    int retval = exec_cmdline(root->left);
-    if (retval != 0)
-        retval = exec_cmdline(root->right);
-    return retval;
+    struct Child child = {-1, status};
+    wait_children(&child, 1);
 }
 
 /* See above */
-static int exec_semicolon(struct SyntaxTree *root)
+static void start_timer(struct Timer *timer)
 {
-    int retval = 0;
-    if (root->left)
-        retval = exec_cmdline(root->left);
-    if (root->right)
-        retval = exec_cmdline(root->right);
-    return retval;
+    struct rusage *usage = jobs_usage();
+
+    clock_gettime(CLOCK_MONOTONIC, &timer->start);
+    getrusage(RUSAGE_SELF, &timer->self);
+    timer->children = *usage;
+    usage->ru_maxrss = 0;
+}
+
+/* See above */
+static void stop_timer(struct Timer *timer, bool json, int status)
+{
+    struct rusage *usage = jobs_usage(), self;
+    struct timespec now;
+    struct timeval user, sys, delta;
+    double real;
+    long maxrss = usage->ru_maxrss, minflt, majflt, nvcsw, nivcsw;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    getrusage(RUSAGE_SELF, &self);
+    real = (now.tv_sec - timer->start.tv_sec) +
+        (now.tv_nsec - timer->start.tv_nsec) / 1e9;
+
+    timersub(&usage->ru_utime, &timer->children.ru_utime, &user);
+    timersub(&self.ru_utime, &timer->self.ru_utime, &delta);
+    timeradd(&user, &delta, &user);
+    timersub(&usage->ru_stime, &timer->children.ru_stime, &sys);
+    timersub(&self.ru_stime, &timer->self.ru_stime, &delta);
+    timeradd(&sys, &delta, &sys);
+
+#define DELTA(field) (usage->field - timer->children.field + \
+                      self.field - timer->self.field)
+    minflt = DELTA(ru_minflt);
+    majflt = DELTA(ru_majflt);
+    nvcsw = DELTA(ru_nvcsw);
+    nivcsw = DELTA(ru_nivcsw);
+#undef DELTA
+
+    /* An enclosing span still has to see the largest child before this one */
+    if (timer->children.ru_maxrss > usage->ru_maxrss)
+        usage->ru_maxrss = timer->children.ru_maxrss;
+
+    fflush(stdout);
+    if (json) {
+        fprintf(stderr, "{\"real\":%.6f,\"user\":%ld.%06ld,"
+                "\"sys\":%ld.%06ld,\"maxrss_kb\":%ld,\"minflt\":%ld,"
+                "\"majflt\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld,"
+                "\"status\":%d}\n", real, (long)user.tv_sec,
+                (long)user.tv_usec, (long)sys.tv_sec, (long)sys.tv_usec,
+                maxrss, minflt, majflt, nvcsw, nivcsw, status);
+    } else {
+        fprintf(stderr, "real %.3fs user %ld.%03lds sys %ld.%03lds "
+                "maxrss %ldk faults %ld/%ld csw %ld/%ld\n", real,
+                (long)user.tv_sec, (long)user.tv_usec / 1000,
+                (long)sys.tv_sec, (long)sys.tv_usec / 1000, maxrss, minflt,
+                majflt, nvcsw, nivcsw);
+    }
 }
 
 /* See above */
-static int exec_background(struct SyntaxTree *root)
+static pid_t fork_block(void)
 {
-    int retval = 0;
+    uint64_t start = trace_start();
     pid_t pid;
+
+    /* Otherwise the child would write out whatever is buffered again */
+    fflush(stdout);
+    if (tracing)
+        trace_flush();
     if ((pid = fork()) == -1)
         error(errno, errno, "error");
-    if (pid) {
-        if (root->right)
-            retval = exec_cmdline(root->right);
-    } else
-        exit(exec_cmdline(root->left));
-    return retval;
+    if (pid == 0)
+        jobs_forget();
+    else if (tracing)
+        trace_span("fork", NULL, start);
+    return pid;
+}
+
+/* See above */
+static char *describe_block(struct Insn *block, size_t len)
+{
+    struct Insn *cmd = NULL;
+    size_t size = sizeof(" ...");
+    bool more = false;
+    char *desc, *p;
+
+    for (size_t i = 0; i < len; ++i) {
+        if (block[i].op != INSN_EXEC)
+            continue;
+        if (cmd) {
+            more = true;
+            break;
+        }
+        cmd = &block[i];
+    }
+    for (size_t i = 0; cmd && i < cmd->len; ++i)
+        size += strlen(cmd->argv[i]) + 1;
+
+    p = desc = arena_alloc(&cmdline_arena, size);
+    for (size_t i = 0; cmd && i < cmd->len; ++i) {
+        if (i > 0)
+            *p++ = ' ';
+        p = stpcpy(p, cmd->argv[i]);
+    }
+    strcpy(p, more ? " ..." : "");
+    return desc;
+}
+
+/* See above */
+static bool run_builtin_block(struct Insn *block, size_t len, int (*pipes)[2],
+                              size_t *num_pipes, struct Child *child)
+{
+    struct Insn *cmd = &block[len - 1];
+    bool is_saved[3] = {false, false, false};
+    int saved[3], status = 0, argc;
+    char **argv;
+
+    if (len == 0 || cmd->op != INSN_EXEC || !runs_builtin(cmd))
+        return false;
+    for (size_t i = 0; i < len - 1; ++i) {
+        if (block[i].op != INSN_REDIR && block[i].op != INSN_HEREDOC &&
+            block[i].op != INSN_PIPE_END && block[i].op != INSN_CLOSE_PIPE)
+            return false;
+        if (block[i].op == INSN_PIPE_END && block[i].flags == 1)
+            return false;
+    }
+
+    /* Whatever is buffered belongs to the file descriptor before it moves */
+    fflush(stdout);
+    for (size_t i = 0; i < len - 1; ++i) {
+        struct Insn *insn = &block[i];
+
+        /* The pipes are closed even if a file couldn't be opened */
+        if (insn->op == INSN_CLOSE_PIPE) {
+            close_pipes(pipes, *num_pipes);
+            *num_pipes = 0;
+            continue;
+        } else if (status)
+            continue;
+
+        /* A file descriptor which was closed is saved as -1 */
+        if (!is_saved[insn->fd]) {
+            saved[insn->fd] = fcntl(insn->fd, F_DUPFD_CLOEXEC, 3);
+            is_saved[insn->fd] = true;
+        }
+        if (insn->op == INSN_PIPE_END)
+            dup2(pipes[insn->len][insn->flags], insn->fd);
+        else
+            status = redirect(insn);
+    }
+    /* The built-in may leave the command to the external one after all */
+    if (status == 0) {
+        argv = expand_args(cmd, &argc);
+        status = exec_cmd(argc, argv);
+    }
+
+    for (int fd = 0; fd < 3; ++fd) {
+        if (!is_saved[fd])
+            continue;
+        if (saved[fd] == -1)
+            close(fd);
+        else {
+            dup2(saved[fd], fd);
+            close(saved[fd]);
+        }
+    }
+    *child = (struct Child){-1, status};
+    return true;
+}
+
+/* See above */
+static bool spawn_block(struct Insn *block, size_t len, int (*pipes)[2],
+                        struct Child *child)
+{
+    struct Insn *cmd = &block[len - 1];
+    struct SpawnAction *actions;
+    int *files, argc;
+    size_t num_actions = 0, num_files = 0;
+
+    if (len == 0 || cmd->op != INSN_EXEC || runs_builtin(cmd))
+        return false;
+    for (size_t i = 0; i < len - 1; ++i) {
+        if (block[i].op != INSN_REDIR && block[i].op != INSN_HEREDOC &&
+            block[i].op != INSN_PIPE_END && block[i].op != INSN_CLOSE_PIPE)
+            return false;
+    }
+
+    /* Each instruction turns into at most two actions */
+    actions = arena_alloc(&cmdline_arena, sizeof(*actions) * 2 * len);
+    files = arena_alloc(&cmdline_arena, sizeof(*files) * len);
+    child->pid = -1;
+    for (size_t i = 0; i < len - 1; ++i) {
+        struct Insn *insn = &block[i];
+        int file;
+
+        /* The pipes are closed by the exec because they are close-on-exec */
+        if (insn->op == INSN_CLOSE_PIPE)
+            continue;
+        else if (insn->op == INSN_PIPE_END) {
+            actions[num_actions++] = (struct SpawnAction){
+                SPAWN_DUP2, pipes[insn->len][insn->flags], insn->fd
+            };
+            continue;
+        }
+
+        /* Files are opened by the shell to report errors like the subshell */
+        if ((file = open_file(insn)) == -1) {
+            child->status = errno;
+            goto out;
+        }
+        files[num_files++] = file;
+        if (file != insn->fd) {
+            actions[num_actions++] = (struct SpawnAction){
+                SPAWN_DUP2, file, insn->fd
+            };
+            actions[num_actions++] = (struct SpawnAction){
+                SPAWN_CLOSE, file, -1
+            };
+        }
+    }
+    if ((child->pid = spawn(expand_args(cmd, &argc), actions,
+                            num_actions)) == -1)
+        child->status = errno;
+    else
+        jobs_track(child->pid);
+
+out:
+    for (size_t i = 0; i < num_files; ++i)
+        close(files[i]);
+    return true;
+}
+
+/* See above */
+static int wait_child(struct Child *child)
+{
+    if (child->pid == -1)
+        return child->status;
+    return jobs_wait_child(child->pid);
+}
+
+/* See above */
+static int open_file(const struct Insn *insn)
+{
+    int mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
+    const char *path = insn->path;
+    bool glob;
+    int file;
+
+    /* A path which expands to nothing is an empty one, like a quoted one */
+    if (insn->expand && !(path = expand_word(path, &glob)))
+        path = "";
+    if (insn->op == INSN_HEREDOC)
+        file = open_heredoc(path, insn->flags);
+    else
+        file = open(path, insn->flags, mode);
+    if (file == -1) {
+        int err = errno;
+        error(0, err, "error");
+        errno = err;
+    }
+    return file;
+}
+
+/* See above */
+static int open_heredoc(const char *text, bool newline)
+{
+    size_t len = strlen(text);
+    int file, err;
+
+    file = memfd_create("heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (file == -1)
+        return -1;
+
+    /* A single write moves a little less than 2 GiB at most */
+    while (len > 0 || newline) {
+        ssize_t written;
+
+        if (len == 0) {
+            text = "\n";
+            len = 1;
+            newline = false;
+        }
+        if ((written = write(file, text, len)) == -1) {
+            if (errno == EINTR)
+                continue;
+            goto err;
+        }
+        text += written;
+        len -= written;
+    }
+    if (fcntl(file, F_ADD_SEALS, F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW |
+              F_SEAL_WRITE) == -1 || lseek(file, 0, SEEK_SET) == -1)
+        goto err;
+    return file;
+
+err:
+    err = errno;
+    close(file);
+    errno = err;
+    return -1;
+}
+
+/* See above */
+static int redirect(const struct Insn *insn)
+{
+    int file;
+
+    if ((file = open_file(insn)) == -1)
+        return errno;
+    if (file != insn->fd) {
+        dup2(file, insn->fd);
+        close(file);
+    }
+    return 0;
 }
@@ -1,12 +1,34 @@
 #ifndef CMDLINE_H
 #define CMDLINE_H
 
-#include "parser.h"
+#include <sys/types.h>
+
+#include "plan.h"
 
 /**
- * Execute a command line which has been parsed into a syntax tree
+ * Execute a command line which has been compiled into an execution plan
  * @return The exit status of the command line
  */
-int exec_cmdline(struct SyntaxTree *root);
+int exec_cmdline(struct Plan *plan);
+
+/**
+ * Get the exit statuses of the stages of the last pipeline, or of the last
+ * command if it wasn't a pipeline
+ * @param last Set to the statuses, which are valid until the next command
+ * @return The number of statuses
+ */
+size_t last_statuses(const int **last);
+
+/**
+ * Set the capacity in bytes of the pipes of pipelines which aren't given one
+ * by a pipesize prefix, where zero is the default of the kernel and
+ * PIPE_ADAPTIVE makes the pipes grow whenever they are seen full. Capacities
+ * are rounded up by the kernel to a power of two pages and capped at
+ * /proc/sys/fs/pipe-max-size
+ */
+void set_pipe_capacity(size_t capacity);
+
+/** Return the capacity of pipes set with set_pipe_capacity */
+size_t pipe_capacity(void);
 
 #endif /* CMDLINE_H */
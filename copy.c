@@ -0,0 +1,340 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+#include "copy.h"
+#include "error.h"
+
+#ifndef COPY_BUFFER_SIZE
+/** The size of the buffer which data is copied through as a last resort */
+#define COPY_BUFFER_SIZE (128 * 1024)
+#endif
+
+/**
+ * The most bytes asked of one system call which moves data in the kernel,
+ * which caps it at a little less anyway
+ */
+#define MOVE_CHUNK_SIZE (1 << 30)
+
+/**
+ * A way of moving data from a file descriptor to another in the kernel
+ * @return The number of bytes moved, zero at the end of the input, or -1 with
+ * errno set on failure
+ */
+typedef ssize_t (*move_function)(int in, int out);
+
+/** Move data with copy_file_range */
+static ssize_t move_range(int in, int out);
+
+/** Move data with splice */
+static ssize_t move_splice(int in, int out);
+
+/** Move data with sendfile */
+static ssize_t move_sendfile(int in, int out);
+
+/**
+ * Move data from a file descriptor to another with a function until the end
+ * of the input
+ * @return Zero on success, -1 if the function doesn't work for the kinds of
+ * files (in which case some data may have been moved already, and the rest
+ * can be copied another way from the offsets where it stopped), or the error
+ * number on failure
+ */
+static int move_all(move_function move, int in, int out);
+
+/**
+ * Return whether an error number means that a way of moving data doesn't
+ * work for the kinds of files it was tried on
+ */
+static inline bool unsupported(int err);
+
+/** Return the buffer which data is copied through, allocating it at first */
+static char *copy_buffer(void);
+
+/**
+ * Copy data from a file descriptor to each of a number of others through a
+ * buffer until the end of the input
+ * @return Zero on success, or the error number on failure
+ */
+static int copy_buffered(int in, const int *outs, size_t num_outs);
+
+/**
+ * Copy a chunk of data out of a pipe to each of a number of outputs through a
+ * buffer, leaving out the start of the chunk which the first output already
+ * got
+ * @param len The length of the chunk
+ * @param done The number of bytes at the start of the chunk which the first
+ * output got
+ * @return Zero on success, or the error number on failure
+ */
+static int copy_chunk(int in, size_t len, size_t done, const int *outs,
+                      size_t num_outs);
+
+/**
+ * Duplicate data from a pipe into each of a number of pipes or regular files
+ * with tee(2) and splice until the end of the input
+ * @return Zero on success, -1 if it doesn't work for the kinds of files before
+ * any data was moved, or the error number on failure
+ */
+static int tee_splice(int in, const int *outs, size_t num_outs);
+
+/**
+ * Move an exact number of bytes out of a pipe with splice
+ * @return Zero on success, or the error number on failure
+ */
+static int splice_exactly(int in, int out, size_t len);
+
+/** Write all of a buffer to a file descriptor */
+static int write_all(int fd, const char *buf, size_t len);
+
+/* See copy.h */
+int copy_fd(int in, int out)
+{
+    struct stat in_st, out_st;
+    int flags, err;
+
+    if (fstat(in, &in_st) == -1 || fstat(out, &out_st) == -1 ||
+        (flags = fcntl(out, F_GETFL)) == -1)
+        return errno;
+
+    /*
+     * None of the system calls write to a file opened for appending, and a
+     * regular file which claims to be empty may be generated as it's read
+     * (as in /proc), which copy_file_range and sendfile don't expect
+     */
+    if (!(flags & O_APPEND) &&
+        (!S_ISREG(in_st.st_mode) || in_st.st_size > 0)) {
+        if (S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode) &&
+            (err = move_all(move_range, in, out)) != -1)
+            return err;
+        if ((S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode)) &&
+            (err = move_all(move_splice, in, out)) != -1)
+            return err;
+        if (S_ISREG(in_st.st_mode) &&
+            (err = move_all(move_sendfile, in, out)) != -1)
+            return err;
+    }
+    return copy_buffered(in, &out, 1);
+}
+
+/* See copy.h */
+int tee_fds(int in, const int *outs, size_t num_outs)
+{
+    struct stat st;
+    bool spliceable;
+    int err;
+
+    if (num_outs == 1)
+        return copy_fd(in, outs[0]);
+
+    spliceable = num_outs > 0 && fstat(in, &st) == 0 && S_ISFIFO(st.st_mode);
+    for (size_t i = 0; spliceable && i < num_outs; ++i) {
+        int flags = fcntl(outs[i], F_GETFL);
+        spliceable = flags != -1 && !(flags & O_APPEND) &&
+            fstat(outs[i], &st) == 0 &&
+            (S_ISREG(st.st_mode) || S_ISFIFO(st.st_mode));
+    }
+    if (spliceable && (err = tee_splice(in, outs, num_outs)) != -1)
+        return err;
+    return copy_buffered(in, outs, num_outs);
+}
+
+/* See above */
+static ssize_t move_range(int in, int out)
+{
+    return copy_file_range(in, NULL, out, NULL, MOVE_CHUNK_SIZE, 0);
+}
+
+/* See above */
+static ssize_t move_splice(int in, int out)
+{
+    return splice(in, NULL, out, NULL, MOVE_CHUNK_SIZE,
+                  SPLICE_F_MOVE | SPLICE_F_MORE);
+}
+
+/* See above */
+static ssize_t move_sendfile(int in, int out)
+{
+    return sendfile(out, in, NULL, MOVE_CHUNK_SIZE);
+}
+
+/* See above */
+static int move_all(move_function move, int in, int out)
+{
+    ssize_t moved;
+
+    while ((moved = move(in, out)) != 0) {
+        if (moved == -1 && errno != EINTR)
+            return unsupported(errno) ? -1 : errno;
+    }
+    return 0;
+}
+
+/* See above */
+static inline bool unsupported(int err)
+{
+    /* copy_file_range fails with EBADF for some files it can't write to */
+    return err == EINVAL || err == ENOSYS || err == EXDEV ||
+        err == EOPNOTSUPP || err == EBADF;
+}
+
+/* See above */
+static char *copy_buffer(void)
+{
+    static char *buf = NULL;
+
+    if (!buf && !(buf = malloc(COPY_BUFFER_SIZE)))
+        error(1, errno, "fatal error");
+    return buf;
+}
+
+/* See above */
+static int copy_buffered(int in, const int *outs, size_t num_outs)
+{
+    char *buf = copy_buffer();
+    ssize_t len;
+    int err;
+
+    while ((len = read(in, buf, COPY_BUFFER_SIZE)) != 0) {
+        if (len == -1) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        for (size_t i = 0; i < num_outs; ++i) {
+            if ((err = write_all(outs[i], buf, len)))
+                return err;
+        }
+    }
+    return 0;
+}
+
+/* See above */
+static int tee_splice(int in, const int *outs, size_t num_outs)
+{
+    int scratch[2], err = 0;
+    bool moved = false;
+
+    if (pipe2(scratch, O_CLOEXEC) == -1)
+        return errno;
+
+    /*
+     * Each chunk is duplicated into the scratch pipe and moved from there to
+     * each output but the last, which it is then moved to out of the input.
+     * The first tee into the empty scratch pipe determines the size of the
+     * chunk, which the later ones then get too
+     */
+    for (;;) {
+        ssize_t len = tee(in, scratch[1], MOVE_CHUNK_SIZE, 0);
+        bool copied = false;
+
+        if (len == 0)
+            break;
+        else if (len == -1) {
+            if (errno == EINTR)
+                continue;
+            err = !moved && unsupported(errno) ? -1 : errno;
+            break;
+        }
+        for (size_t i = 0; i < num_outs - 1; ++i) {
+            ssize_t teed = len;
+
+            if (i > 0) {
+                while ((teed = tee(in, scratch[1], len, 0)) == -1 &&
+                       errno == EINTR)
+                    ;
+                if (teed == -1) {
+                    err = errno;
+                    break;
+                }
+            }
+            if ((err = splice_exactly(scratch[0], outs[i], teed)))
+                break;
+            /*
+             * tee always starts at the front of the input, so the rest of a
+             * chunk it duplicated only part of is copied the slow way
+             */
+            if (teed < len) {
+                err = copy_chunk(in, len, teed, &outs[i], num_outs - i);
+                copied = true;
+                break;
+            }
+        }
+        if (err || (!copied &&
+                    (err = splice_exactly(in, outs[num_outs - 1], len))))
+            break;
+        moved = true;
+    }
+
+    close(scratch[0]);
+    close(scratch[1]);
+    return err;
+}
+
+/* See above */
+static int copy_chunk(int in, size_t len, size_t done, const int *outs,
+                      size_t num_outs)
+{
+    char *buf = copy_buffer();
+    size_t offset = 0;
+    int err;
+
+    while (offset < len) {
+        size_t skip = done > offset ? done - offset : 0;
+        ssize_t got = read(in, buf, len - offset < COPY_BUFFER_SIZE ?
+                                    len - offset : COPY_BUFFER_SIZE);
+
+        if (got == -1) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        } else if (got == 0)
+            break;
+        if (skip < got && (err = write_all(outs[0], buf + skip, got - skip)))
+            return err;
+        for (size_t i = 1; i < num_outs; ++i) {
+            if ((err = write_all(outs[i], buf, got)))
+                return err;
+        }
+        offset += got;
+    }
+    return 0;
+}
+
+/* See above */
+static int splice_exactly(int in, int out, size_t len)
+{
+    while (len > 0) {
+        ssize_t moved = splice(in, NULL, out, NULL, len,
+                               SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (moved == -1) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        len -= moved;
+    }
+    return 0;
+}
+
+/* See above */
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t written = write(fd, buf, len);
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        buf += written;
+        len -= written;
+    }
+    return 0;
+}
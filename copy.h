@@ -0,0 +1,26 @@
+#ifndef COPY_H
+#define COPY_H
+
+#include <stddef.h>
+
+/**
+ * Copy everything from a file descriptor to another until the end of the
+ * input, from and to their current offsets. The data is moved inside the
+ * kernel where the kinds of files allow it: with copy_file_range between
+ * regular files (which may share the blocks on filesystems supporting
+ * reflinks), with splice when either is a pipe, and with sendfile from a
+ * regular file. Otherwise it is copied through a buffer with read and write
+ * @return Zero on success, or the error number on failure
+ */
+int copy_fd(int in, int out);
+
+/**
+ * Copy everything from a file descriptor to each of a number of others, as
+ * tee does. If the input is a pipe and the outputs are all pipes or regular
+ * files, the data is duplicated with tee(2) and moved with splice, and
+ * otherwise it is copied through a buffer
+ * @return Zero on success, or the error number on failure
+ */
+int tee_fds(int in, const int *outs, size_t num_outs);
+
+#endif /* COPY_H */
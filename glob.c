@@ -0,0 +1,539 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "arena.h"
+#include "error.h"
+#include "glob.h"
+
+#ifndef GLOB_BUFFER_SIZE
+/** The size of the buffer which directory entries are read into in batches */
+#define GLOB_BUFFER_SIZE (256 * 1024)
+#endif
+
+/** The initial capacity of a list of paths */
+#define INITIAL_CAPACITY 16
+
+/** The number of strings at most which are sorted by insertion */
+#define INSERTION_SORT_MAX 16
+
+/** A directory entry as returned by getdents64 */
+struct Dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/** The entries of a directory, which may be cached for the command line */
+struct Listing {
+    /** The next cached listing */
+    struct Listing *next;
+
+    /** The path of the directory */
+    char *path;
+
+    /**
+     * The device, inode, and modification time of the directory when it was
+     * read, which tell whether the listing is still up to date
+     */
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+
+    /**
+     * The names of the entries, each preceded by a byte with the type of the
+     * entry (DT_DIR, etc.)
+     */
+    char **names;
+
+    /** The number of entries */
+    size_t len;
+};
+
+/** A growable list of strings allocated from cmdline_arena */
+struct List {
+    /** The strings */
+    char **items;
+
+    /** The number of strings and the size of the array */
+    size_t len, capacity;
+};
+
+/**
+ * A string being sorted along with the eight bytes of it from the depth being
+ * sorted by, as a big-endian number padded with zeros past the end of it
+ */
+struct SortItem {
+    /** The eight bytes */
+    uint64_t key;
+
+    /** The string */
+    char *str;
+};
+
+/** Whether directory listings are cached */
+static bool cache_enabled = true;
+
+/** The directory listings cached for the command line */
+static struct Listing *listings = NULL;
+
+/** The buffer which directory entries are read into */
+static char *dirent_buf = NULL;
+
+/**
+ * Expand a pattern, adding the paths matching it to a list
+ * @return The number of paths added
+ */
+static size_t expand(const char *pattern, struct List *list);
+
+/**
+ * Add the paths which extend the paths of a list (each ending with a slash,
+ * or empty for the current directory) with a component of a pattern to
+ * another list
+ * @param dir Whether to only add paths of directories, which end with a slash
+ * @param check Whether to check that literal paths exist
+ */
+static void expand_component(struct List *prefixes, const char *component,
+                             size_t len, bool dir, bool check,
+                             struct List *list);
+
+/**
+ * Read the entries of a directory, or find them in the cache
+ * @return The listing, or NULL if the directory can't be read
+ */
+static struct Listing *list_dir(const char *path);
+
+/** Return whether a component of a pattern has any special characters */
+static bool has_magic(const char *component, size_t len);
+
+/**
+ * Return whether a name matches a component of a pattern. A star is matched
+ * by moving on from where it last matched on failure, without backtracking
+ * any further, which takes at most the product of the lengths
+ */
+static bool match(const char *pat, const char *pat_end, const char *name);
+
+/**
+ * Match a character against the element at the start of a pattern (a
+ * character, ?, or a bracket expression)
+ * @return The length of the element if it matches, or zero if not
+ */
+static size_t match_char(const char *pat, const char *pat_end, char c);
+
+/**
+ * Return whether an entry of a directory (whose path ends with a slash or is
+ * empty) is a directory, following symbolic links
+ */
+static bool is_dir(const char *dir, const char *name, unsigned char type);
+
+/** Add a string to a list */
+static void list_add(struct List *list, char *str);
+
+/** Concatenate a path, a name of a given length, and optionally a slash */
+static char *join(const char *path, const char *name, size_t len,
+                  bool slash);
+
+/**
+ * Sort strings in byte order. They are sorted eight bytes at a time, by keys
+ * kept next to the pointers, so that the sorting passes run through
+ * contiguous memory instead of chasing the pointers; each string is only
+ * read again to load its next eight bytes if its key ties with another one's
+ */
+static void sort_strings(char **strs, size_t len);
+
+/**
+ * Sort items by their keys with a radix sort and then the runs of items with
+ * the same keys by the next eight bytes of their strings
+ * @param tmp Scratch space for as many items
+ * @param depth The offset in the strings of the bytes of the keys
+ */
+static void sort_items(struct SortItem *items, struct SortItem *tmp,
+                       size_t len, size_t depth);
+
+/** Load the eight bytes of a string at an offset as a key */
+static inline uint64_t load_key(const char *str, size_t depth);
+
+/* See glob.h */
+char **glob_args(size_t argc, char **argv, const bool *patterns,
+                 size_t *new_argc)
+{
+    struct List args = {NULL, 0, 0};
+
+    for (size_t i = 0; i < argc; ++i) {
+        if (!patterns[i] || expand(argv[i], &args) == 0)
+            list_add(&args, argv[i]);
+    }
+    list_add(&args, NULL);
+    *new_argc = args.len - 1;
+    return args.items;
+}
+
+/* See glob.h */
+void glob_forget(void)
+{
+    listings = NULL;
+}
+
+/* See glob.h */
+void glob_set_cache(bool enabled)
+{
+    cache_enabled = enabled;
+    listings = NULL;
+}
+
+/* See glob.h */
+bool glob_cache(void)
+{
+    return cache_enabled;
+}
+
+/* See above */
+static size_t expand(const char *pattern, struct List *list)
+{
+    struct List prefixes = {NULL, 0, 0}, next;
+    const char *p = pattern;
+    size_t first = list->len;
+    bool matched = false;
+
+    list_add(&prefixes, *p == '/' ? "/" : "");
+    while (*p == '/')
+        ++p;
+    while (*p && prefixes.len) {
+        const char *end = strchrnul(p, '/'), *rest = end;
+        bool dir;
+
+        while (*rest == '/')
+            ++rest;
+        /* Trailing slashes only match directories, and are kept */
+        dir = *end == '/';
+        next = (struct List){NULL, 0, 0};
+        expand_component(&prefixes, p, end - p, dir, matched,
+                         *rest ? &next : list);
+        matched |= has_magic(p, end - p);
+        prefixes = next;
+        p = rest;
+    }
+
+    /* A pattern which is all literal is not expanded */
+    if (!matched) {
+        list->len = first;
+        return 0;
+    }
+    sort_strings(&list->items[first], list->len - first);
+    return list->len - first;
+}
+
+/* See above */
+static void expand_component(struct List *prefixes, const char *component,
+                             size_t len, bool dir, bool check,
+                             struct List *list)
+{
+    bool magic = has_magic(component, len);
+
+    for (size_t i = 0; i < prefixes->len; ++i) {
+        const char *prefix = prefixes->items[i];
+        struct Listing *listing;
+        struct stat st;
+
+        if (!magic) {
+            char *path = join(prefix, component, len, dir);
+            /* Literal components only need checking after a match */
+            if (!check || (dir ? stat(path, &st) == 0 && S_ISDIR(st.st_mode) :
+                           lstat(path, &st) == 0))
+                list_add(list, path);
+            continue;
+        }
+
+        if (!(listing = list_dir(*prefix ? prefix : ".")))
+            continue;
+        for (size_t j = 0; j < listing->len; ++j) {
+            const char *name = listing->names[j];
+            if (name[0] == '.' && component[0] != '.')
+                continue;
+            if (match(component, component + len, name) &&
+                (!dir || is_dir(prefix, name, name[-1])))
+                list_add(list, join(prefix, name, strlen(name), dir));
+        }
+    }
+}
+
+/* See above */
+static struct Listing *list_dir(const char *path)
+{
+    struct Listing *listing;
+    struct List names = {NULL, 0, 0};
+    struct stat st;
+    long len;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return NULL;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return NULL;
+    }
+    for (listing = cache_enabled ? listings : NULL; listing;
+            listing = listing->next) {
+        if (strcmp(listing->path, path) == 0 && listing->dev == st.st_dev &&
+            listing->ino == st.st_ino &&
+            listing->mtime.tv_sec == st.st_mtim.tv_sec &&
+            listing->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            close(fd);
+            return listing;
+        }
+    }
+
+    if (!dirent_buf && !(dirent_buf = malloc(GLOB_BUFFER_SIZE)))
+        error(1, errno, "fatal error");
+    listing = arena_alloc(&cmdline_arena, sizeof(*listing));
+    while ((len = syscall(SYS_getdents64, fd, dirent_buf,
+                         GLOB_BUFFER_SIZE)) > 0) {
+        /* The names and types of a batch take less room than the entries */
+        char *strings = arena_alloc(&cmdline_arena, len);
+
+        for (long off = 0; off < len;) {
+            struct Dirent64 *entry = (struct Dirent64 *)(dirent_buf + off);
+            const char *name = entry->d_name;
+            size_t name_len;
+
+            off += entry->d_reclen;
+            if (name[0] == '.' &&
+                (!name[1] || (name[1] == '.' && !name[2])))
+                continue;
+
+            name_len = strlen(name);
+            *strings++ = entry->d_type;
+            list_add(&names, memcpy(strings, name, name_len + 1));
+            strings += name_len + 1;
+        }
+    }
+    close(fd);
+    if (len == -1)
+        return NULL;
+
+    listing->names = names.items;
+    listing->len = names.len;
+    if (cache_enabled) {
+        listing->path = strcpy(arena_alloc(&cmdline_arena, strlen(path) + 1),
+                               path);
+        listing->dev = st.st_dev;
+        listing->ino = st.st_ino;
+        listing->mtime = st.st_mtim;
+        listing->next = listings;
+        listings = listing;
+    }
+    return listing;
+}
+
+/* See above */
+static bool has_magic(const char *component, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        if (component[i] == '*' || component[i] == '?' ||
+            component[i] == '[')
+            return true;
+    }
+    return false;
+}
+
+/* See above */
+static bool match(const char *pat, const char *pat_end, const char *name)
+{
+    const char *star = NULL, *star_name = NULL;
+
+    while (*name) {
+        size_t len;
+
+        if (pat < pat_end && *pat == '*') {
+            star = ++pat;
+            star_name = name;
+            continue;
+        } else if (pat < pat_end && (len = match_char(pat, pat_end, *name))) {
+            pat += len;
+            ++name;
+            continue;
+        } else if (!star)
+            return false;
+        /* Let the last star take one more character and try again */
+        pat = star;
+        name = ++star_name;
+    }
+    while (pat < pat_end && *pat == '*')
+        ++pat;
+    return pat == pat_end;
+}
+
+/* See above */
+static size_t match_char(const char *pat, const char *pat_end, char c)
+{
+    const char *p = pat + 1;
+    bool negate, found = false;
+
+    if (*pat == '?')
+        return 1;
+    else if (*pat != '[')
+        return *pat == c;
+
+    negate = p < pat_end && (*p == '!' || *p == '^');
+    if (negate)
+        ++p;
+    /* A bracket right after the opening one is taken literally */
+    for (const char *start = p; p < pat_end && (*p != ']' || p == start);) {
+        if (p + 2 < pat_end && p[1] == '-' && p[2] != ']') {
+            found |= (unsigned char)p[0] <= (unsigned char)c &&
+                (unsigned char)c <= (unsigned char)p[2];
+            p += 3;
+        } else
+            found |= *p++ == c;
+    }
+    /* Without a closing bracket, the opening one is an ordinary character */
+    if (p == pat_end)
+        return c == '[';
+    return found != negate ? p + 1 - pat : 0;
+}
+
+/* See above */
+static bool is_dir(const char *dir, const char *name, unsigned char type)
+{
+    struct stat st;
+
+    if (type == DT_DIR)
+        return true;
+    else if (type != DT_LNK && type != DT_UNKNOWN)
+        return false;
+    return stat(join(dir, name, strlen(name), false), &st) == 0 &&
+        S_ISDIR(st.st_mode);
+}
+
+/* See above */
+static void list_add(struct List *list, char *str)
+{
+    if (list->len >= list->capacity) {
+        size_t capacity = list->capacity ? 2 * list->capacity :
+            INITIAL_CAPACITY;
+        char **items = arena_alloc(&cmdline_arena, sizeof(*items) * capacity);
+        if (list->items)
+            memcpy(items, list->items, sizeof(*items) * list->len);
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->len++] = str;
+}
+
+/* See above */
+static char *join(const char *path, const char *name, size_t len,
+                  bool slash)
+{
+    size_t path_len = strlen(path);
+    char *joined = arena_alloc(&cmdline_arena, path_len + len + 2);
+
+    memcpy(joined, path, path_len);
+    memcpy(joined + path_len, name, len);
+    strcpy(joined + path_len + len, slash ? "/" : "");
+    return joined;
+}
+
+/* See above */
+static void sort_strings(char **strs, size_t len)
+{
+    struct SortItem *items, *tmp;
+
+    if (len < 2)
+        return;
+    items = arena_alloc(&cmdline_arena, sizeof(*items) * 2 * len);
+    tmp = items + len;
+    for (size_t i = 0; i < len; ++i)
+        items[i] = (struct SortItem){load_key(strs[i], 0), strs[i]};
+    sort_items(items, tmp, len, 0);
+    for (size_t i = 0; i < len; ++i)
+        strs[i] = items[i].str;
+}
+
+/* See above */
+static void sort_items(struct SortItem *items, struct SortItem *tmp,
+                       size_t len, size_t depth)
+{
+    size_t counts[8][256] = {{0}};
+    struct SortItem *from = items, *to = tmp;
+
+    if (len <= INSERTION_SORT_MAX) {
+        for (size_t i = 1; i < len; ++i) {
+            struct SortItem item = items[i];
+            size_t j = i;
+            for (; j > 0; --j) {
+                struct SortItem *prev = &items[j - 1];
+                /* A key ending in a null byte is the end of the string */
+                if (prev->key < item.key ||
+                    (prev->key == item.key &&
+                     (!(item.key & 0xff) ||
+                      strcmp(prev->str + depth + 8,
+                             item.str + depth + 8) <= 0)))
+                    break;
+                items[j] = *prev;
+            }
+            items[j] = item;
+        }
+        return;
+    }
+
+    /* The least significant byte first, skipping bytes which all share */
+    for (size_t i = 0; i < len; ++i) {
+        for (int byte = 0; byte < 8; ++byte)
+            ++counts[byte][(items[i].key >> (8 * byte)) & 0xff];
+    }
+    for (int byte = 0; byte < 8; ++byte) {
+        size_t offset = 0;
+        struct SortItem *swap;
+        int shift = 8 * byte;
+
+        if (counts[byte][(items[0].key >> shift) & 0xff] == len)
+            continue;
+        for (int digit = 0; digit < 256; ++digit) {
+            size_t count = counts[byte][digit];
+            counts[byte][digit] = offset;
+            offset += count;
+        }
+        for (size_t i = 0; i < len; ++i)
+            to[counts[byte][(from[i].key >> shift) & 0xff]++] = from[i];
+        swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != items)
+        memcpy(items, from, sizeof(*items) * len);
+
+    for (size_t i = 0, j; i < len; i = j) {
+        for (j = i + 1; j < len && items[j].key == items[i].key; ++j)
+            ;
+        if (j - i < 2 || !(items[i].key & 0xff))
+            continue;
+        for (size_t k = i; k < j; ++k)
+            items[k].key = load_key(items[k].str, depth + 8);
+        sort_items(&items[i], &tmp[i], j - i, depth + 8);
+    }
+}
+
+/* See above */
+static inline uint64_t load_key(const char *str, size_t depth)
+{
+    const unsigned char *p = (const unsigned char *)str + depth;
+    uint64_t key = 0;
+
+    /* Once the null terminator is reached, the rest is padded with zeros */
+    for (int i = 0; i < 8; ++i) {
+        key <<= 8;
+        if (*p)
+            key |= *p++;
+    }
+    return key;
+}
@@ -0,0 +1,41 @@
+#ifndef GLOB_H
+#define GLOB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Expand the glob patterns among the arguments of a command into the paths
+ * matching them. Each pattern is split at slashes into components, and those
+ * with *, ?, or [...] are matched against the entries of the directories the
+ * previous ones led to, which don't include . and .., nor names starting with
+ * a dot unless the component does too. The matches of each pattern are sorted
+ * in byte order, and a pattern which matches nothing is kept as it is
+ * @param argc The number of arguments
+ * @param argv The arguments
+ * @param patterns Which of the arguments are patterns
+ * @param new_argc Set to the number of arguments after expansion
+ * @return The expanded arguments, null-terminated and allocated from
+ * cmdline_arena
+ */
+char **glob_args(size_t argc, char **argv, const bool *patterns,
+                 size_t *new_argc);
+
+/**
+ * Forget the directory listings cached for the command line, which must be
+ * done whenever cmdline_arena is reset
+ */
+void glob_forget(void);
+
+/**
+ * Enable or disable caching the directory listings read for patterns until the
+ * end of the command line, so that several patterns over the same directory
+ * read it once. A cached listing is only used while the directory hasn't been
+ * modified since it was read
+ */
+void glob_set_cache(bool enabled);
+
+/** Return whether directory listings are cached */
+bool glob_cache(void);
+
+#endif /* GLOB_H */
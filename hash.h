@@ -0,0 +1,18 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Hash a string of a given length (64-bit FNV-1a) */
+static inline uint64_t hash_string(const char *str, size_t len)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char)str[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+#endif /* HASH_H */
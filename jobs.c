@@ -0,0 +1,707 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "error.h"
+#include "jobs.h"
+#include "jobserver.h"
+#include "trace.h"
+
+/** The initial number of buckets in the hash table of children */
+#define INITIAL_BUCKETS 64
+
+/** A child which is kept track of until it's waited for */
+struct Proc {
+    /** The next child in the same bucket of the hash table */
+    struct Proc *chain;
+
+    /** The process ID */
+    pid_t pid;
+
+    /** Whether the child was reaped after exiting */
+    bool exited;
+
+    /** The exit status, once the child was reaped */
+    int status;
+
+    /** The job run by the child, or NULL if it runs in the foreground */
+    struct Job *job;
+};
+
+/** The hash table of children, by process ID */
+static struct Proc **buckets = NULL;
+
+/** The number of buckets in the hash table (always a power of two) */
+static size_t num_buckets = 0;
+
+/** The number of children in the hash table */
+static size_t num_procs = 0;
+
+/** Children which were removed from the table, to be reused */
+static struct Proc *free_procs = NULL;
+
+/** The oldest and the most recent job in the table */
+static struct Job *first_job = NULL, *last_job = NULL;
+
+/**
+ * The oldest queued job. Since new jobs are queued while any are, the queued
+ * jobs are all of the jobs from this one on
+ */
+static struct Job *first_queued = NULL;
+
+/** The number of running jobs and the limit on it (zero if unlimited) */
+static size_t num_running = 0, max_running = 0;
+
+/** The resources used by the foreground children which were reaped */
+static struct rusage usage;
+
+/** Set by the handler for SIGCHLD, and cleared once children are reaped */
+static volatile sig_atomic_t children_changed = 0;
+
+/** Note that a child has exited, stopped or continued */
+static void handle_sigchld(int sig);
+
+/**
+ * Find a child in the hash table
+ * @return The link to the child in its bucket, which is NULL if the child
+ * isn't in the table
+ */
+static struct Proc **find_proc(pid_t pid);
+
+/** Add a child to the hash table */
+static void add_proc(pid_t pid, struct Job *job);
+
+/** Remove a child from the hash table, given its link in its bucket */
+static void remove_proc(struct Proc **link);
+
+/** Double the number of buckets in the hash table */
+static void grow_table(void);
+
+/** Reap the children which have exited, stopped or continued, if any */
+static void reap_children(void);
+
+/** Add the resources used by a foreground child to the total */
+static void add_usage(const struct rusage *child);
+
+/**
+ * Return the exit status of a child which exited or was terminated, given its
+ * wait status, which is 128 plus the number of the signal for the latter
+ */
+static inline int exit_status(int wstatus);
+
+/** Update the state of a job after its child was reaped with a wait status */
+static void update_job(struct Job *job, int wstatus);
+
+/** Change the state of a job, keeping count of the running jobs */
+static void set_state(struct Job *job, enum JobState state);
+
+/** Add a job in a given state to the end of the table */
+static struct Job *add_job(enum JobState state, const char *name);
+
+/** Return whether fewer jobs than the limit are running */
+static inline bool below_limit(void);
+
+/**
+ * Let the child of a queued job go from job_hold and close the shell's end of
+ * its socket
+ * @param start Whether the child runs the job, rather than exiting
+ */
+static void release(struct Job *job, bool start);
+
+/**
+ * Start queued jobs for as long as fewer jobs than the limit are running and
+ * there are tokens from the jobserver for them
+ */
+static void start_queued(void);
+
+/**
+ * Suspend the shell with a signal mask until SIGCHLD arrives, until a token
+ * from the jobserver may be available if queued jobs only need one, or until a
+ * file descriptor has input
+ * @param fd The file descriptor, or -1 for none
+ * @return Whether the file descriptor has input
+ */
+static bool suspend(const sigset_t *mask, int fd);
+
+/**
+ * Start all of the queued jobs before the shell exits (registered with
+ * atexit), waiting for running jobs to make room for them
+ */
+static void drain_queue(void);
+
+/* See jobs.h */
+void jobs_init(void)
+{
+    struct sigaction sa;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    max_running = cpus > 0 ? cpus : 0;
+
+    /* Reading the next command line must not be interrupted */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigchld;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, NULL);
+    atexit(drain_queue);
+}
+
+/* See jobs.h */
+void jobs_forget(void)
+{
+    /*
+     * The tables are dropped rather than freed, which would take time in
+     * proportion to the number of jobs and copy the pages they're on
+     */
+    /* Queued jobs mustn't be kept waiting by the sockets of the copy */
+    for (struct Job *job = first_queued; job; job = job->next) {
+        if (job->state == JOB_QUEUED)
+            close(job->gate);
+    }
+    buckets = NULL;
+    num_buckets = num_procs = 0;
+    free_procs = NULL;
+    first_job = last_job = first_queued = NULL;
+    num_running = 0;
+    children_changed = 0;
+    jobserver_forget();
+}
+
+/* See jobs.h */
+void jobs_track(pid_t pid)
+{
+    add_proc(pid, NULL);
+}
+
+/* See jobs.h */
+int jobs_wait_child(pid_t pid)
+{
+    struct Proc **link = find_proc(pid);
+    struct rusage child;
+    int wstatus, status;
+
+    if (*link && (*link)->exited)
+        status = (*link)->status;
+    else if (*link && first_queued) {
+        uint64_t start = trace_start();
+        sigset_t mask, old_mask;
+
+        /* Queued jobs are started as running ones exit in the meantime */
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &mask, &old_mask);
+        while (jobs_reap(), !(*(link = find_proc(pid)))->exited)
+            suspend(&old_mask, -1);
+        sigprocmask(SIG_SETMASK, &old_mask, NULL);
+        status = (*link)->status;
+        if (tracing)
+            trace_span("wait", NULL, start);
+    } else {
+        uint64_t start = trace_start();
+        while (wait4(pid, &wstatus, 0, &child) == -1) {
+            if (errno != EINTR)
+                error(errno, errno, "error");
+        }
+        add_usage(&child);
+        status = exit_status(wstatus);
+        if (tracing) {
+            trace_span("wait", NULL, start);
+            trace_child_exit(pid, status);
+        }
+    }
+    if (*link)
+        remove_proc(link);
+    return status;
+}
+
+/* See jobs.h */
+void jobs_reap(void)
+{
+    reap_children();
+
+    /* Tokens from the jobserver can turn up without any child exiting */
+    start_queued();
+}
+
+/* See jobs.h */
+bool jobs_exited(pid_t pid)
+{
+    struct Proc *proc;
+
+    reap_children();
+    proc = *find_proc(pid);
+    return !proc || proc->exited;
+}
+
+/* See jobs.h */
+void jobs_wait_input(int fd)
+{
+    sigset_t mask, old_mask;
+
+    if (!first_queued)
+        return;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &old_mask);
+    while (jobs_reap(), first_queued && !suspend(&old_mask, fd))
+        ;
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+/* See jobs.h */
+struct rusage *jobs_usage(void)
+{
+    return &usage;
+}
+
+/* See jobs.h */
+void jobs_notify(void)
+{
+    struct Job *job = first_job;
+
+    jobs_reap();
+    while (job) {
+        struct Job *next = job->next;
+        if (job->changed)
+            job_print(job);
+        if (job->state == JOB_DONE)
+            job_remove(job);
+        job = next;
+    }
+}
+
+/* See jobs.h */
+struct Job *job_new(pid_t pid, const char *name)
+{
+    struct Job *job = add_job(JOB_RUNNING, name);
+
+    job->pid = pid;
+    add_proc(pid, job);
+    return job;
+}
+
+/* See jobs.h */
+struct Job *job_queue(pid_t pid, int gate[2], const char *name)
+{
+    struct Job *job = add_job(JOB_QUEUED, name);
+
+    close(gate[1]);
+    job->pid = pid;
+    job->gate = gate[0];
+    add_proc(pid, job);
+    if (!first_queued)
+        first_queued = job;
+    return job;
+}
+
+/* See jobs.h */
+void job_hold(int gate[2])
+{
+    char start;
+    ssize_t len;
+
+    close(gate[0]);
+    while ((len = read(gate[1], &start, 1)) == -1 && errno == EINTR)
+        ;
+    close(gate[1]);
+    if (len != 1)
+        _exit(0);
+}
+
+/* See jobs.h */
+void jobs_clear(void)
+{
+    drain_queue();
+    while (first_job)
+        job_remove(first_job);
+}
+
+/* See jobs.h */
+bool jobs_can_start(void)
+{
+    /* Slots may have been freed by removing running jobs */
+    start_queued();
+    return !first_queued && below_limit() && jobserver_acquire();
+}
+
+/* See jobs.h */
+void jobs_set_limit(size_t limit)
+{
+    max_running = limit;
+    start_queued();
+}
+
+/* See jobs.h */
+size_t jobs_limit(void)
+{
+    return max_running;
+}
+
+/* See jobs.h */
+struct Job *jobs_first(void)
+{
+    return first_job;
+}
+
+/* See jobs.h */
+struct Job *job_find(const char *spec)
+{
+    struct Proc *proc;
+    char *end;
+    long n;
+
+    if (!spec || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0)
+        return last_job;
+
+    n = strtol(spec + (*spec == '%'), &end, 10);
+    if (*end || end == spec + (*spec == '%') || n <= 0)
+        return NULL;
+    if (*spec == '%') {
+        for (struct Job *job = last_job; job && job->id >= n; job = job->prev) {
+            if (job->id == n)
+                return job;
+        }
+        return NULL;
+    }
+
+    /* Jobs which are done are no longer in the table of children */
+    if ((proc = *find_proc(n)) && proc->job)
+        return proc->job;
+    for (struct Job *job = first_job; job; job = job->next) {
+        if (job->pid == n)
+            return job;
+    }
+    return NULL;
+}
+
+/* See jobs.h */
+int job_wait(struct Job *job)
+{
+    sigset_t mask, old_mask;
+
+    /* SIGCHLD can only arrive while suspended, so it can't be missed */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &old_mask);
+    while (jobs_reap(), job->state == JOB_QUEUED || job->state == JOB_RUNNING)
+        suspend(&old_mask, -1);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    return job->status;
+}
+
+/* See jobs.h */
+void job_continue(struct Job *job)
+{
+    if (job->state != JOB_STOPPED)
+        return;
+    if (kill(-job->pid, SIGCONT) == -1)
+        kill(job->pid, SIGCONT);
+    set_state(job, JOB_RUNNING);
+}
+
+/* See jobs.h */
+void job_print(struct Job *job)
+{
+    const char *state = "Done";
+    char exit[16];
+
+    if (job->state == JOB_QUEUED)
+        state = "Queued";
+    else if (job->state == JOB_RUNNING)
+        state = "Running";
+    else if (job->state == JOB_STOPPED)
+        state = "Stopped";
+    else if (job->signal)
+        state = strsignal(job->signal);
+    else if (job->status) {
+        snprintf(exit, sizeof(exit), "Exit %d", job->status);
+        state = exit;
+    }
+    printf("[%d]%c %-10s %s\n", job->id, job == last_job ? '+' : ' ', state,
+           job->name);
+    job->changed = false;
+}
+
+/* See jobs.h */
+void job_remove(struct Job *job)
+{
+    struct Proc **link;
+
+    if (job->state == JOB_QUEUED)
+        release(job, false);
+    if (job->state != JOB_DONE && *(link = find_proc(job->pid)))
+        remove_proc(link);
+    set_state(job, JOB_DONE);
+
+    if (job->prev)
+        job->prev->next = job->next;
+    else
+        first_job = job->next;
+    if (job->next)
+        job->next->prev = job->prev;
+    else
+        last_job = job->prev;
+    free(job);
+}
+
+/* See above */
+static void handle_sigchld(int sig)
+{
+    children_changed = 1;
+}
+
+/* See above */
+static struct Proc **find_proc(pid_t pid)
+{
+    struct Proc **link;
+
+    if (!num_buckets)
+        grow_table();
+    link = &buckets[(size_t)pid & (num_buckets - 1)];
+    while (*link && (*link)->pid != pid)
+        link = &(*link)->chain;
+    return link;
+}
+
+/* See above */
+static void add_proc(pid_t pid, struct Job *job)
+{
+    struct Proc *proc, **bucket;
+
+    if (num_procs >= num_buckets)
+        grow_table();
+    if ((proc = free_procs))
+        free_procs = proc->chain;
+    else if (!(proc = malloc(sizeof(*proc))))
+        error(1, errno, "fatal error");
+    proc->pid = pid;
+    proc->exited = false;
+    proc->status = 0;
+    proc->job = job;
+
+    /* Process IDs are mostly sequential, so their low bits spread well */
+    bucket = &buckets[(size_t)pid & (num_buckets - 1)];
+    proc->chain = *bucket;
+    *bucket = proc;
+    ++num_procs;
+}
+
+/* See above */
+static void remove_proc(struct Proc **link)
+{
+    struct Proc *proc = *link;
+
+    *link = proc->chain;
+    proc->chain = free_procs;
+    free_procs = proc;
+    --num_procs;
+}
+
+/* See above */
+static void grow_table(void)
+{
+    struct Proc **old_buckets = buckets;
+    size_t old_num_buckets = num_buckets;
+
+    num_buckets = num_buckets ? 2 * num_buckets : INITIAL_BUCKETS;
+    if (!(buckets = calloc(num_buckets, sizeof(*buckets))))
+        error(1, errno, "fatal error");
+
+    for (size_t i = 0; i < old_num_buckets; ++i) {
+        struct Proc *proc = old_buckets[i];
+        while (proc) {
+            struct Proc *chain = proc->chain;
+            size_t index = (size_t)proc->pid & (num_buckets - 1);
+            proc->chain = buckets[index];
+            buckets[index] = proc;
+            proc = chain;
+        }
+    }
+    free(old_buckets);
+}
+
+/* See above */
+static void reap_children(void)
+{
+    struct rusage child;
+    pid_t pid;
+    int wstatus;
+
+    if (children_changed) {
+        children_changed = 0;
+        while ((pid = wait4(-1, &wstatus, WNOHANG | WUNTRACED | WCONTINUED,
+                            &child)) > 0) {
+            struct Proc **link = find_proc(pid), *proc = *link;
+
+            if (tracing && (WIFEXITED(wstatus) || WIFSIGNALED(wstatus)))
+                trace_child_exit(pid, exit_status(wstatus));
+            /* Disowned jobs are no longer kept track of */
+            if (!proc)
+                continue;
+            if (proc->job) {
+                update_job(proc->job, wstatus);
+                if (proc->job->state == JOB_DONE)
+                    remove_proc(link);
+            } else if (WIFEXITED(wstatus) || WIFSIGNALED(wstatus)) {
+                add_usage(&child);
+                proc->exited = true;
+                proc->status = exit_status(wstatus);
+            }
+        }
+    }
+}
+
+/* See above */
+static void add_usage(const struct rusage *child)
+{
+    timeradd(&usage.ru_utime, &child->ru_utime, &usage.ru_utime);
+    timeradd(&usage.ru_stime, &child->ru_stime, &usage.ru_stime);
+    if (child->ru_maxrss > usage.ru_maxrss)
+        usage.ru_maxrss = child->ru_maxrss;
+    usage.ru_minflt += child->ru_minflt;
+    usage.ru_majflt += child->ru_majflt;
+    usage.ru_nvcsw += child->ru_nvcsw;
+    usage.ru_nivcsw += child->ru_nivcsw;
+}
+
+/* See above */
+static void update_job(struct Job *job, int wstatus)
+{
+    /* A queued job is only waiting to start, until it's gone */
+    if (job->state == JOB_QUEUED &&
+        (WIFSTOPPED(wstatus) || WIFCONTINUED(wstatus)))
+        return;
+    if (job->state == JOB_QUEUED)
+        release(job, false);
+    if (WIFSTOPPED(wstatus)) {
+        set_state(job, JOB_STOPPED);
+        job->status = 128 + WSTOPSIG(wstatus);
+        job->changed = true;
+    } else if (WIFCONTINUED(wstatus))
+        set_state(job, JOB_RUNNING);
+    else {
+        set_state(job, JOB_DONE);
+        job->status = exit_status(wstatus);
+        job->signal = WIFSIGNALED(wstatus) ? WTERMSIG(wstatus) : 0;
+        job->changed = true;
+    }
+}
+
+/* See above */
+static inline int exit_status(int wstatus)
+{
+    if (WIFSIGNALED(wstatus))
+        return 128 + WTERMSIG(wstatus);
+    return WEXITSTATUS(wstatus);
+}
+
+/* See above */
+static void set_state(struct Job *job, enum JobState state)
+{
+    /* A job holds a token from when it starts until it's done */
+    if (state == JOB_DONE &&
+        (job->state == JOB_RUNNING || job->state == JOB_STOPPED))
+        jobserver_release();
+    if (job->state == JOB_RUNNING)
+        --num_running;
+    if (state == JOB_RUNNING)
+        ++num_running;
+    /* The queue stays at the oldest job which is still queued */
+    if (job == first_queued && state != JOB_QUEUED) {
+        do
+            first_queued = first_queued->next;
+        while (first_queued && first_queued->state != JOB_QUEUED);
+    }
+    job->state = state;
+}
+
+/* See above */
+static struct Job *add_job(enum JobState state, const char *name)
+{
+    size_t name_len = strlen(name);
+    struct Job *job = malloc(sizeof(*job) + name_len + 1);
+
+    if (!job)
+        error(1, errno, "fatal error");
+    job->id = last_job ? last_job->id + 1 : 1;
+    job->pid = -1;
+    job->gate = -1;
+    job->state = JOB_DONE;
+    set_state(job, state);
+    job->status = 0;
+    job->signal = 0;
+    job->changed = false;
+    memcpy(job->name, name, name_len + 1);
+
+    job->prev = last_job;
+    job->next = NULL;
+    if (last_job)
+        last_job->next = job;
+    else
+        first_job = job;
+    last_job = job;
+    return job;
+}
+
+/* See above */
+static inline bool below_limit(void)
+{
+    return !max_running || num_running < max_running;
+}
+
+/* See above */
+static void start_queued(void)
+{
+    while (first_queued && below_limit() && jobserver_acquire()) {
+        struct Job *job = first_queued;
+
+        release(job, true);
+        set_state(job, JOB_RUNNING);
+    }
+}
+
+/* See above */
+static void release(struct Job *job, bool start)
+{
+    /* The child may be gone already, which mustn't raise SIGPIPE */
+    if (start)
+        send(job->gate, "", 1, MSG_NOSIGNAL);
+    close(job->gate);
+    job->gate = -1;
+}
+
+/* See above */
+static bool suspend(const sigset_t *mask, int fd)
+{
+    struct pollfd pfd = {fd, POLLIN, 0};
+
+    if (first_queued && below_limit())
+        return jobserver_suspend(mask, fd);
+    /* Without a file descriptor, this is sigsuspend */
+    return ppoll(&pfd, 1, NULL, mask) > 0;
+}
+
+/* See above */
+static void drain_queue(void)
+{
+    sigset_t mask, old_mask;
+
+    if (!first_queued)
+        return;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &old_mask);
+    while (jobs_reap(), first_queued)
+        suspend(&old_mask, -1);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
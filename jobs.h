@@ -0,0 +1,204 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include "plan.h"
+
+/** Constants for the states of a job */
+enum JobState {
+    JOB_QUEUED, /**< The job waits for fewer jobs to be running to start */
+    JOB_RUNNING, /**< The job is running */
+    JOB_STOPPED, /**< The job was stopped by a signal */
+    JOB_DONE /**< The job has exited */
+};
+
+/**
+ * A command run in the background. Each job is a child running a block of
+ * instructions in a process group of its own, with the same ID as the child
+ */
+struct Job {
+    /** The previous and next jobs in the table, which is in order of ID */
+    struct Job *prev, *next;
+
+    /** The number of the job, as given to the job built-ins with % */
+    int id;
+
+    /** The process ID of the child, which waits while the job is queued */
+    pid_t pid;
+
+    /**
+     * The shell's end of the socket which the child of a queued job waits on
+     * in job_hold, or -1 once the job has left the queue
+     */
+    int gate;
+
+    /** The state of the job */
+    enum JobState state;
+
+    /**
+     * The exit status of the job once it's done, or 128 plus the number of the
+     * signal which stopped or terminated it
+     */
+    int status;
+
+    /** The signal which terminated the job once it's done, or 0 if it exited */
+    int signal;
+
+    /** Whether the state changed since the job was last reported */
+    bool changed;
+
+    /** The command line of the job, for reporting it */
+    char name[];
+};
+
+/**
+ * Start reaping children as they exit and limit the number of running jobs to
+ * the number of online processors. A handler for SIGCHLD notes that children
+ * have exited, and they are reaped whenever the shell next checks. Jobs which
+ * are still queued when the shell exits are started before it does
+ */
+void jobs_init(void);
+
+/**
+ * Forget about all of the children and jobs, which belong to the parent in a
+ * newly forked child
+ */
+void jobs_forget(void);
+
+/** Keep track of a child which will be waited for with jobs_wait_child */
+void jobs_track(pid_t pid);
+
+/**
+ * Wait for a child that is being kept track of to exit, whether or not it
+ * was already reaped, and stop keeping track of it. Queued jobs are started
+ * in the meantime as room is made for them
+ * @return The exit status of the child
+ */
+int jobs_wait_child(pid_t pid);
+
+/**
+ * Reap the children which have exited, stopped or continued since the last
+ * time, updating the states of their jobs. Nothing is done unless SIGCHLD was
+ * received in the meantime
+ */
+void jobs_reap(void);
+
+/**
+ * Return whether a child which is kept track of has exited, reaping children
+ * first but without starting queued jobs. A child which isn't kept track of
+ * is taken to have exited
+ */
+bool jobs_exited(pid_t pid);
+
+/**
+ * Wait for input on a file descriptor while there are queued jobs, starting
+ * them as room is made for them, as an interactive shell does before reading
+ * its next line. Nothing is done if no jobs are queued
+ */
+void jobs_wait_input(int fd);
+
+/**
+ * Return the resources used by the foreground children reaped so far, like
+ * getrusage with RUSAGE_CHILDREN but leaving out jobs. The times, fault and
+ * context switch counts are totals, while the maximum resident set size is
+ * that of the largest child, which the caller may reset to measure a span
+ */
+struct rusage *jobs_usage(void);
+
+/**
+ * Print the jobs which have stopped or are done since they were last reported
+ * and remove the jobs which are done, as an interactive shell does before
+ * showing its prompt
+ */
+void jobs_notify(void);
+
+/**
+ * Add a job to the table for a child which was just forked into a process
+ * group of its own
+ * @return The job
+ */
+struct Job *job_new(pid_t pid, const char *name);
+
+/**
+ * Add a job to the table for a child which was just forked into a process
+ * group of its own and waits in job_hold until fewer jobs than the limit are
+ * running. Queued jobs are started in order as running jobs exit or stop and
+ * tokens from the jobserver turn up, which the shell notices whenever it reaps
+ * children: before each command line, while it waits for commands or for
+ * input, and before it exits
+ * @param gate The socket pair the child was forked with, of which the shell
+ * keeps the first end
+ * @return The job
+ */
+struct Job *job_queue(pid_t pid, int gate[2], const char *name);
+
+/**
+ * Wait in the child of a queued job until the shell starts the job, or exit
+ * if the job is removed from the table (or the shell exits) before then
+ * @param gate The socket pair the child was forked with, of which the child
+ * keeps the second end
+ */
+void job_hold(int gate[2]);
+
+/**
+ * Return whether a new job can be started right away rather than queued,
+ * because fewer jobs than the limit are running, none are queued, and a token
+ * from the jobserver was taken for it if the shell is a client of one
+ */
+bool jobs_can_start(void);
+
+/**
+ * Start the queued jobs, waiting for running jobs to make room for them as
+ * the shell does before it exits, and then remove all of the jobs from the
+ * table, so that the running ones are reaped silently when they exit
+ */
+void jobs_clear(void);
+
+/**
+ * Set the maximum number of jobs running at once, where zero means there is no
+ * limit. The default is the number of online processors, as set by jobs_init
+ */
+void jobs_set_limit(size_t limit);
+
+/** Return the maximum number of jobs running at once, or zero if unlimited */
+size_t jobs_limit(void);
+
+/** Return the first (oldest) job in the table, or NULL if there are none */
+struct Job *jobs_first(void);
+
+/**
+ * Find a job by a specification: NULL, "%%" or "%+" for the current (most
+ * recent) job, %n for the job numbered n, or a process ID
+ * @return The job, or NULL if there's no such job
+ */
+struct Job *job_find(const char *spec);
+
+/**
+ * Wait until a job is no longer queued or running, suspending the shell until
+ * SIGCHLD
+ * @return The status of the job
+ */
+int job_wait(struct Job *job);
+
+/** Continue a stopped job by sending SIGCONT to its process group */
+void job_continue(struct Job *job);
+
+/**
+ * Print the number, state and command line of a job, marking the current job
+ * with a plus
+ */
+void job_print(struct Job *job);
+
+/**
+ * Remove a job from the table. If it's still running, it's no longer kept
+ * track of and is reaped silently when it exits, and if it's queued, it never
+ * starts
+ */
+void job_remove(struct Job *job);
+
+#endif /* JOBS_H */
@@ -0,0 +1,207 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "error.h"
+#include "jobserver.h"
+#include "vars.h"
+
+/** The options of MAKEFLAGS naming the jobserver, for newer and older makes */
+static const char *auth_options[] = {
+    "--jobserver-auth=",
+    "--jobserver-fds=",
+};
+
+/**
+ * The file descriptor which tokens are read from without blocking, or -1 if
+ * the shell isn't a client of a jobserver
+ */
+static int read_fd = -1;
+
+/** The file descriptor which tokens are given back to */
+static int write_fd = -1;
+
+/** Whether the token given to the shell implicitly is used by a job */
+static bool implicit_used = false;
+
+/** The tokens held by jobs, which are given back as they were read */
+static char *tokens = NULL;
+
+/** The number of tokens held and the capacity of the array */
+static size_t num_tokens = 0, tokens_capacity = 0;
+
+/**
+ * Find the value of the last option naming the jobserver in MAKEFLAGS
+ * @return The value, which ends at a space or the end of the string, or NULL
+ * if there is no such option
+ */
+static const char *find_auth(const char *flags);
+
+/** Return whether a file descriptor is open on a pipe */
+static bool is_pipe(int fd);
+
+/** Give back all of the tokens held when the shell exits */
+static void release_all(void);
+
+/* See jobserver.h */
+bool jobserver_init(void)
+{
+    const char *flags = var_get("MAKEFLAGS"), *auth;
+    char path[64];
+    int r, w;
+
+    if (!flags || !(auth = find_auth(flags)))
+        return false;
+
+    if (strncmp(auth, "fifo:", 5) == 0) {
+        char *fifo = strndup(auth + 5, strcspn(auth + 5, " "));
+        if (!fifo)
+            error(1, errno, "fatal error");
+        read_fd = write_fd = open(fifo, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        free(fifo);
+    } else {
+        /* make closes the pipe for commands it doesn't consider recursive */
+        if (sscanf(auth, "%d,%d", &r, &w) != 2 || !is_pipe(r) || !is_pipe(w))
+            return false;
+
+        /*
+         * Reopening the pipe gives the shell a file description of its own,
+         * which can be made non-blocking without affecting make
+         */
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", r);
+        read_fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        write_fd = w;
+    }
+    if (read_fd == -1) {
+        write_fd = -1;
+        return false;
+    }
+    atexit(release_all);
+    return true;
+}
+
+/* See jobserver.h */
+int jobserver_serve(int slots)
+{
+    const char *old_flags = var_get("MAKEFLAGS");
+    char *flags, *buf;
+    int fds[2];
+
+    /* The shell has the first slot implicitly, like make */
+    if (pipe(fds) == -1)
+        return -1;
+    if (!(buf = malloc(slots)))
+        error(1, errno, "fatal error");
+    memset(buf, '+', slots);
+    if (slots > 1 && write(fds[1], buf, slots - 1) != slots - 1) {
+        int err = errno;
+        free(buf);
+        close(fds[0]);
+        close(fds[1]);
+        errno = err;
+        return -1;
+    }
+    free(buf);
+
+    /* The last option wins, in case the shell is itself run by make */
+    if (asprintf(&flags, "%s -j%d --jobserver-auth=%d,%d",
+                 old_flags ? old_flags : "", slots, fds[0], fds[1]) == -1)
+        error(1, errno, "fatal error");
+    var_set("MAKEFLAGS", strlen("MAKEFLAGS"), flags, true);
+    free(flags);
+    return 0;
+}
+
+/* See jobserver.h */
+bool jobserver_acquire(void)
+{
+    char token;
+
+    if (read_fd == -1)
+        return true;
+    if (!implicit_used) {
+        implicit_used = true;
+        return true;
+    }
+    if (read(read_fd, &token, 1) != 1)
+        return false;
+
+    if (num_tokens >= tokens_capacity) {
+        tokens_capacity = tokens_capacity ? 2 * tokens_capacity : 16;
+        if (!(tokens = realloc(tokens, tokens_capacity)))
+            error(1, errno, "fatal error");
+    }
+    tokens[num_tokens++] = token;
+    return true;
+}
+
+/* See jobserver.h */
+void jobserver_release(void)
+{
+    if (read_fd == -1)
+        return;
+    if (num_tokens == 0) {
+        implicit_used = false;
+        return;
+    }
+    --num_tokens;
+    while (write(write_fd, &tokens[num_tokens], 1) == -1 && errno == EINTR)
+        ;
+}
+
+/* See jobserver.h */
+void jobserver_forget(void)
+{
+    /*
+     * The implicit token stays in use if a job of the parent (possibly the
+     * child itself) runs on it, so that jobs of the child take tokens of their
+     * own rather than each child running one more job on the same token
+     */
+    num_tokens = 0;
+}
+
+/* See jobserver.h */
+bool jobserver_suspend(const sigset_t *mask, int fd)
+{
+    /* Negative file descriptors are ignored by ppoll */
+    struct pollfd pfds[2] = {{fd, POLLIN, 0}, {read_fd, POLLIN, 0}};
+
+    return ppoll(pfds, 2, NULL, mask) > 0 && pfds[0].revents;
+}
+
+/* See above */
+static const char *find_auth(const char *flags)
+{
+    const char *auth = NULL;
+
+    for (int i = 0; i < sizeof(auth_options) / sizeof(*auth_options); ++i) {
+        size_t len = strlen(auth_options[i]);
+        for (const char *p = flags; (p = strstr(p, auth_options[i]));
+                p += len)
+            auth = p + len;
+        if (auth)
+            break;
+    }
+    return auth;
+}
+
+/* See above */
+static bool is_pipe(int fd)
+{
+    struct stat st;
+    return fd >= 0 && fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+/* See above */
+static void release_all(void)
+{
+    while (num_tokens)
+        jobserver_release();
+}
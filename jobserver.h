@@ -0,0 +1,48 @@
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+#include <signal.h>
+#include <stdbool.h>
+
+/**
+ * Become a client of the jobserver named by MAKEFLAGS with --jobserver-auth
+ * (a pair of pipe file descriptors or a named pipe), if there is one which is
+ * open. Each job then holds a token from the jobserver while it runs, except
+ * that one job at a time may run on the token implicitly given to the shell
+ * @return Whether the shell is a client
+ */
+bool jobserver_init(void);
+
+/**
+ * Start a jobserver with a number of slots, publishing it in MAKEFLAGS to the
+ * children of the shell, which makes and other shells under it share. The
+ * shell becomes a client of it with jobserver_init
+ * @return Zero on success, -1 with errno set on failure
+ */
+int jobserver_serve(int slots);
+
+/**
+ * Take a token for a job without blocking
+ * @return Whether a token was taken (always true if there is no jobserver)
+ */
+bool jobserver_acquire(void);
+
+/** Give back the token of a job */
+void jobserver_release(void);
+
+/**
+ * Forget about the tokens held by the shell, which belong to the parent in a
+ * newly forked child. The token given to the shell implicitly stays in use if
+ * it was
+ */
+void jobserver_forget(void);
+
+/**
+ * Suspend the shell with a signal mask until a signal arrives, a token may be
+ * available, or a file descriptor has input
+ * @param fd The file descriptor, or -1 for none
+ * @return Whether the file descriptor has input
+ */
+bool jobserver_suspend(const sigset_t *mask, int fd);
+
+#endif /* JOBSERVER_H */
@@ -1,42 +1,75 @@
-#include <stdio.h>
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-#include "cmdline.h"
 #include "error.h"
-#include "parser.h"
-#include "tokenizer.h"
-
-#define PS1 "$ "
-/* #define DEBUG_TOKENS */
-/* #define DEBUG_PARSER */
+#include "jobs.h"
+#include "jobserver.h"
+#include "server.h"
+#include "shell.h"
+#include "spawn.h"
+#include "trace.h"
+#include "vars.h"
 
 int main(int argc, char **argv)
 {
-    char *line = NULL;
-    struct Token *tokens = NULL;
-    size_t line_len = 0, tokens_len = 0;
-    ssize_t line_read, tokens_read;
-
-    printf("%s", PS1);
-    while ((line_read = getline(&line, &line_len, stdin)) != -1) {
-        if ((tokens_read = tokenize(&tokens, &tokens_len, line)) != -1) {
-            struct SyntaxTree *tree = NULL;
-#ifdef DEBUG_TOKENS
-            print_tokens(tokens_read, tokens);
-#endif
-            tree = parse(tokens_read, tokens);
-#ifdef DEBUG_PARSER
-            print_tree(tree);
-#endif
-            if (tree) {
-                exec_cmdline(tree);
-                free_tree(tree);
-            }
-        }
-        printf("%s", PS1);
+    char *backend = getenv("OSH_SPAWN");
+
+    if (backend && spawn_select(backend) == -1)
+        error(0, 0, "OSH_SPAWN: unknown backend: %s", backend);
+    trace_init();
+    vars_init();
+    jobs_init();
+
+    /* With -j, the shell serves a jobserver to the commands it runs */
+    if (argc > 1 && strcmp(argv[1], "-j") == 0) {
+        char *end;
+        long slots;
+
+        if (argc < 3)
+            error(2, 0, "-j: option requires an argument");
+        slots = strtol(argv[2], &end, 10);
+        if (!*argv[2] || *end || slots < 1 || slots > 4096)
+            error(2, 0, "-j: invalid number of jobs: %s", argv[2]);
+        if (jobserver_serve(slots) == -1)
+            error(0, errno, "-j");
+        argc -= 2;
+        argv += 2;
     }
-    printf("\n");
-    free(line);
-    free(tokens);
-    return 0;
+    jobserver_init();
+
+    if (argc > 1 && strcmp(argv[1], "--server") == 0) {
+        long workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (argc < 3)
+            error(2, 0, "--server: option requires an argument");
+        if (argc > 3) {
+            char *end;
+            workers = strtol(argv[3], &end, 10);
+            if (!*argv[3] || *end || workers < 1 || workers > 4096)
+                error(2, 0, "--server: invalid number of workers: %s",
+                      argv[3]);
+        }
+        server_run(argv[2], workers > 0 ? workers : 1);
+        error(1, errno, "--server: %s", argv[2]);
+    } else if (argc > 1 && strcmp(argv[1], "--client") == 0) {
+        int sock, status;
+
+        if (argc < 4)
+            error(2, 0, "usage: --client socket command-line");
+        if ((sock = server_connect(argv[2])) == -1)
+            error(1, errno, "--client: %s", argv[2]);
+        if ((status = server_request(sock, argv[3], strlen(argv[3]),
+                                     NULL)) == -1)
+            error(1, errno, "--client");
+        return status;
+    } else if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3)
+            error(2, 0, "-c: option requires an argument");
+        return run_string(argv[2]);
+    } else if (argc > 1)
+        return run_file(argv[1]);
+    else
+        return run_stdin();
 }
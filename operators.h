@@ -0,0 +1,58 @@
+#ifndef OPERATORS_H
+#define OPERATORS_H
+
+/** The precedence level of special tokens which are not binary operators */
+#define LEVEL_NONE -1
+
+/** The precedence level of parentheses */
+#define LEVEL_GROUP -2
+
+/**
+ * The precedence level of the separators ; & and &!, which associate to the
+ * right so that each applies only to the command just before it
+ */
+#define LEVEL_LIST 0
+
+/** The precedence level of && and ||, which a time prefix applies down to */
+#define LEVEL_AND 1
+
+/** The precedence level of | and |&, which a pipesize prefix applies down to */
+#define LEVEL_PIPE 2
+
+/**
+ * The table of operators, i.e., the special tokens known to the tokenizer. For
+ * each one, X is expanded with its code, its string, the level of precedence
+ * it binds at if it is a binary operator (higher levels bind tighter), and the
+ * type of node it forms in the syntax tree
+ */
+#define OPERATOR_TABLE(X)                                                   \
+    /* code             string  level           node type */                \
+    X(OP_BACKGROUND,    "&",    LEVEL_LIST,     NODE_BACKGROUND)            \
+    X(OP_SEMICOLON,     ";",    LEVEL_LIST,     NODE_SEMICOLON)             \
+    X(OP_DISOWN,        "&!",   LEVEL_LIST,     NODE_DISOWN)                \
+    X(OP_AND,           "&&",   LEVEL_AND,      NODE_AND)                   \
+    X(OP_OR,            "||",   LEVEL_AND,      NODE_OR)                    \
+    X(OP_PIPE,          "|",    LEVEL_PIPE,     NODE_PIPE)                  \
+    X(OP_ERR_PIPE,      "|&",   LEVEL_PIPE,     NODE_ERR_PIPE)              \
+    X(OP_REDIR_IN,      "<",    3,              NODE_REDIR_IN)              \
+    X(OP_REDIR_OUT,     ">",    3,              NODE_REDIR_OUT)             \
+    X(OP_REDIR_APPEND,  ">>",   3,              NODE_REDIR_APPEND)          \
+    X(OP_HEREDOC,       "<<",   3,              NODE_HEREDOC)               \
+    X(OP_HERESTRING,    "<<<",  3,              NODE_HERESTRING)            \
+    X(OP_LPAREN,        "(",    LEVEL_GROUP,    NODE_CMD)                   \
+    X(OP_RPAREN,        ")",    LEVEL_GROUP,    NODE_CMD)                   \
+    X(OP_BANG,          "!",    LEVEL_NONE,     NODE_CMD)                   \
+    X(OP_COMMENT,       "#",    LEVEL_NONE,     NODE_CMD)                   \
+    X(OP_DUP_OUT,       ">&",   LEVEL_NONE,     NODE_CMD)
+
+/** Codes for the types of tokens */
+enum Operator {
+    OP_NONE, /**< Not an operator, i.e., a word */
+#define X(code, string, level, node_type) code,
+    OPERATOR_TABLE(X)
+#undef X
+    OP_UNKNOWN, /**< A special token which is not a known operator */
+    NUM_OPERATORS
+};
+
+#endif /* OPERATORS_H */
@@ -1,304 +1,408 @@
-#include <assert.h>
 #include <error.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "arena.h"
 #include "parser.h"
 
+/** The state of the parser while it walks an array of tokens */
+struct Parser {
+    /** The arena which the tree is allocated from */
+    struct Arena *arena;
+
+    /** The tokens being parsed */
+    struct Token *tokens;
+
+    /**
+     * For each opening parenthesis, the index of the matching closing
+     * parenthesis
+     */
+    size_t *match;
+
+    /** The index of the next token to be parsed */
+    size_t pos;
+};
+
 /**
- * Construct a node of the abstract syntax tree with an array of tokens of
- * the given length
+ * Construct a node of the abstract syntax tree referring to the given array
+ * of tokens
  */
-static inline struct SyntaxTree *syntax_node(size_t num_tokens);
+static inline struct SyntaxTree *syntax_node(struct Arena *arena,
+                                             struct Token *tokens,
+                                             size_t num_tokens);
 
 /**
- * Recursively parse a command line
- * @return Zero on success, non-zero on failure
+ * Find the matching closing parenthesis of every opening parenthesis
+ * @return Zero on success, non-zero on unmatched parentheses
  */
-static int parse_helper(struct SyntaxTree *root);
+static int match_parens(struct Parser *parser, size_t num_tokens);
 
 /**
- * Split the root of a tree by trying to form two subtrees around an operator
- * for each level of precedence
- * @return Zero on success, non-zero on failure
+ * Parse the tokens up to end by precedence climbing, consuming binary
+ * operators as long as they bind at least as tightly as the given level
+ * @return The parsed tree, or NULL if it is empty
  */
-static int split_tree(struct SyntaxTree *root);
+static struct SyntaxTree *parse_expr(struct Parser *parser, size_t end,
+                                     int min_level);
 
 /**
- * Split a single node at a given index, creating a left and right subtree for
- * that node
+ * Parse the operand starting at the next token, i.e., the tokens up to the
+ * next binary operator which is not inside of parentheses. An operand
+ * entirely enclosed in a pair of parentheses is parsed as a new expression
+ * @return The parsed tree, or NULL if the operand is empty
  */
-static void split_node(struct SyntaxTree *root, size_t i);
+static struct SyntaxTree *parse_operand(struct Parser *parser, size_t end);
 
 /**
- * Strip extra pairs of parentheses in an array of tokens of the node
- * @return Zero on success, non-zero on unmatched parentheses
+ * Parse a time prefix and the tokens it applies to if the next token is the
+ * word time. The prefix applies to the rest of the operand being parsed at the
+ * given level, but at most to a list joined by && and ||, which is what it
+ * applies to at the start of a command line. Repeated prefixes (each of which
+ * may be followed by -j for JSON output) are folded into one node
+ * @return The time node, or NULL if the next token isn't time
  */
-static int strip_parens(struct SyntaxTree *root);
-
-/** Get the type of node corresponding to the given special token */
-static inline enum NodeType get_node_type(char *token);
-
-/** Return whether a given token is a valid special token */
-static bool valid_operator(char *token);
+static struct SyntaxTree *parse_time(struct Parser *parser, size_t end,
+                                     int min_level);
 
 /**
- * Return whether a syntax tree is full, i.e., all nodes that require both a
- * left and right subtree have one
+ * Parse a pipesize prefix and the pipeline it applies to if the next token is
+ * the word pipesize. The prefix is followed by a comma-separated list of
+ * capacities, the first for the first pipe of the pipeline and so on, where
+ * the last one applies to the rest of the pipes. The list is left out of the
+ * node if it's missing or invalid, which makes the node a parse error
+ * @return The pipesize node, or NULL if the next token isn't pipesize
  */
-static bool is_full(struct SyntaxTree *root);
+static struct SyntaxTree *parse_pipesize(struct Parser *parser, size_t end,
+                                         int min_level);
+
+/** Return whether a token is a comma-separated list of pipe capacities */
+static bool valid_pipe_sizes(struct Token *token);
+
+/** Return whether a token is a given word */
+static inline bool is_word(struct Token *token, const char *word);
 
 /**
- * Prune a syntax tree by freeing and removing any empty nodes
+ * Return the precedence level of a token if it is a binary operator, or a
+ * negative level (LEVEL_NONE or LEVEL_GROUP) if it is not
  */
-static struct SyntaxTree *prune_tree(struct SyntaxTree *root);
+static inline int operator_level(struct Token *token);
+
+/** Return whether a given token is a valid special token */
+static inline bool valid_operator(struct Token *token);
 
 /**
- * An array of null-terminated arrays containing each precedence level of
- * binary operators
+ * Return whether a syntax tree is full, i.e., all nodes that require both a
+ * left and right subtree have one
+ * @param num_nodes An upper bound on the number of nodes in the tree
  */
-static const char *binary_tokens[][4] = {
-    {"&", ";", "&!"}, /* Bind loosest (lowest precedence) */
-    {"&&", "||"},
-    {"|", "|&"},
-    {"<", ">", ">>"} /* Bind tightest (highest precedence) */
+static bool is_full(struct Arena *arena, struct SyntaxTree *root,
+                    size_t num_nodes);
+
+/** The precedence levels of the operators, indexed by operator code */
+static const int operator_levels[NUM_OPERATORS] = {
+    [OP_NONE] = LEVEL_NONE,
+#define X(code, string, level, node_type) [code] = level,
+    OPERATOR_TABLE(X)
+#undef X
+    [OP_UNKNOWN] = LEVEL_NONE,
 };
 
-/** The number of levels of precedence */
-#define NUM_LEVELS (sizeof(binary_tokens) / sizeof(*binary_tokens))
+/** The types of node formed by the operators, indexed by operator code */
+static const enum NodeType node_types[NUM_OPERATORS] = {
+#define X(code, string, level, node_type) [code] = node_type,
+    OPERATOR_TABLE(X)
+#undef X
+};
 
 /* See parser.h */
-struct SyntaxTree *parse(size_t num_tokens, struct Token *tokens)
+struct SyntaxTree *parse(struct Arena *arena, size_t num_tokens,
+                         struct Token *tokens)
 {
+    struct Parser parser = {arena, tokens, NULL, 0};
+    struct SyntaxTree *root;
+
     for (int i = 0; i < num_tokens; ++i) {
-        if (tokens[i].special && !valid_operator(tokens[i].token)) {
-            error(0, 0, "parse error near `%s'", tokens[i].token);
+        if (tokens[i].op != OP_NONE && !valid_operator(&tokens[i])) {
+            error(0, 0, "parse error near `%.*s'", (int)tokens[i].len,
+                  tokens[i].token);
             return NULL;
         }
     }
 
-    struct SyntaxTree *root = syntax_node(num_tokens);
-    memcpy(root->tokens, tokens, num_tokens * sizeof(struct Token));
-
-    if (parse_helper(root) == -1 || !is_full(root)) {
-        free_tree(root);
+    if (match_parens(&parser, num_tokens) == -1) {
+        error(0, 0, "parsing error: unmatched parentheses");
         return NULL;
     }
-    return prune_tree(root);
-}
 
-/* See above */
-static int parse_helper(struct SyntaxTree *root)
-{
-    if (!root->left && !root->right) {
-        if (split_tree(root) == -1)
-            return -1;
-    } else {
-        if (parse_helper(root->left) == -1 ||
-            parse_helper(root->right) == -1)
-            return -1;
-    }
-    return 0;
+    root = parse_expr(&parser, num_tokens, 0);
+    if (root && !is_full(&cmdline_arena, root, num_tokens))
+        return NULL;
+    return root;
 }
 
-
 /* See above */
-static inline struct SyntaxTree *syntax_node(size_t num_tokens)
+static inline struct SyntaxTree *syntax_node(struct Arena *arena,
+                                             struct Token *tokens,
+                                             size_t num_tokens)
 {
-    struct SyntaxTree *root = malloc(sizeof(struct SyntaxTree));
-    if (!root)
-        error(1, errno, "fatal error");
-    root->tokens = malloc(sizeof(struct Token) * num_tokens);
-    if (!root->tokens)
-        error(1, errno, "fatal error");
+    struct SyntaxTree *root = arena_alloc(arena, sizeof(struct SyntaxTree));
     root->type = NODE_CMD;
+    root->tokens = tokens;
     root->num_tokens = num_tokens;
     root->left = root->right = NULL;
     return root;
 }
 
 /* See above */
-static int split_tree(struct SyntaxTree *root)
+static int match_parens(struct Parser *parser, size_t num_tokens)
 {
-    ssize_t parens = 0;
-
-    if (strip_parens(root) == -1) {
-        error(0, 0, "parsing error: unmatched parentheses");
-        return -1;
-    }
-
-    for (size_t level = 0; level < NUM_LEVELS; ++level) {
-        for (ssize_t i = root->num_tokens - 1; i >= 0; --i) {
-            const char **operators = binary_tokens[level];
-            for (size_t j = 0; operators[j]; ++j) {
-                if (root->tokens[i].special) {
-                    char *token = root->tokens[i].token;
-                    if (strcmp(token, ")") == 0)
-                        ++parens;
-                    else if (strcmp(token, "(") == 0)
-                        --parens;
-                    else if (!parens && strcmp(token, operators[j]) == 0) {
-                        split_node(root, i);
-                        return 0;
-                    }
-                }
-            }
+    size_t *open, depth = 0;
+
+    parser->match = arena_alloc(&cmdline_arena, sizeof(size_t) * num_tokens);
+    open = arena_alloc(&cmdline_arena, sizeof(size_t) * num_tokens);
+
+    for (size_t i = 0; i < num_tokens; ++i) {
+        if (parser->tokens[i].op == OP_LPAREN)
+            open[depth++] = i;
+        else if (parser->tokens[i].op == OP_RPAREN) {
+            if (depth == 0)
+                return -1;
+            parser->match[open[--depth]] = i;
         }
     }
-
-    return 0;
+    return depth == 0 ? 0 : -1;
 }
 
 /* See above */
-static void split_node(struct SyntaxTree *root, size_t i)
+static struct SyntaxTree *parse_expr(struct Parser *parser, size_t end,
+                                     int min_level)
 {
-    root->left = syntax_node(i);
-    memcpy(root->left->tokens, root->tokens,
-            root->left->num_tokens * sizeof(struct Token));
-    split_tree(root->left);
-
-    root->right = syntax_node(root->num_tokens - (i + 1));
-    memcpy(root->right->tokens, root->tokens + (i + 1),
-            root->right->num_tokens * sizeof(struct Token));
-    split_tree(root->right);
-
-    root->tokens[0] = root->tokens[i];
-    root->num_tokens = 1;
-    root->type = get_node_type(root->tokens[0].token);
+    struct SyntaxTree *left = parse_time(parser, end, min_level), **tail;
+
+    if (!left)
+        left = parse_pipesize(parser, end, min_level);
+    if (!left)
+        left = parse_operand(parser, end);
+
+    /*
+     * Operators of the same level associate to the left, so the loop keeps
+     * folding the tree built so far into the left subtree of the next one.
+     * Separators associate to the right instead, folding only the command
+     * since the last separator, so that `a & b &' is two jobs rather than a
+     * job running another
+     */
+    tail = &left;
+    while (parser->pos < end) {
+        struct Token *token = &parser->tokens[parser->pos];
+        int level = operator_level(token);
+        struct SyntaxTree *root;
+
+        if (level < min_level)
+            break;
+        ++parser->pos;
+
+        root = syntax_node(parser->arena, token, 1);
+        root->type = node_types[token->op];
+        root->left = *tail;
+        root->right = parse_expr(parser, end, level + 1);
+        *tail = root;
+        if (level == LEVEL_LIST)
+            tail = &root->right;
+    }
+    return left;
 }
 
 /* See above */
-static int strip_parens(struct SyntaxTree *root)
+static struct SyntaxTree *parse_operand(struct Parser *parser, size_t end)
 {
-    if (root->num_tokens == 0)
-        return 0;
-
-    ssize_t parens = 0;
-    bool strip = root->tokens[0].special &&
-                 strcmp(root->tokens[0].token, "(") == 0 &&
-                 root->tokens[root->num_tokens - 1].special &&
-                 strcmp(root->tokens[root->num_tokens - 1].token, ")") == 0;
-
-    for (size_t i = 0; i < root->num_tokens; ++i) {
-        if (root->tokens[i].special) {
-            char *token = root->tokens[i].token;
-            if (strcmp(token, "(") == 0)
-                ++parens;
-            else if (strcmp(token, ")") == 0) {
-                --parens;
-                if (parens == 0 && i != root->num_tokens - 1)
-                    strip = false;
-                else if (parens < 0)
-                    return -1;
-            }
-        }
+    size_t start = parser->pos, pos = start;
+    struct Token *tokens = parser->tokens;
+
+    while (pos < end && operator_level(&tokens[pos]) < 0) {
+        if (tokens[pos].op == OP_LPAREN)
+            pos = parser->match[pos] + 1;
+        else
+            ++pos;
     }
-    if (strip) {
-        root->num_tokens -= 2;
-        memmove(root->tokens, root->tokens + 1,
-                root->num_tokens * sizeof(struct Token));
-        return strip_parens(root);
+    parser->pos = pos;
+
+    if (pos == start)
+        return NULL;
+    else if (tokens[start].op == OP_LPAREN &&
+             parser->match[start] == pos - 1) {
+        struct SyntaxTree *root;
+        parser->pos = start + 1;
+        root = parse_expr(parser, pos - 1, 0);
+        parser->pos = pos;
+        return root;
     } else
-        return parens == 0 ? 0 : -1;
+        return syntax_node(parser->arena, &tokens[start], pos - start);
 }
 
 /* See above */
-static inline enum NodeType get_node_type(char *token) {
-    if (strcmp(token, "<") == 0)
-        return NODE_REDIR_IN;
-    else if (strcmp(token, ">") == 0)
-        return NODE_REDIR_OUT;
-    else if (strcmp(token, ">>") == 0)
-        return NODE_REDIR_APPEND;
-    else if (strcmp(token, "|") == 0)
-        return NODE_PIPE;
-    else if (strcmp(token, "|&") == 0)
-        return NODE_ERR_PIPE;
-    else if (strcmp(token, "&&") == 0)
-        return NODE_AND;
-    else if (strcmp(token, "||") == 0)
-        return NODE_OR;
-    else if (strcmp(token, ";") == 0)
-        return NODE_SEMICOLON;
-    else if (strcmp(token, "&") == 0)
-        return NODE_BACKGROUND;
-    else if (strcmp(token, "&!") == 0)
-        return NODE_DISOWN;
-    else
-        assert(0);
+static struct SyntaxTree *parse_time(struct Parser *parser, size_t end,
+                                     int min_level)
+{
+    struct Token *tokens = parser->tokens;
+    size_t start = parser->pos;
+    struct SyntaxTree *root;
+
+    while (parser->pos < end && is_word(&tokens[parser->pos], "time")) {
+        ++parser->pos;
+        if (parser->pos < end && is_word(&tokens[parser->pos], "-j"))
+            ++parser->pos;
+    }
+    if (parser->pos == start)
+        return NULL;
+
+    root = syntax_node(parser->arena, &tokens[start], parser->pos - start);
+    root->type = NODE_TIME;
+    root->left = parse_expr(parser, end,
+                            min_level > LEVEL_AND ? min_level : LEVEL_AND);
+    return root;
 }
 
 /* See above */
-static bool valid_operator(char *token)
+static struct SyntaxTree *parse_pipesize(struct Parser *parser, size_t end,
+                                         int min_level)
 {
-    for (size_t i = 0; i < NUM_LEVELS; ++i) {
-        const char **operators = binary_tokens[i];
-        for (size_t j = 0; operators[j]; ++j) {
-            if (strcmp(token, operators[j]) == 0)
-                return true;
-        }
-        if (strcmp(token, "(") == 0 || strcmp(token, ")") == 0)
-            return true;
-    }
-    return false;
+    struct Token *tokens = parser->tokens;
+    size_t start = parser->pos;
+    struct SyntaxTree *root;
+
+    if (start >= end || !is_word(&tokens[start], "pipesize"))
+        return NULL;
+    ++parser->pos;
+    if (parser->pos < end && valid_pipe_sizes(&tokens[parser->pos]))
+        ++parser->pos;
+
+    root = syntax_node(parser->arena, &tokens[start], parser->pos - start);
+    root->type = NODE_PIPESIZE;
+    root->left = parse_expr(parser, end,
+                            min_level > LEVEL_PIPE ? min_level : LEVEL_PIPE);
+    return root;
 }
 
 /* See above */
-static bool is_full(struct SyntaxTree *root)
+static bool valid_pipe_sizes(struct Token *token)
 {
-    switch (root->type) {
-        case NODE_CMD:
-            return 1;
-        case NODE_REDIR_IN:
-        case NODE_REDIR_OUT:
-        case NODE_REDIR_APPEND:
-        case NODE_PIPE:
-        case NODE_ERR_PIPE:
-        case NODE_AND:
-        case NODE_OR:
-            if (root->left->num_tokens == 0 || root->right->num_tokens == 0) {
-                error(0, 0, "parse error near `%s'", root->tokens[0].token);
-                return false;
-            }
-            break;
-        case NODE_SEMICOLON:
-            break;
-        case NODE_BACKGROUND:
-        case NODE_DISOWN:
-            if (root->left->num_tokens == 0) {
-                error(0, 0, "parse error near `%s'", root->tokens[0].token);
-                return false;
-            }
-            break;
+    const char *p = token->token, *end = p + token->len;
+    size_t capacity;
+
+    if (token->op != OP_NONE)
+        return false;
+    for (;;) {
+        const char *comma = memchr(p, ',', end - p);
+        if (!parse_pipe_size(p, (comma ? comma : end) - p, &capacity))
+            return false;
+        if (!comma)
+            return true;
+        p = comma + 1;
     }
-    return is_full(root->left) && is_full(root->right);
 }
 
-/** See above */
-static struct SyntaxTree *prune_tree(struct SyntaxTree *root)
+/* See parser.h */
+bool parse_pipe_size(const char *str, size_t len, size_t *capacity)
 {
-    if (root) {
-        if (root->num_tokens == 0) {
-            free_tree(root);
-            root = NULL;
-        } else {
-            root->left = prune_tree(root->left);
-            root->right = prune_tree(root->right);
-        }
+    size_t value = 0, unit = 1;
+
+    if (len == 4 && memcmp(str, "auto", 4) == 0) {
+        *capacity = PIPE_ADAPTIVE;
+        return true;
     }
-    return root;
+    if (len > 1 && (str[len - 1] == 'k' || str[len - 1] == 'K'))
+        unit = 1024;
+    else if (len > 1 && (str[len - 1] == 'm' || str[len - 1] == 'M'))
+        unit = 1024 * 1024;
+    if (unit > 1)
+        --len;
+    if (len == 0)
+        return false;
+
+    for (size_t i = 0; i < len; ++i) {
+        if (str[i] < '0' || str[i] > '9' || value > (INT32_MAX - 9) / 10)
+            return false;
+        value = 10 * value + (str[i] - '0');
+    }
+    if (value > INT32_MAX / unit)
+        return false;
+    *capacity = value * unit;
+    return true;
 }
 
-/** See parser.h */
-void free_tree(struct SyntaxTree *root)
+/* See above */
+static inline bool is_word(struct Token *token, const char *word)
 {
-    if (root) {
-        free(root->tokens);
-        free_tree(root->left);
-        free_tree(root->right);
-        free(root);
+    return token->op == OP_NONE && strlen(word) == token->len &&
+        memcmp(token->token, word, token->len) == 0;
+}
+
+/* See above */
+static inline int operator_level(struct Token *token)
+{
+    return operator_levels[token->op];
+}
+
+/* See above */
+static inline bool valid_operator(struct Token *token)
+{
+    return operator_levels[token->op] != LEVEL_NONE;
+}
+
+/* See above */
+static bool is_full(struct Arena *arena, struct SyntaxTree *root,
+                    size_t num_nodes)
+{
+    /*
+     * The tree is checked in pre-order so that the first error reported is
+     * the outermost one. An explicit stack of the right subtrees still to be
+     * checked is used because long lists make the tree arbitrarily deep
+     */
+    struct SyntaxTree **stack = arena_alloc(arena, sizeof(*stack) * num_nodes);
+    size_t depth = 0;
+    bool full = true;
+
+    while (root) {
+        switch (root->type) {
+            case NODE_CMD:
+            case NODE_SEMICOLON:
+                break;
+            case NODE_REDIR_IN:
+            case NODE_REDIR_OUT:
+            case NODE_REDIR_APPEND:
+            case NODE_HEREDOC:
+            case NODE_HERESTRING:
+            case NODE_PIPE:
+            case NODE_ERR_PIPE:
+            case NODE_AND:
+            case NODE_OR:
+                full = root->left && root->right;
+                break;
+            case NODE_BACKGROUND:
+            case NODE_DISOWN:
+            case NODE_TIME:
+                full = root->left;
+                break;
+            case NODE_PIPESIZE:
+                full = root->left && root->num_tokens == 2;
+                break;
+        }
+        if (!full) {
+            error(0, 0, "parse error near `%.*s'", (int)root->tokens[0].len,
+                  root->tokens[0].token);
+            return false;
+        }
+
+        if (root->right)
+            stack[depth++] = root->right;
+        if (root->left)
+            root = root->left;
+        else
+            root = depth ? stack[--depth] : NULL;
     }
+    return true;
 }
 
 /** See parser.h */
@@ -1,21 +1,35 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
 #include "tokenizer.h"
 
+/** The capacity of a pipe which grows whenever it is seen full */
+#define PIPE_ADAPTIVE SIZE_MAX
+
 /** Constants for the types of (special) nodes */
 enum NodeType {
     NODE_CMD, /**< A normal node which is to be executed literally */
     NODE_REDIR_IN, /**< An input redirection node */
     NODE_REDIR_OUT, /**< An output redirection node */
     NODE_REDIR_APPEND, /**< An appending output redirection node */
+    NODE_HEREDOC, /**< A heredoc node, whose right subtree is the text */
+    NODE_HERESTRING, /**< A here-string node, whose right subtree is the word
+                          given as a line of input */
     NODE_PIPE, /**< A pipe node */
     NODE_ERR_PIPE, /**< A standard-error pipe node */
     NODE_AND, /**< A logical-AND node */
     NODE_OR, /**< A logical-OR node */
     NODE_SEMICOLON, /**< A sequential list separator node */
     NODE_BACKGROUND, /**< A backgrounding (non-blocking) list separator node */
-    NODE_DISOWN /** A backgrounding and disowning list separator node */
+    NODE_DISOWN, /** A backgrounding and disowning list separator node */
+    NODE_TIME, /**< A time prefix node, whose left subtree is timed */
+    NODE_PIPESIZE /**< A pipesize prefix node, whose second token gives the
+                       capacities of the pipes of its left subtree */
 };
 
 /** An abstract syntax tree resulting from parsing a command line */
@@ -36,11 +50,25 @@ struct SyntaxTree {
     struct SyntaxTree *left, *right;
 };
 
-/** Parse an array of tokens into an abstract syntax tree */
-struct SyntaxTree *parse(size_t token_count, struct Token *tokens);
+/**
+ * Parse an array of tokens into an abstract syntax tree in time linear in the
+ * number of tokens. The nodes of the tree are allocated from the given arena
+ * and refer to the given tokens rather than copying them, so the array must
+ * outlive the tree. Scratch space is allocated from cmdline_arena
+ * @return The tree, or NULL if there was a parse error or no command
+ */
+struct SyntaxTree *parse(struct Arena *arena, size_t token_count,
+                         struct Token *tokens);
 
-/** Free an abstract syntax tree */
-void free_tree(struct SyntaxTree *root);
+/**
+ * Parse a capacity of pipes given to pipesize or set -p: a number of bytes,
+ * optionally followed by k or m for KiB or MiB, zero for the default of the
+ * kernel, or auto for pipes which grow whenever they are seen full
+ * @param len The length of the string
+ * @param capacity Set to the capacity, or PIPE_ADAPTIVE for auto
+ * @return Whether the string is a valid capacity
+ */
+bool parse_pipe_size(const char *str, size_t len, size_t *capacity);
 
 /** Print an abstract syntax tree by a pre-order traversal */
 void print_tree(struct SyntaxTree *root);
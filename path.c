@@ -0,0 +1,237 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "error.h"
+#include "hash.h"
+#include "path.h"
+#include "vars.h"
+
+/** The search path used when PATH is unset (as by execvp) */
+#define DEFAULT_PATH "/bin:/usr/bin"
+
+/** The initial number of buckets in the hash table */
+#define INITIAL_BUCKETS 64
+
+/** A command in the hash table */
+struct PathEntry {
+    /** The next entry in the same bucket of the hash table */
+    struct PathEntry *chain;
+
+    /** The hash of the name */
+    uint64_t hash;
+
+    /** The name of the command */
+    char *name;
+
+    /** The path of the command */
+    char *path;
+
+    /** The number of times the command was looked up after it was found */
+    size_t hits;
+};
+
+/** The hash table of commands */
+static struct PathEntry **buckets = NULL;
+
+/** The number of buckets in the hash table (always a power of two) */
+static size_t num_buckets = 0;
+
+/** The number of commands in the hash table */
+static size_t num_entries = 0;
+
+/** A copy of the value of PATH that the table was filled with */
+static char *table_path = NULL;
+
+/** Return the value of PATH which commands are searched for in */
+static inline const char *search_path(void);
+
+/** Clear the table if PATH has changed since it was filled */
+static void check_path(void);
+
+/** Find the entry of a command in the table */
+static struct PathEntry *find_entry(const char *name, uint64_t hash);
+
+/** Double the number of buckets in the hash table */
+static void grow_table(void);
+
+/** Return whether a file is a regular file which we can execute */
+static bool is_executable(const char *path);
+
+/* See path.h */
+const char *path_lookup(const char *name)
+{
+    struct PathEntry *entry;
+    uint64_t hash;
+    char *path;
+    size_t name_len;
+
+    if (strchr(name, '/'))
+        return name;
+
+    check_path();
+    name_len = strlen(name);
+    hash = hash_string(name, name_len);
+    if ((entry = find_entry(name, hash))) {
+        ++entry->hits;
+        return entry->path;
+    }
+
+    /* Commands which aren't found aren't remembered, so they can be added */
+    if (!(path = path_search(name)))
+        return NULL;
+
+    if (num_entries >= num_buckets)
+        grow_table();
+    if (!(entry = malloc(sizeof(*entry) + name_len + 1)))
+        error(1, errno, "fatal error");
+    entry->hash = hash;
+    entry->name = memcpy(entry + 1, name, name_len + 1);
+    entry->path = path;
+    entry->hits = 0;
+    entry->chain = buckets[hash & (num_buckets - 1)];
+    buckets[hash & (num_buckets - 1)] = entry;
+    ++num_entries;
+    return entry->path;
+}
+
+/* See path.h */
+const char *path_hashed(const char *name)
+{
+    struct PathEntry *entry;
+
+    check_path();
+    entry = find_entry(name, hash_string(name, strlen(name)));
+    return entry ? entry->path : NULL;
+}
+
+/* See path.h */
+char *path_search(const char *name)
+{
+    const char *dir = search_path();
+    size_t name_len = strlen(name);
+    char *path;
+
+    if (!*name)
+        return NULL;
+
+    /* There is room for the longest directory, the slash, and the name */
+    if (!(path = malloc(strlen(dir) + name_len + 3)))
+        error(1, errno, "fatal error");
+    while (true) {
+        size_t dir_len = strcspn(dir, ":");
+
+        /* An empty directory means the current directory */
+        if (dir_len == 0)
+            memcpy(path, ".", dir_len = 1);
+        else
+            memcpy(path, dir, dir_len);
+        path[dir_len] = '/';
+        memcpy(path + dir_len + 1, name, name_len + 1);
+        if (is_executable(path))
+            return path;
+
+        dir += strcspn(dir, ":");
+        if (!*dir++)
+            break;
+    }
+    free(path);
+    return NULL;
+}
+
+/* See path.h */
+void path_clear(void)
+{
+    for (size_t i = 0; i < num_buckets; ++i) {
+        struct PathEntry *entry = buckets[i];
+        while (entry) {
+            struct PathEntry *chain = entry->chain;
+            free(entry->path);
+            free(entry);
+            entry = chain;
+        }
+        buckets[i] = NULL;
+    }
+    num_entries = 0;
+}
+
+/* See path.h */
+size_t path_foreach(void (*func)(const char *name, const char *path,
+                                 size_t hits))
+{
+    check_path();
+    for (size_t i = 0; func && i < num_buckets; ++i) {
+        for (struct PathEntry *entry = buckets[i]; entry;
+                entry = entry->chain)
+            func(entry->name, entry->path, entry->hits);
+    }
+    return num_entries;
+}
+
+/* See above */
+static inline const char *search_path(void)
+{
+    const char *path = var_get("PATH");
+    return path ? path : DEFAULT_PATH;
+}
+
+/* See above */
+static void check_path(void)
+{
+    const char *path = search_path();
+
+    if (table_path && strcmp(table_path, path) == 0)
+        return;
+    path_clear();
+    free(table_path);
+    if (!(table_path = strdup(path)))
+        error(1, errno, "fatal error");
+}
+
+/* See above */
+static struct PathEntry *find_entry(const char *name, uint64_t hash)
+{
+    if (!num_buckets)
+        return NULL;
+    for (struct PathEntry *entry = buckets[hash & (num_buckets - 1)]; entry;
+            entry = entry->chain) {
+        if (entry->hash == hash && strcmp(entry->name, name) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+/* See above */
+static void grow_table(void)
+{
+    struct PathEntry **old_buckets = buckets;
+    size_t old_num_buckets = num_buckets;
+
+    num_buckets = num_buckets ? 2 * num_buckets : INITIAL_BUCKETS;
+    if (!(buckets = calloc(num_buckets, sizeof(*buckets))))
+        error(1, errno, "fatal error");
+
+    for (size_t i = 0; i < old_num_buckets; ++i) {
+        struct PathEntry *entry = old_buckets[i];
+        while (entry) {
+            struct PathEntry *chain = entry->chain;
+            size_t index = entry->hash & (num_buckets - 1);
+            entry->chain = buckets[index];
+            buckets[index] = entry;
+            entry = chain;
+        }
+    }
+    free(old_buckets);
+}
+
+/* See above */
+static bool is_executable(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) &&
+        access(path, X_OK) == 0;
+}
@@ -0,0 +1,40 @@
+#ifndef PATH_H
+#define PATH_H
+
+#include <stddef.h>
+
+/**
+ * Look up the location of a command in the hash table of commands, searching
+ * PATH and remembering the result if it isn't there yet. The table is cleared
+ * whenever PATH changes. A name containing a slash is returned as is
+ * @return The path of the command, which is valid until the table is next
+ * cleared, or NULL if the command wasn't found
+ */
+const char *path_lookup(const char *name);
+
+/**
+ * Look up the location of a command only in the hash table of commands
+ * @return The path of the command, or NULL if it isn't in the table
+ */
+const char *path_hashed(const char *name);
+
+/**
+ * Search PATH for a command without using the hash table of commands
+ * @return The path of the command, which must be freed, or NULL if it wasn't
+ * found
+ */
+char *path_search(const char *name);
+
+/** Remove all of the commands from the hash table */
+void path_clear(void);
+
+/**
+ * Call a function for every command in the hash table with its name, its
+ * path, and the number of times it was looked up after it was first found.
+ * The function may be NULL to only count the commands
+ * @return The number of commands in the table
+ */
+size_t path_foreach(void (*func)(const char *name, const char *path,
+                                 size_t hits));
+
+#endif /* PATH_H */
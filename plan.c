@@ -0,0 +1,612 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "plan.h"
+
+/** The initial number of instructions and frames of a compiler */
+#define INITIAL_CAPACITY 16
+
+/** A node of the syntax tree which is being compiled */
+struct Frame {
+    /** The node */
+    struct SyntaxTree *node;
+
+    /**
+     * Whether the node makes up the whole of a block run by a child, so that
+     * it can change the file descriptors of the child directly
+     */
+    bool in_block;
+
+    /** Whether the subtree to be compiled next is the whole of a block */
+    bool next_in_block;
+
+    /** The number of subtrees of the node which are compiled as code */
+    size_t num_subtrees;
+
+    /** The number of subtrees which have been entered so far */
+    size_t state;
+
+    /**
+     * The index of an instruction whose length can only be filled in once the
+     * following subtree has been compiled
+     */
+    size_t fixup;
+
+    /**
+     * For a pipeline, its pipe nodes in order, where the stages are the left
+     * subtree of the first one and the right subtrees of all of them
+     */
+    struct SyntaxTree **pipes;
+};
+
+/** The state of the compilation of a syntax tree */
+struct Compiler {
+    /** The instructions emitted so far, allocated from cmdline_arena */
+    struct Insn *insns;
+
+    /** The number of instructions emitted and the capacity of the array */
+    size_t len, capacity;
+
+    /** The total number of arguments including null terminators */
+    size_t num_args;
+
+    /**
+     * The total number of arguments of the commands and paths with flags for
+     * expansion
+     */
+    size_t num_expand;
+
+    /**
+     * The capacities given by a pipesize prefix to the next pipeline, or NULL
+     * if there are none
+     */
+    struct Token *pipe_sizes;
+
+    /** The stack of nodes being compiled, allocated from cmdline_arena */
+    struct Frame *stack;
+
+    /** The number of nodes on the stack and the capacity of the stack */
+    size_t depth, stack_capacity;
+};
+
+/**
+ * Emit an instruction with the given operation, leaving its operands zeroed
+ * @return The instruction, which is valid until the next one is emitted
+ */
+static struct Insn *emit(struct Compiler *compiler, enum Opcode op);
+
+/**
+ * Push a node onto the stack of nodes to compile, unless it is NULL
+ * @param in_block Whether the node is the whole of a block run by a child
+ */
+static void push_node(struct Compiler *compiler, struct SyntaxTree *node,
+                      bool in_block);
+
+/**
+ * Emit the instructions for a node which come before its first subtree and
+ * set the number of subtrees to compile
+ * @return The first subtree, to be compiled next
+ */
+static struct SyntaxTree *enter_node(struct Compiler *compiler,
+                                     struct Frame *frame);
+
+/**
+ * Emit the instructions for a node which come between two of its subtrees
+ * @param index The index of the subtree which is next
+ * @return The subtree, to be compiled next
+ */
+static struct SyntaxTree *between_subtrees(struct Compiler *compiler,
+                                           struct Frame *frame, size_t index);
+
+/** Emit the instructions for a node which come after its last subtree */
+static void leave_node(struct Compiler *compiler, struct Frame *frame);
+
+/** Return the ArgExpansion flags of a word */
+static inline unsigned char expansion_flags(const struct Token *token);
+
+/** Return whether a node is a redirection */
+static inline bool is_redirection(struct SyntaxTree *node);
+
+/**
+ * Emit a redirection for every node of a chain of nested redirections, from
+ * the outermost one in
+ * @return The command which is redirected
+ */
+static struct SyntaxTree *emit_redirections(struct Compiler *compiler,
+                                            struct SyntaxTree *node);
+
+/**
+ * Collect the pipe nodes of a pipeline, which lean to the left because pipes
+ * associate to the left, into an array in the frame of the pipeline, whose
+ * subtrees are then its stages
+ */
+static void collect_pipes(struct Frame *frame);
+
+/**
+ * Emit the start of the block of a stage of a pipeline, which connects the
+ * stage to its neighbours
+ * @param index The index of the stage
+ * @return The stage
+ */
+static struct SyntaxTree *begin_stage(struct Compiler *compiler,
+                                      struct Frame *frame, size_t index);
+
+/**
+ * Emit an instruction setting the capacity of each pipe of a pipeline from the
+ * capacities given by a pipesize prefix, which are then used up
+ */
+static void emit_pipe_sizes(struct Compiler *compiler, size_t num_pipes);
+
+/** Set the length of a block instruction to reach the current instruction */
+static inline void end_block(struct Compiler *compiler, size_t start);
+
+/**
+ * Copy the instructions and their arguments into one contiguous plan in the
+ * given arena
+ */
+static struct Plan *finish_plan(struct Compiler *compiler,
+                                struct Arena *arena);
+
+/** Double the capacity of an array allocated from cmdline_arena */
+static void *grow_array(void *array, size_t *capacity, size_t elem_size);
+
+/** The names of the operations, indexed by opcode */
+static const char *opcode_names[] = {
+    [INSN_EXEC] = "exec",
+    [INSN_SUBSHELL] = "subshell",
+    [INSN_BACKGROUND] = "background",
+    [INSN_WAIT] = "wait",
+    [INSN_REDIR] = "redir",
+    [INSN_HEREDOC] = "heredoc",
+    [INSN_PIPE] = "pipe",
+    [INSN_PIPE_SIZE] = "pipe_size",
+    [INSN_PIPE_END] = "pipe_end",
+    [INSN_CLOSE_PIPE] = "close_pipe",
+    [INSN_JZ] = "jz",
+    [INSN_JNZ] = "jnz",
+    [INSN_TRUE] = "true",
+    [INSN_TIME_START] = "time_start",
+    [INSN_TIME_END] = "time_end",
+};
+
+/* See plan.h */
+struct Plan *compile(struct Arena *arena, struct SyntaxTree *root)
+{
+    struct Compiler compiler = {NULL, 0, 0, 0, 0, NULL, NULL, 0, 0};
+
+    push_node(&compiler, root, false);
+    while (compiler.depth) {
+        struct Frame *frame = &compiler.stack[compiler.depth - 1];
+        struct SyntaxTree *next = NULL;
+        bool in_block;
+
+        /* The frame may move when the next node is pushed, so it's done with */
+        frame->next_in_block = false;
+        if (frame->state == 0)
+            next = enter_node(&compiler, frame);
+        else if (frame->state < frame->num_subtrees)
+            next = between_subtrees(&compiler, frame, frame->state);
+        else {
+            leave_node(&compiler, frame);
+            --compiler.depth;
+            continue;
+        }
+        ++frame->state;
+        in_block = frame->next_in_block;
+        push_node(&compiler, next, in_block);
+    }
+    return finish_plan(&compiler, arena);
+}
+
+/* See above */
+static struct Insn *emit(struct Compiler *compiler, enum Opcode op)
+{
+    struct Insn *insn;
+
+    if (compiler->len >= compiler->capacity) {
+        compiler->insns = grow_array(compiler->insns, &compiler->capacity,
+                                     sizeof(struct Insn));
+    }
+    insn = &compiler->insns[compiler->len];
+    memset(insn, 0, sizeof(*insn));
+    insn->op = op;
+    ++compiler->len;
+    return insn;
+}
+
+/* See above */
+static void push_node(struct Compiler *compiler, struct SyntaxTree *node,
+                      bool in_block)
+{
+    if (!node)
+        return;
+    if (compiler->depth >= compiler->stack_capacity) {
+        compiler->stack = grow_array(compiler->stack,
+                                     &compiler->stack_capacity,
+                                     sizeof(struct Frame));
+    }
+    compiler->stack[compiler->depth++] = (struct Frame){
+        node, in_block, false, 0, 0, 0, NULL
+    };
+}
+
+/* See above */
+static struct SyntaxTree *enter_node(struct Compiler *compiler,
+                                     struct Frame *frame)
+{
+    struct SyntaxTree *node = frame->node;
+    struct Insn *insn;
+
+    frame->num_subtrees = 2;
+    switch (node->type) {
+        case NODE_CMD:
+            insn = emit(compiler, INSN_EXEC);
+            insn->len = node->num_tokens;
+            insn->argv = arena_alloc(&cmdline_arena,
+                                     sizeof(char *) * (node->num_tokens + 1));
+            for (size_t i = 0; i < node->num_tokens; ++i) {
+                struct Token *token = &node->tokens[i];
+                unsigned char flags = expansion_flags(token);
+                insn->argv[i] = token->raw ? token->raw : token->token;
+                if (flags && !insn->expand) {
+                    insn->expand = arena_alloc(&cmdline_arena,
+                                               node->num_tokens);
+                    memset(insn->expand, 0, node->num_tokens);
+                    compiler->num_expand += node->num_tokens;
+                }
+                if (insn->expand)
+                    insn->expand[i] = flags;
+            }
+            insn->argv[node->num_tokens] = NULL;
+            compiler->num_args += node->num_tokens + 1;
+            frame->num_subtrees = 0;
+            return NULL;
+        case NODE_REDIR_IN:
+        case NODE_REDIR_OUT:
+        case NODE_REDIR_APPEND:
+        case NODE_HEREDOC:
+        case NODE_HERESTRING:
+            /*
+             * The files are opened by the child which runs the command, so
+             * the redirections only need a block of their own if they aren't
+             * already the whole of one
+             */
+            if (!frame->in_block) {
+                frame->fixup = compiler->len;
+                emit(compiler, INSN_SUBSHELL);
+            }
+            frame->num_subtrees = 1;
+            frame->next_in_block = true;
+            return emit_redirections(compiler, node);
+        case NODE_PIPE:
+        case NODE_ERR_PIPE:
+            /* All of the stages are launched with the pipes made up front */
+            collect_pipes(frame);
+            insn = emit(compiler, INSN_PIPE);
+            insn->len = frame->num_subtrees - 1;
+            if (compiler->pipe_sizes) {
+                insn->flags = 1;
+                emit_pipe_sizes(compiler, insn->len);
+            }
+            return begin_stage(compiler, frame, 0);
+        case NODE_SEMICOLON:
+            /* A list of nothing succeeds */
+            if (!node->left && !node->right)
+                emit(compiler, INSN_TRUE);
+            break;
+        case NODE_BACKGROUND:
+        case NODE_DISOWN:
+            frame->fixup = compiler->len;
+            insn = emit(compiler, INSN_BACKGROUND);
+            insn->flags = node->type == NODE_DISOWN;
+            frame->next_in_block = true;
+            break;
+        case NODE_TIME:
+            emit(compiler, INSN_TIME_START);
+            frame->num_subtrees = 1;
+            break;
+        case NODE_PIPESIZE:
+            compiler->pipe_sizes = &node->tokens[1];
+            frame->num_subtrees = 1;
+            break;
+        case NODE_AND:
+        case NODE_OR:
+            break;
+    }
+    return node->left;
+}
+
+/* See above */
+static struct SyntaxTree *between_subtrees(struct Compiler *compiler,
+                                           struct Frame *frame, size_t index)
+{
+    struct SyntaxTree *node = frame->node;
+
+    switch (node->type) {
+        case NODE_PIPE:
+        case NODE_ERR_PIPE:
+            end_block(compiler, frame->fixup);
+            return begin_stage(compiler, frame, index);
+        case NODE_AND:
+            frame->fixup = compiler->len;
+            emit(compiler, INSN_JNZ);
+            break;
+        case NODE_OR:
+            frame->fixup = compiler->len;
+            emit(compiler, INSN_JZ);
+            break;
+        case NODE_BACKGROUND:
+        case NODE_DISOWN:
+            end_block(compiler, frame->fixup);
+            break;
+        default:
+            break;
+    }
+    return node->right;
+}
+
+/* See above */
+static void leave_node(struct Compiler *compiler, struct Frame *frame)
+{
+    struct SyntaxTree *node = frame->node;
+    struct Insn *insn;
+
+    switch (node->type) {
+        case NODE_REDIR_IN:
+        case NODE_REDIR_OUT:
+        case NODE_REDIR_APPEND:
+        case NODE_HEREDOC:
+        case NODE_HERESTRING:
+            if (!frame->in_block) {
+                end_block(compiler, frame->fixup);
+                emit(compiler, INSN_WAIT)->len = 1;
+            }
+            break;
+        case NODE_PIPE:
+        case NODE_ERR_PIPE:
+            end_block(compiler, frame->fixup);
+            emit(compiler, INSN_CLOSE_PIPE);
+            emit(compiler, INSN_WAIT)->len = frame->num_subtrees;
+            break;
+        case NODE_AND:
+        case NODE_OR:
+            end_block(compiler, frame->fixup);
+            break;
+        case NODE_TIME:
+            insn = emit(compiler, INSN_TIME_END);
+            for (size_t i = 0; i < node->num_tokens; ++i) {
+                if (strcmp(node->tokens[i].token, "-j") == 0)
+                    insn->flags = 1;
+            }
+            break;
+        case NODE_PIPESIZE:
+            /* The prefix may not have applied to a pipeline after all */
+            compiler->pipe_sizes = NULL;
+            break;
+        default:
+            break;
+    }
+}
+
+/* See above */
+static inline unsigned char expansion_flags(const struct Token *token)
+{
+    /* Whether a raw word is a pattern is only known once it's expanded */
+    if (token->raw)
+        return ARG_VARS;
+    return token->glob ? ARG_GLOB : 0;
+}
+
+/* See above */
+static inline bool is_redirection(struct SyntaxTree *node)
+{
+    return node->type == NODE_REDIR_IN || node->type == NODE_REDIR_OUT ||
+        node->type == NODE_REDIR_APPEND || node->type == NODE_HEREDOC ||
+        node->type == NODE_HERESTRING;
+}
+
+/* See above */
+static struct SyntaxTree *emit_redirections(struct Compiler *compiler,
+                                            struct SyntaxTree *node)
+{
+    for (; is_redirection(node); node = node->left) {
+        bool heredoc = node->type == NODE_HEREDOC ||
+            node->type == NODE_HERESTRING;
+        struct Insn *insn = emit(compiler, heredoc ? INSN_HEREDOC : INSN_REDIR);
+        struct Token *token = &node->right->tokens[0];
+
+        insn->path = token->token;
+        if (token->raw) {
+            insn->path = token->raw;
+            insn->expand = arena_alloc(&cmdline_arena, 1);
+            *insn->expand = ARG_VARS;
+            ++compiler->num_expand;
+        }
+        if (heredoc) {
+            insn->fd = 0;
+            insn->flags = node->type == NODE_HERESTRING;
+        } else if (node->type == NODE_REDIR_IN) {
+            insn->fd = 0;
+            insn->flags = O_RDONLY;
+        } else {
+            insn->fd = 1;
+            insn->flags = O_WRONLY | O_CREAT |
+                (node->type == NODE_REDIR_APPEND ? O_APPEND : O_TRUNC);
+        }
+    }
+    return node;
+}
+
+/* See above */
+static void collect_pipes(struct Frame *frame)
+{
+    struct SyntaxTree *node = frame->node;
+    size_t num_pipes = 0;
+
+    for (; node->type == NODE_PIPE || node->type == NODE_ERR_PIPE;
+            node = node->left)
+        ++num_pipes;
+
+    frame->pipes = arena_alloc(&cmdline_arena,
+                               sizeof(*frame->pipes) * num_pipes);
+    frame->num_subtrees = num_pipes + 1;
+    for (node = frame->node; num_pipes; node = node->left)
+        frame->pipes[--num_pipes] = node;
+}
+
+/* See above */
+static struct SyntaxTree *begin_stage(struct Compiler *compiler,
+                                      struct Frame *frame, size_t index)
+{
+    size_t num_pipes = frame->num_subtrees - 1;
+    struct Insn *insn;
+
+    frame->fixup = compiler->len;
+    emit(compiler, INSN_SUBSHELL);
+    if (index > 0) {
+        insn = emit(compiler, INSN_PIPE_END);
+        insn->fd = 0;
+        insn->flags = 0;
+        insn->len = index - 1;
+    }
+    if (index < num_pipes) {
+        insn = emit(compiler, INSN_PIPE_END);
+        insn->fd = frame->pipes[index]->type == NODE_ERR_PIPE ? 2 : 1;
+        insn->flags = 1;
+        insn->len = index;
+    }
+    emit(compiler, INSN_CLOSE_PIPE);
+    frame->next_in_block = true;
+    return index == 0 ? frame->pipes[0]->left : frame->pipes[index - 1]->right;
+}
+
+/* See above */
+static void emit_pipe_sizes(struct Compiler *compiler, size_t num_pipes)
+{
+    const char *p = compiler->pipe_sizes->token;
+    size_t capacity = 0;
+
+    /* The list was validated by the parser, and its last entry repeats */
+    for (size_t i = 0; i < num_pipes; ++i) {
+        struct Insn *insn;
+        if (p) {
+            const char *comma = strchr(p, ',');
+            parse_pipe_size(p, comma ? comma - p : strlen(p), &capacity);
+            p = comma ? comma + 1 : NULL;
+        }
+        insn = emit(compiler, INSN_PIPE_SIZE);
+        insn->len = i;
+        insn->capacity = capacity;
+    }
+    compiler->pipe_sizes = NULL;
+}
+
+/* See above */
+static inline void end_block(struct Compiler *compiler, size_t start)
+{
+    compiler->insns[start].len = compiler->len - start - 1;
+}
+
+/* See above */
+static struct Plan *finish_plan(struct Compiler *compiler,
+                                struct Arena *arena)
+{
+    struct Plan *plan;
+    char **args;
+    unsigned char *expand = NULL;
+
+    arena_reserve(arena, sizeof(struct Plan) + ARENA_ALIGNMENT +
+                  sizeof(struct Insn) * compiler->len + ARENA_ALIGNMENT +
+                  sizeof(char *) * compiler->num_args + ARENA_ALIGNMENT +
+                  (compiler->num_expand ?
+                   compiler->num_expand + ARENA_ALIGNMENT : 0));
+    plan = arena_alloc(arena, sizeof(struct Plan));
+    plan->insns = arena_alloc(arena, sizeof(struct Insn) * compiler->len);
+    plan->len = compiler->len;
+    memcpy(plan->insns, compiler->insns, sizeof(struct Insn) * compiler->len);
+
+    /* The arguments of all of the commands are packed together */
+    args = arena_alloc(arena, sizeof(char *) * compiler->num_args);
+    if (compiler->num_expand)
+        expand = arena_alloc(arena, compiler->num_expand);
+    for (size_t i = 0; i < plan->len; ++i) {
+        struct Insn *insn = &plan->insns[i];
+        if (insn->op == INSN_EXEC) {
+            memcpy(args, insn->argv, sizeof(char *) * (insn->len + 1));
+            insn->argv = args;
+            args += insn->len + 1;
+        }
+        if (insn->expand) {
+            size_t num = insn->op == INSN_EXEC ? insn->len : 1;
+            memcpy(expand, insn->expand, num);
+            insn->expand = expand;
+            expand += num;
+        }
+    }
+    return plan;
+}
+
+/* See above */
+static void *grow_array(void *array, size_t *capacity, size_t elem_size)
+{
+    size_t new_capacity = *capacity ? 2 * *capacity : INITIAL_CAPACITY;
+    void *new_array = arena_alloc(&cmdline_arena, elem_size * new_capacity);
+    if (array)
+        memcpy(new_array, array, elem_size * *capacity);
+    *capacity = new_capacity;
+    return new_array;
+}
+
+/* See plan.h */
+void print_plan(struct Plan *plan)
+{
+    for (size_t i = 0; i < plan->len; ++i) {
+        struct Insn *insn = &plan->insns[i];
+        printf("%4zu: %-10s", i, opcode_names[insn->op]);
+        switch (insn->op) {
+            case INSN_EXEC:
+                for (size_t j = 0; j < insn->len; ++j)
+                    printf(" `%s'", insn->argv[j]);
+                break;
+            case INSN_REDIR:
+                printf(" %d `%s' %#o", insn->fd, insn->path, insn->flags);
+                break;
+            case INSN_HEREDOC:
+                printf(" %d %zu bytes", insn->fd,
+                       strlen(insn->path) + insn->flags);
+                break;
+            case INSN_PIPE_END:
+                printf(" %d %s %zu", insn->fd, insn->flags ? "write" : "read",
+                       insn->len);
+                break;
+            case INSN_BACKGROUND:
+                printf(" %zu%s", insn->len, insn->flags ? " disown" : "");
+                break;
+            case INSN_TIME_END:
+                printf("%s", insn->flags ? " json" : "");
+                break;
+            case INSN_PIPE:
+                printf(" %zu%s", insn->len, insn->flags ? " sized" : "");
+                break;
+            case INSN_PIPE_SIZE:
+                if (insn->capacity == PIPE_ADAPTIVE)
+                    printf(" %zu auto", insn->len);
+                else
+                    printf(" %zu %zu", insn->len, insn->capacity);
+                break;
+            case INSN_CLOSE_PIPE:
+            case INSN_TRUE:
+            case INSN_TIME_START:
+                break;
+            default:
+                printf(" %zu", insn->len);
+                break;
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,125 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "arena.h"
+#include "parser.h"
+
+/**
+ * Constants for the operations of the instructions of an execution plan. The
+ * instructions are executed in order by a single loop which keeps the exit
+ * status of the last command in a register. A block of instructions run by a
+ * child process ends with the child exiting with that status
+ */
+enum Opcode {
+    INSN_EXEC, /**< Execute a command (built-in or external) and wait for it */
+    INSN_SUBSHELL, /**< Fork a child which runs the next len instructions as a
+                        block while the parent skips them */
+    INSN_BACKGROUND, /**< Like INSN_SUBSHELL, but the child becomes a job in
+                          the background and the status becomes zero */
+    INSN_WAIT, /**< Wait for the last len children forked by INSN_SUBSHELL and
+                    take the status of the last one */
+    INSN_REDIR, /**< Open a file and move it onto a file descriptor, or skip the
+                     rest of the block if the file can't be opened */
+    INSN_HEREDOC, /**< Like INSN_REDIR, but the file is a sealed anonymous one
+                       in memory holding the text of a heredoc */
+    INSN_PIPE, /**< Create the len pipes of a pipeline, which are closed when
+                    a command is executed */
+    INSN_PIPE_SIZE, /**< Set the capacity of pipe number len */
+    INSN_PIPE_END, /**< Duplicate one end of pipe number len onto a file
+                        descriptor */
+    INSN_CLOSE_PIPE, /**< Close all of the pipes */
+    INSN_JZ, /**< Skip the next len instructions if the status is zero */
+    INSN_JNZ, /**< Skip the next len instructions if the status is non-zero */
+    INSN_TRUE, /**< Set the status to zero */
+    INSN_TIME_START, /**< Start measuring the time and resources used */
+    INSN_TIME_END /**< Stop measuring since the matching INSN_TIME_START and
+                       print the measurements */
+};
+
+/** Flags for how an argument or path is expanded when it runs */
+enum ArgExpansion {
+    ARG_GLOB = 1, /**< The argument is a glob pattern */
+    ARG_VARS = 2 /**< The argument is the raw text of a word, whose variables
+                      are expanded when it runs, as they may have changed */
+};
+
+/** An instruction of an execution plan */
+struct Insn {
+    /** The operation */
+    enum Opcode op;
+
+    /**
+     * The file descriptor which is redirected by INSN_REDIR, INSN_HEREDOC or
+     * INSN_PIPE_END
+     */
+    int fd;
+
+    /**
+     * The flags to open the file with for INSN_REDIR, whether a newline is
+     * appended to the text for INSN_HEREDOC, the end of the pipe (0 for the
+     * read end, 1 for the write end) for INSN_PIPE_END, whether the job is
+     * disowned (left out of the job table) for INSN_BACKGROUND, whether to
+     * print the measurements as JSON for INSN_TIME_END, or whether the pipes
+     * are sized by INSN_PIPE_SIZE rather than by the shell option for
+     * INSN_PIPE
+     */
+    int flags;
+
+    /**
+     * The number of instructions in the block or to skip, the number of
+     * children to wait for or pipes to create, the index of the pipe for
+     * INSN_PIPE_END and INSN_PIPE_SIZE, or the number of arguments for
+     * INSN_EXEC
+     */
+    size_t len;
+
+    union {
+        /** The null-terminated arguments of the command for INSN_EXEC */
+        char **argv;
+
+        /**
+         * The path of the file to open for INSN_REDIR, or the text for
+         * INSN_HEREDOC
+         */
+        const char *path;
+
+        /**
+         * The capacity of the pipe in bytes for INSN_PIPE_SIZE, where zero
+         * leaves it as it is and PIPE_ADAPTIVE makes it grow
+         */
+        size_t capacity;
+    };
+
+    /**
+     * The ArgExpansion flags of each argument for INSN_EXEC, or of the path
+     * for INSN_REDIR and INSN_HEREDOC, or NULL if nothing is expanded
+     */
+    unsigned char *expand;
+};
+
+/** A command line compiled into a flat array of instructions */
+struct Plan {
+    /** The instructions */
+    struct Insn *insns;
+
+    /** The number of instructions */
+    size_t len;
+};
+
+/**
+ * Compile a syntax tree into an execution plan. The tree is walked without
+ * recursion, so arbitrarily long command lines can be compiled. The plan is
+ * allocated from the given arena and its arguments refer to the strings of the
+ * tokens of the tree, which must outlive it. Scratch space is allocated from
+ * cmdline_arena
+ * @return The plan
+ */
+struct Plan *compile(struct Arena *arena, struct SyntaxTree *root);
+
+/** Print the instructions of an execution plan, one per line */
+void print_plan(struct Plan *plan);
+
+#endif /* PLAN_H */
@@ -0,0 +1,51 @@
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+/*
+ * The interface for plugins which add built-ins to the shell. A plugin is a
+ * shared object loaded with `enable -f lib.so name...', which exports a
+ * struct OshBuiltin named osh_builtin_<name> for each of the built-ins it
+ * provides, e.g.,
+ *
+ *     #include "plugin.h"
+ *
+ *     static int hello(int argc, char **argv)
+ *     {
+ *         printf("hello, %s\n", argc > 1 ? argv[1] : "world");
+ *         return 0;
+ *     }
+ *
+ *     const struct OshBuiltin osh_builtin_hello = {
+ *         OSH_PLUGIN_ABI_VERSION, "hello", hello
+ *     };
+ *
+ * Loaded built-ins run in the shell process exactly like the ones compiled
+ * into it. Fields are only ever added to the end of struct OshBuiltin, along
+ * with a new version, so that plugins built against an older version of this
+ * header keep working.
+ */
+
+/** The version of the interface described by this header */
+#define OSH_PLUGIN_ABI_VERSION 1
+
+/** The prefix of the names of the symbols of built-ins */
+#define OSH_BUILTIN_PREFIX "osh_builtin_"
+
+/** A built-in provided by a plugin */
+struct OshBuiltin {
+    /** The version of the interface the plugin was built against */
+    unsigned int abi_version;
+
+    /** The name of the command, which must match the name of the symbol */
+    const char *name;
+
+    /**
+     * The function run for the command with its arguments (argv[0] being the
+     * name). It returns the exit status of the command, or -1 to leave the
+     * command to the external one of the same name. Standard output is
+     * flushed after it returns
+     */
+    int (*func)(int argc, char **argv);
+};
+
+#endif /* PLUGIN_H */
@@ -0,0 +1,164 @@
+#include <string.h>
+
+#ifdef __SSE2__
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#include "scan.h"
+
+/* See scan.h */
+const unsigned char char_classes[256] = {
+    ['\t'] = CHAR_SPACE, ['\n'] = CHAR_SPACE, ['\v'] = CHAR_SPACE,
+    ['\f'] = CHAR_SPACE, ['\r'] = CHAR_SPACE, [' '] = CHAR_SPACE,
+    ['&'] = CHAR_SPECIAL, ['|'] = CHAR_SPECIAL, ['!'] = CHAR_SPECIAL,
+    ['#'] = CHAR_SPECIAL, ['<'] = CHAR_SPECIAL, ['>'] = CHAR_SPECIAL,
+    ['('] = CHAR_SPECIAL, [')'] = CHAR_SPECIAL, [';'] = CHAR_SPECIAL,
+    ['\''] = CHAR_QUOTE, ['"'] = CHAR_QUOTE,
+    ['\\'] = CHAR_ESCAPE, ['$'] = CHAR_DOLLAR,
+    ['*'] = CHAR_GLOB, ['?'] = CHAR_GLOB, ['['] = CHAR_GLOB,
+};
+
+/** A function returning the length of a run of word characters */
+typedef size_t (*scan_function)(const char *, const char *);
+
+/** Scan a run of word characters one byte at a time using the class table */
+static size_t scan_word_scalar(const char *p, const char *end);
+
+#ifdef HAVE_X86_SIMD
+/** Scan a run of word characters sixteen bytes at a time using SSE2 */
+static size_t scan_word_sse2(const char *p, const char *end);
+
+/** Scan a run of word characters thirty-two bytes at a time using AVX2 */
+static size_t scan_word_avx2(const char *p, const char *end);
+#endif
+
+/**
+ * Pick the scan function for the running CPU and then scan with it (used as
+ * the initial value of scan_impl)
+ */
+static size_t scan_word_resolve(const char *p, const char *end);
+
+/** The implementation of scan_word in use */
+static scan_function scan_impl = scan_word_resolve;
+
+/* See scan.h */
+size_t scan_word(const char *p, const char *end)
+{
+    return scan_impl(p, end);
+}
+
+/* See scan.h */
+int scan_select(const char *name)
+{
+    if (strcmp(name, "scalar") == 0) {
+        scan_impl = scan_word_scalar;
+        return 0;
+    }
+#ifdef HAVE_X86_SIMD
+    if (strcmp(name, "sse2") == 0) {
+        scan_impl = scan_word_sse2;
+        return 0;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        scan_impl = scan_word_avx2;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+/* See above */
+static size_t scan_word_resolve(const char *p, const char *end)
+{
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        scan_impl = scan_word_avx2;
+    else
+        scan_impl = scan_word_sse2;
+#else
+    scan_impl = scan_word_scalar;
+#endif
+    return scan_impl(p, end);
+}
+
+/* See above */
+static size_t scan_word_scalar(const char *p, const char *end)
+{
+    const char *q = p;
+    while (q < end && char_classes[(unsigned char)*q] == CHAR_WORD)
+        ++q;
+    return q - p;
+}
+
+#ifdef HAVE_X86_SIMD
+/*
+ * The SIMD scanners test every byte against the non-word characters, which
+ * fall into the ranges \t-\r, ' '-'$', '&'-'*', ';'-'<', '>'-'?', and
+ * '['-'\\', plus the single character '|'. A byte v is in the range [lo, hi]
+ * exactly when the unsigned difference v - lo is at most hi - lo
+ */
+
+/** Return a mask of the bytes of v in the range [lo, hi] */
+#define RANGE_SSE2(v, lo, hi) ({                                         \
+    __m128i d = _mm_sub_epi8((v), _mm_set1_epi8(lo));                    \
+    _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8((hi) - (lo))), d);      \
+})
+
+/** Return a mask of the bytes of v equal to c */
+#define EQ_SSE2(v, c) _mm_cmpeq_epi8((v), _mm_set1_epi8(c))
+
+/* See above */
+static size_t scan_word_sse2(const char *p, const char *end)
+{
+    const char *q = p;
+    for (; end - q >= 16; q += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)q);
+        __m128i stop = _mm_or_si128(
+            _mm_or_si128(_mm_or_si128(RANGE_SSE2(v, '\t', '\r'),
+                                      RANGE_SSE2(v, ' ', '$')),
+                         _mm_or_si128(RANGE_SSE2(v, '&', '*'),
+                                      RANGE_SSE2(v, ';', '<'))),
+            _mm_or_si128(_mm_or_si128(RANGE_SSE2(v, '>', '?'),
+                                      RANGE_SSE2(v, '[', '\\')),
+                         EQ_SSE2(v, '|')));
+        unsigned int mask = _mm_movemask_epi8(stop);
+        if (mask)
+            return q - p + __builtin_ctz(mask);
+    }
+    return q - p + scan_word_scalar(q, end);
+}
+
+/** Return a mask of the bytes of v in the range [lo, hi] */
+#define RANGE_AVX2(v, lo, hi) ({                                         \
+    __m256i d = _mm256_sub_epi8((v), _mm256_set1_epi8(lo));              \
+    _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8((hi) - (lo))), \
+                      d);                                                \
+})
+
+/** Return a mask of the bytes of v equal to c */
+#define EQ_AVX2(v, c) _mm256_cmpeq_epi8((v), _mm256_set1_epi8(c))
+
+/* See above */
+__attribute__((target("avx2")))
+static size_t scan_word_avx2(const char *p, const char *end)
+{
+    const char *q = p;
+    for (; end - q >= 32; q += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)q);
+        __m256i stop = _mm256_or_si256(
+            _mm256_or_si256(_mm256_or_si256(RANGE_AVX2(v, '\t', '\r'),
+                                            RANGE_AVX2(v, ' ', '$')),
+                            _mm256_or_si256(RANGE_AVX2(v, '&', '*'),
+                                            RANGE_AVX2(v, ';', '<'))),
+            _mm256_or_si256(_mm256_or_si256(RANGE_AVX2(v, '>', '?'),
+                                            RANGE_AVX2(v, '[', '\\')),
+                            EQ_AVX2(v, '|')));
+        unsigned int mask = _mm256_movemask_epi8(stop);
+        if (mask)
+            return q - p + __builtin_ctz(mask);
+    }
+    return q - p + scan_word_sse2(q, end);
+}
+#endif /* HAVE_X86_SIMD */
@@ -0,0 +1,47 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Flags for the lexical classes of characters */
+enum CharClass {
+    CHAR_WORD = 0, /**< An ordinary character which is part of a word */
+    CHAR_SPACE = 1 << 0, /**< Whitespace (as isspace in the C locale) */
+    CHAR_SPECIAL = 1 << 1, /**< Part of an operator (e.g., `|' or `;') */
+    CHAR_QUOTE = 1 << 2, /**< A single or double quote */
+    CHAR_ESCAPE = 1 << 3, /**< A backslash */
+    CHAR_DOLLAR = 1 << 4, /**< A dollar sign, which may start an expansion */
+    CHAR_GLOB = 1 << 5 /**< A character special in glob patterns (`*?[') */
+};
+
+/** The lexical class of every byte value */
+extern const unsigned char char_classes[256];
+
+/** Return the lexical class of a character */
+static inline unsigned int char_class(char c)
+{
+    return char_classes[(unsigned char)c];
+}
+
+/** Return whether a character belongs to any of the given classes */
+static inline bool char_is(char c, unsigned int classes)
+{
+    return char_class(c) & classes;
+}
+
+/**
+ * Return the length of the run of ordinary word characters (i.e., characters
+ * of class CHAR_WORD) starting at p and ending no later than end
+ */
+size_t scan_word(const char *p, const char *end);
+
+/**
+ * Select the implementation used by scan_word by name ("scalar", "sse2", or
+ * "avx2"). By default, the fastest one supported by the CPU is chosen the
+ * first time scan_word is called
+ * @return Zero on success, -1 if the implementation is not available
+ */
+int scan_select(const char *name);
+
+#endif /* SCAN_H */
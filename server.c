@@ -0,0 +1,483 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "cmdline.h"
+#include "error.h"
+#include "glob.h"
+#include "jobs.h"
+#include "server.h"
+#include "shell.h"
+#include "vars.h"
+
+#ifndef SERVER_MAX_LINE
+/** The longest command line accepted in a request */
+#define SERVER_MAX_LINE (16 * 1024 * 1024)
+#endif
+
+/**
+ * The number of file descriptors passed with a request: standard input,
+ * output, and error, and the working directory
+ */
+#define NUM_FDS 4
+
+/** Space for the control message passing the file descriptors */
+union Control {
+    char buf[CMSG_SPACE(sizeof(int) * NUM_FDS)];
+    struct cmsghdr align;
+};
+
+/**
+ * The standard input, output, and error of a worker and its working
+ * directory, duplicated so that they can be restored after each request
+ */
+static int saved_fds[NUM_FDS];
+
+/** The options of a worker, restored after each request */
+static size_t saved_limit, saved_capacity;
+static bool saved_glob_cache;
+
+/** The process ID of a worker, which its forked children don't share */
+static pid_t worker_pid = -1;
+
+/** The connection whose request a worker is running, or -1 if there is none */
+static int running_conn = -1;
+
+/** The usages of a worker and its children when the request started */
+static struct rusage start_self, start_children;
+
+/**
+ * Fill in the address of a socket bound to a path
+ * @return Zero on success, -1 with errno set if the path is too long
+ */
+static int socket_address(struct sockaddr_un *addr, const char *path);
+
+/**
+ * Fork a worker which accepts connections on a listening socket and serves
+ * them one at a time until it exits
+ * @return The process ID of the worker, or -1 with errno set on failure
+ */
+static pid_t start_worker(int sock);
+
+/**
+ * Receive a request on a connection and run its command line
+ * @return Zero on success, -1 if the connection was closed or the request was
+ * malformed
+ */
+static int serve_request(int conn);
+
+/**
+ * Bring the state of a worker which a request may have changed back to what it
+ * was before: its file descriptors, working directory, variables, and options.
+ * The jobs of the request were removed before it replied
+ */
+static void restore_worker(void);
+
+/**
+ * Reply to the request which is running when its command line exits the
+ * worker (registered with on_exit)
+ */
+static void reply_on_exit(int status, void *arg);
+
+/**
+ * Receive the header of a request along with the file descriptors passed with
+ * it
+ * @param fds Set to the file descriptors, or to -1 for the ones missing
+ * @return The number of bytes received, or -1 with errno set on failure
+ */
+static ssize_t recv_header(int conn, struct ServerRequest *header,
+                           int fds[NUM_FDS]);
+
+/**
+ * Set a usage to the resources used by a command line since the given usages
+ * of the shell and of its children, like the time prefix does
+ */
+static void usage_since(struct rusage *usage, const struct rusage *self,
+                        const struct rusage *children);
+
+/**
+ * Read exactly len bytes from a file descriptor
+ * @return Zero on success, -1 with errno set on failure (ECONNRESET if the
+ * end of the file comes first)
+ */
+static int read_full(int fd, void *buf, size_t len);
+
+/**
+ * Send all of a buffer on a socket, without raising SIGPIPE if the peer is
+ * gone
+ * @return Zero on success, -1 with errno set on failure
+ */
+static int send_full(int sock, const void *buf, size_t len);
+
+/* See server.h */
+int server_run(const char *path, int workers)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    int sock, err;
+
+    if (socket_address(&addr, path) == -1 ||
+        (sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+        return -1;
+    /* A socket left behind by an earlier server would keep bind from working */
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(sock, SOMAXCONN) == -1) {
+        err = errno;
+        close(sock);
+        errno = err;
+        return -1;
+    }
+
+    for (int i = 0; i < workers; ++i) {
+        if (start_worker(sock) == -1)
+            error(1, errno, "server");
+    }
+    /* Workers exit when a request runs exit or a signal kills them */
+    for (;;) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+
+        if (pid == -1) {
+            if (errno == EINTR)
+                continue;
+            error(1, errno, "server");
+        }
+        if (WIFSIGNALED(status))
+            error(0, 0, "server: worker %d killed by signal %d", pid,
+                  WTERMSIG(status));
+        while (start_worker(sock) == -1) {
+            error(0, errno, "server");
+            sleep(1);
+        }
+    }
+}
+
+/* See server.h */
+int server_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    int sock, err;
+
+    if (socket_address(&addr, path) == -1 ||
+        (sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+        return -1;
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        err = errno;
+        close(sock);
+        errno = err;
+        return -1;
+    }
+    return sock;
+}
+
+/* See server.h */
+int server_request(int sock, const char *line, size_t len,
+                   struct rusage *usage)
+{
+    struct ServerRequest header = {SERVER_MAGIC, len};
+    struct ServerReply reply;
+    union Control control;
+    struct iovec iov[2] = {
+        {&header, sizeof(header)}, {(void *)line, len}
+    };
+    struct msghdr msg = {
+        .msg_iov = iov, .msg_iovlen = 2,
+        .msg_control = control.buf, .msg_controllen = sizeof(control.buf)
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    int fds[NUM_FDS] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, -1};
+    ssize_t sent;
+    int err;
+
+    if (len > SERVER_MAX_LINE) {
+        errno = E2BIG;
+        return -1;
+    }
+    if ((fds[3] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return -1;
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    do
+        sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    while (sent == -1 && errno == EINTR);
+    err = errno;
+    close(fds[3]);
+    errno = err;
+    if (sent == -1)
+        return -1;
+
+    /* The rest of a long line may not have fit in the socket at once */
+    if (sent < sizeof(header)) {
+        if (send_full(sock, (char *)&header + sent,
+                      sizeof(header) - sent) == -1 ||
+            send_full(sock, line, len) == -1)
+            return -1;
+    } else if (send_full(sock, line + (sent - sizeof(header)),
+                         len - (sent - sizeof(header))) == -1)
+        return -1;
+
+    if (read_full(sock, &reply, sizeof(reply)) == -1)
+        return -1;
+    if (usage)
+        *usage = reply.usage;
+    return reply.status;
+}
+
+/* See above */
+static int socket_address(struct sockaddr_un *addr, const char *path)
+{
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/* See above */
+static pid_t start_worker(int sock)
+{
+    pid_t parent = getpid(), pid;
+
+    /* Otherwise the worker would write out whatever is buffered again */
+    fflush(stdout);
+    if ((pid = fork()) != 0)
+        return pid;
+
+    /* Workers don't outlive the server, even if it is killed */
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != parent)
+        exit(0);
+    worker_pid = getpid();
+    on_exit(reply_on_exit, NULL);
+
+    /* Received file descriptors must not land on the standard ones */
+    for (int fd = 0; fd < 3; ++fd) {
+        if (fcntl(fd, F_GETFD) == -1 &&
+            open("/dev/null", fd ? O_WRONLY : O_RDONLY) != fd)
+            error(1, errno, "server: /dev/null");
+        if ((saved_fds[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 3)) == -1)
+            error(1, errno, "server");
+    }
+    if ((saved_fds[3] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC)) == -1)
+        error(1, errno, "server");
+    saved_limit = jobs_limit();
+    saved_capacity = pipe_capacity();
+    saved_glob_cache = glob_cache();
+    vars_save();
+
+    for (;;) {
+        int conn = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+
+        if (conn == -1) {
+            if (errno != EINTR && errno != ECONNABORTED)
+                error(1, errno, "server: accept");
+            continue;
+        }
+        while (serve_request(conn) == 0)
+            ;
+        close(conn);
+    }
+}
+
+/* See above */
+static int serve_request(int conn)
+{
+    struct ServerRequest header;
+    struct ServerReply reply;
+    struct rusage *usage;
+    char *line = NULL;
+    int fds[NUM_FDS], status;
+    ssize_t len = recv_header(conn, &header, fds);
+    bool valid = len == sizeof(header) && header.magic == SERVER_MAGIC &&
+        header.len <= SERVER_MAX_LINE;
+
+    for (int fd = 0; fd < NUM_FDS; ++fd)
+        valid &= fds[fd] != -1;
+    if (valid && !(line = malloc(header.len + 1)))
+        error(1, errno, "fatal error");
+    if (!valid || read_full(conn, line, header.len) == -1) {
+        for (int fd = 0; fd < NUM_FDS; ++fd) {
+            if (fds[fd] != -1)
+                close(fds[fd]);
+        }
+        free(line);
+        return -1;
+    }
+    line[header.len] = '\0';
+
+    for (int fd = 0; fd < 3; ++fd) {
+        dup2(fds[fd], fd);
+        close(fds[fd]);
+    }
+    usage = jobs_usage();
+    getrusage(RUSAGE_SELF, &start_self);
+    start_children = *usage;
+    usage->ru_maxrss = 0;
+
+    /* The command line runs in the working directory of the client */
+    running_conn = conn;
+    if (fchdir(fds[3]) == -1) {
+        error(0, errno, "server: cd");
+        status = 1;
+    } else
+        status = run_string(line);
+    close(fds[3]);
+    /* As when a script exits, queued jobs start before the reply */
+    jobs_clear();
+    running_conn = -1;
+    fflush(stdout);
+    usage_since(&reply.usage, &start_self, &start_children);
+    reply.status = status;
+
+    restore_worker();
+    free(line);
+    return send_full(conn, &reply, sizeof(reply));
+}
+
+/* See above */
+static void restore_worker(void)
+{
+    for (int fd = 0; fd < 3; ++fd)
+        dup2(saved_fds[fd], fd);
+    if (fchdir(saved_fds[3]) == -1)
+        error(1, errno, "server");
+    vars_restore();
+    jobs_set_limit(saved_limit);
+    set_pipe_capacity(saved_capacity);
+    glob_set_cache(saved_glob_cache);
+}
+
+/* See above */
+static void reply_on_exit(int status, void *arg)
+{
+    struct ServerReply reply;
+
+    if (getpid() != worker_pid || running_conn == -1)
+        return;
+    fflush(stdout);
+    usage_since(&reply.usage, &start_self, &start_children);
+    reply.status = status;
+    send_full(running_conn, &reply, sizeof(reply));
+}
+
+/* See above */
+static ssize_t recv_header(int conn, struct ServerRequest *header,
+                           int fds[NUM_FDS])
+{
+    union Control control;
+    struct iovec iov = {header, sizeof(*header)};
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = control.buf, .msg_controllen = sizeof(control.buf)
+    };
+    ssize_t len;
+
+    for (int fd = 0; fd < NUM_FDS; ++fd)
+        fds[fd] = -1;
+    do
+        len = recvmsg(conn, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+    while (len == -1 && errno == EINTR);
+    if (len == -1)
+        return -1;
+
+    /* Any file descriptors beyond the first four were closed as truncated */
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+            cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(cmsg),
+                   sizeof(int) * (num < NUM_FDS ? num : NUM_FDS));
+        }
+    }
+    return len;
+}
+
+/* See above */
+static void usage_since(struct rusage *usage, const struct rusage *self,
+                        const struct rusage *children)
+{
+    struct rusage *after = jobs_usage(), now;
+    struct timeval delta;
+
+    getrusage(RUSAGE_SELF, &now);
+    memset(usage, 0, sizeof(*usage));
+    timersub(&after->ru_utime, &children->ru_utime, &usage->ru_utime);
+    timersub(&now.ru_utime, &self->ru_utime, &delta);
+    timeradd(&usage->ru_utime, &delta, &usage->ru_utime);
+    timersub(&after->ru_stime, &children->ru_stime, &usage->ru_stime);
+    timersub(&now.ru_stime, &self->ru_stime, &delta);
+    timeradd(&usage->ru_stime, &delta, &usage->ru_stime);
+
+#define DELTA(field) (usage->field = after->field - children->field + \
+                      now.field - self->field)
+    DELTA(ru_minflt);
+    DELTA(ru_majflt);
+    DELTA(ru_nvcsw);
+    DELTA(ru_nivcsw);
+#undef DELTA
+
+    /* As with the time prefix, this is the size of the largest command */
+    usage->ru_maxrss = after->ru_maxrss;
+    if (children->ru_maxrss > after->ru_maxrss)
+        after->ru_maxrss = children->ru_maxrss;
+}
+
+/* See above */
+static int read_full(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+
+    while (len) {
+        ssize_t n = read(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        } else if (n == 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* See above */
+static int send_full(int sock, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len) {
+        ssize_t n = send(sock, p, len, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
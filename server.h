@@ -0,0 +1,74 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sys/resource.h>
+
+/** The magic number at the start of every request ("osh1") */
+#define SERVER_MAGIC 0x3168736f
+
+/**
+ * The header of a request to run a command line, which is followed by the
+ * text of the command line on the socket. The client's standard input,
+ * output, and error and its working directory are passed along with the
+ * header as SCM_RIGHTS, and the command line runs with them as its own
+ */
+struct ServerRequest {
+    /** SERVER_MAGIC */
+    uint32_t magic;
+
+    /** The length of the command line */
+    uint32_t len;
+};
+
+/** The reply to a request once its command line has finished */
+struct ServerReply {
+    /** The exit status of the command line */
+    int status;
+
+    /**
+     * The resources used by the command line: the shell's own usage while
+     * running it plus that of the commands it waited for, as with the time
+     * prefix
+     */
+    struct rusage usage;
+};
+
+/**
+ * Serve command lines on a UNIX domain socket bound to a path, replacing a
+ * socket left there by an earlier server. A pool of workers forked from the
+ * shell accept connections and run the requests of each connection in turn,
+ * and the shell replaces any worker which exits (a request which runs exit
+ * still gets its reply first). Each request is executed with run_string, so it
+ * may hold several lines, in the working directory of the client. Only the
+ * caches of command lines and command locations and the built-ins loaded with
+ * enable persist from one request to the next in the same worker: once a
+ * request has started its queued jobs, its jobs are forgotten, and the
+ * worker's working directory, variables, and options are restored before the
+ * next request
+ * @param workers The number of workers, which bounds the number of command
+ * lines running at once
+ * @return -1 with errno set if the socket can't be set up, and otherwise
+ * doesn't return
+ */
+int server_run(const char *path, int workers);
+
+/**
+ * Connect to a server
+ * @return The socket, or -1 with errno set on failure
+ */
+int server_connect(const char *path);
+
+/**
+ * Run a command line in a server with the standard input, output, and error
+ * of the calling process, and wait for it to finish
+ * @param usage Set to the resources used by the command line if not NULL
+ * @return The exit status of the command line, or -1 with errno set if the
+ * request failed
+ */
+int server_request(int sock, const char *line, size_t len,
+                   struct rusage *usage);
+
+#endif /* SERVER_H */
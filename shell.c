@@ -0,0 +1,496 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "arena.h"
+#include "cache.h"
+#include "cmdline.h"
+#include "error.h"
+#include "glob.h"
+#include "jobs.h"
+#include "parser.h"
+#include "plan.h"
+#include "scan.h"
+#include "shell.h"
+#include "tokenizer.h"
+#include "trace.h"
+
+#define PS1 "$ "
+#define PS2 "> "
+/* #define DEBUG_TOKENS */
+/* #define DEBUG_PARSER */
+/* #define DEBUG_PLAN */
+
+/** The exit status of a command line which could not be parsed */
+#define SYNTAX_ERROR_STATUS 2
+
+/**
+ * The heredocs of a command line whose texts are being read, to find the line
+ * where they end
+ */
+struct Heredocs {
+    /** A copy of the command line which the tokens point into */
+    char *copy;
+
+    /** The tokens of the command line */
+    struct Token *tokens;
+
+    /** The number of tokens and the size of the array */
+    size_t num_tokens, capacity;
+
+    /** The index of the token of the heredoc whose text is being read */
+    size_t next;
+};
+
+/** Return whether a line of a given length consists only of whitespace */
+static bool is_blank(const char *line, size_t len);
+
+/**
+ * Start reading the texts of the heredocs of a command line of a given length
+ * (without its newline), which span the lines after it up to a line
+ * consisting of the word after the << operator for each one in turn
+ * @return Whether the command line has any heredocs
+ */
+static bool find_heredocs(struct Heredocs *heredocs, const char *line,
+                          size_t len);
+
+/**
+ * Advance to the next heredoc, starting from the current one
+ * @return Whether there is one
+ */
+static bool next_heredoc(struct Heredocs *heredocs);
+
+/**
+ * Check a line of a given length (without its newline) of the texts of the
+ * heredocs of a command line
+ * @return Whether it was the last line of the heredocs
+ */
+static bool heredoc_line(struct Heredocs *heredocs, const char *line,
+                         size_t len);
+
+/**
+ * Read the lines of the heredocs of a command line from a file, appending
+ * them to the command line
+ * @param line The command line, which may be resized by realloc
+ * @param capacity The size of the buffer of the command line
+ * @param len The length of the command line
+ * @param interactive Whether to prompt for each line
+ */
+static void read_heredocs(struct Heredocs *heredocs, FILE *file, char **line,
+                          size_t *capacity, size_t len, bool interactive);
+
+/**
+ * Give each heredoc of a command line its text by pointing the token after
+ * the << operator to it, terminating the texts in place
+ * @param text The lines after the command line
+ */
+static void attach_heredocs(struct Token *tokens, size_t num_tokens,
+                            char *text);
+
+/**
+ * Tokenize, parse, and compile a command line, which is modified in place,
+ * with the texts of its heredocs on the lines after it. Only the plan
+ * outlives the command line; the tokens and the tree are scratch
+ * @param arena The arena to allocate the plan from
+ * @param status Set to the exit status for the command line if there is no
+ * plan to execute
+ * @return The execution plan, or NULL if there was a parse error or no command
+ */
+static struct Plan *compile_line(struct Arena *arena, char *line,
+                                 int *status);
+
+/**
+ * Execute the lines of a buffer of a given length as command lines, splitting
+ * them in place by overwriting each newline with a null terminator (except
+ * within the texts of heredocs, which go with their command line)
+ * @param terminated Whether buf[len] may be overwritten too (otherwise the
+ * last line is copied if it lacks a newline)
+ * @return The exit status of the last command line
+ */
+static int run_buffer(char *buf, size_t len, bool terminated);
+
+/**
+ * Read and execute command lines from a file until end of file, printing a
+ * prompt before each line if the file is standard input on a terminal
+ * @return The exit status of the last command line
+ */
+static int run_stream(FILE *file);
+
+/**
+ * Show the prompt of an interactive shell and wait for the next line, starting
+ * queued jobs in the meantime
+ */
+static void prompt(void);
+
+/* See shell.h */
+int run_line(char *line)
+{
+    size_t len = strlen(line);
+    struct Plan *plan;
+    int status = 0;
+
+    /* Children which exited in the background would otherwise be zombies */
+    jobs_reap();
+
+    /* Blank lines are common in scripts and aren't worth caching */
+    if (is_blank(line, len))
+        return 0;
+
+    /* The line is recorded before tokenizing it splits it up */
+    if (tracing)
+        trace_begin("cmdline", line);
+    if (!(plan = cache_find(line, len))) {
+        struct CacheEntry *entry = cache_entry_new(line, len);
+        if (entry) {
+            if ((plan = compile_line(&entry->arena, entry->text, &status)))
+                cache_insert(entry, plan);
+            else
+                cache_entry_free(entry);
+        } else
+            plan = compile_line(&cmdline_arena, line, &status);
+    }
+
+    if (plan)
+        status = exec_cmdline(plan);
+    cache_release();
+    arena_reset(&cmdline_arena);
+    glob_forget();
+    if (tracing) {
+        trace_end();
+        trace_flush();
+    }
+    return status;
+}
+
+/* See shell.h */
+int run_stdin(void)
+{
+    return run_stream(stdin);
+}
+
+/* See above */
+static int run_stream(FILE *file)
+{
+    struct Heredocs heredocs = {NULL, NULL, 0, 0, 0};
+    char *line = NULL;
+    size_t line_len = 0;
+    ssize_t len;
+    bool interactive = file == stdin && isatty(STDIN_FILENO);
+    int status = 0;
+
+    if (interactive)
+        prompt();
+    while ((len = getline(&line, &line_len, file)) != -1) {
+        if (find_heredocs(&heredocs, line, len))
+            read_heredocs(&heredocs, file, &line, &line_len, len,
+                          interactive);
+        status = run_line(line);
+        if (interactive) {
+            jobs_notify();
+            prompt();
+        }
+    }
+    if (interactive)
+        printf("\n");
+    free(line);
+    free(heredocs.copy);
+    free(heredocs.tokens);
+    return status;
+}
+
+/* See shell.h */
+int run_string(char *str)
+{
+    return run_buffer(str, strlen(str), true);
+}
+
+/* See shell.h */
+int run_file(const char *path)
+{
+    struct stat st;
+    FILE *file;
+    char *buf;
+    int fd, status;
+
+    /* The file may stay open while commands run, which mustn't inherit it */
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+        error(0, errno, "%s", path);
+        return 127;
+    }
+    if (fstat(fd, &st) == -1) {
+        error(0, errno, "%s", path);
+        close(fd);
+        return 127;
+    }
+
+    /* Pipes and terminals can't be mapped, so they are read line by line */
+    if (!S_ISREG(st.st_mode)) {
+        if (!(file = fdopen(fd, "r"))) {
+            error(0, errno, "%s", path);
+            close(fd);
+            return 126;
+        }
+        status = run_stream(file);
+        if (ferror(file)) {
+            error(0, errno, "%s", path);
+            status = 126;
+        }
+        fclose(file);
+        return status;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    /*
+     * The mapping is private and writable because the lines are split and
+     * tokenized in place; only the pages that are written to get copied
+     */
+    buf = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buf == MAP_FAILED) {
+        error(0, errno, "%s", path);
+        return 126;
+    }
+    madvise(buf, st.st_size, MADV_SEQUENTIAL);
+
+    status = run_buffer(buf, st.st_size, false);
+    munmap(buf, st.st_size);
+    return status;
+}
+
+/* See above */
+static bool is_blank(const char *line, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        if (!char_is(line[i], CHAR_SPACE))
+            return false;
+    }
+    return true;
+}
+
+/* See above */
+static bool find_heredocs(struct Heredocs *heredocs, const char *line,
+                          size_t len)
+{
+    ssize_t num_tokens;
+
+    /* Most command lines can be ruled out without tokenizing them */
+    if (!memmem(line, len, "<<", 2))
+        return false;
+
+    free(heredocs->copy);
+    if (!(heredocs->copy = strndup(line, len)))
+        error(1, errno, "fatal error");
+    /* Errors are reported when the command line is tokenized to run it */
+    num_tokens = tokenize_quietly(&cmdline_arena, &heredocs->tokens,
+                                  &heredocs->capacity, heredocs->copy);
+    heredocs->num_tokens = num_tokens == -1 ? 0 : num_tokens;
+    heredocs->next = 0;
+    return next_heredoc(heredocs);
+}
+
+/* See above */
+static bool next_heredoc(struct Heredocs *heredocs)
+{
+    struct Token *tokens = heredocs->tokens;
+
+    for (; heredocs->next + 1 < heredocs->num_tokens; ++heredocs->next) {
+        if (tokens[heredocs->next].op == OP_HEREDOC &&
+            tokens[heredocs->next + 1].op == OP_NONE)
+            return true;
+    }
+    return false;
+}
+
+/* See above */
+static bool heredoc_line(struct Heredocs *heredocs, const char *line,
+                         size_t len)
+{
+    struct Token *delimiter = &heredocs->tokens[heredocs->next + 1];
+
+    if (len != delimiter->len || memcmp(line, delimiter->token, len) != 0)
+        return false;
+    heredocs->next += 2;
+    return !next_heredoc(heredocs);
+}
+
+/* See above */
+static void read_heredocs(struct Heredocs *heredocs, FILE *file, char **line,
+                          size_t *capacity, size_t len, bool interactive)
+{
+    char *next = NULL;
+    size_t next_capacity = 0;
+    ssize_t next_len;
+
+    if (interactive)
+        printf("%s", PS2);
+    while ((next_len = getline(&next, &next_capacity, file)) != -1) {
+        /* The buffer doubles so that long texts are copied a few times */
+        if (len + next_len >= *capacity) {
+            *capacity = 2 * (len + next_len + 1);
+            if (!(*line = realloc(*line, *capacity)))
+                error(1, errno, "fatal error");
+        }
+        memcpy(*line + len, next, next_len + 1);
+        len += next_len;
+
+        if (next[next_len - 1] == '\n')
+            --next_len;
+        if (heredoc_line(heredocs, next, next_len))
+            break;
+        if (interactive)
+            printf("%s", PS2);
+    }
+    free(next);
+}
+
+/* See above */
+static void attach_heredocs(struct Token *tokens, size_t num_tokens,
+                            char *text)
+{
+    for (size_t i = 0; i + 1 < num_tokens; ++i) {
+        struct Token *delimiter = &tokens[i + 1];
+        char *p = text;
+
+        if (tokens[i].op != OP_HEREDOC || delimiter->op != OP_NONE)
+            continue;
+        /* The text replaces the delimiter, and is never expanded */
+        delimiter->raw = NULL;
+
+        /* The text ends before the line with the delimiter, if there is one */
+        for (;;) {
+            char *newline = strchrnul(p, '\n');
+
+            if (newline - p == delimiter->len &&
+                memcmp(p, delimiter->token, delimiter->len) == 0) {
+                delimiter->token = text;
+                delimiter->len = p - text;
+                text = *newline ? newline + 1 : newline;
+                *p = '\0';
+                break;
+            } else if (!*newline) {
+                error(0, 0, "warning: heredoc delimited by end of file "
+                      "(wanted `%s')", delimiter->token);
+                delimiter->token = text;
+                delimiter->len = newline - text;
+                text = newline;
+                break;
+            }
+            p = newline + 1;
+        }
+    }
+}
+
+/* See above */
+static struct Plan *compile_line(struct Arena *arena, char *line,
+                                 int *status)
+{
+    static struct Token *tokens = NULL;
+    static size_t tokens_len = 0;
+    struct SyntaxTree *tree;
+    struct Plan *plan;
+    ssize_t tokens_read;
+    char *text = strchrnul(line, '\n');
+    uint64_t start = trace_start();
+
+    *status = SYNTAX_ERROR_STATUS;
+    if (*text)
+        *text++ = '\0';
+    tokens_read = tokenize(arena, &tokens, &tokens_len, line);
+    if (tracing)
+        trace_span("tokenize", NULL, start);
+    if (tokens_read == -1)
+        return NULL;
+    attach_heredocs(tokens, tokens_read, text);
+#ifdef DEBUG_TOKENS
+    print_tokens(tokens_read, tokens);
+#endif
+
+    start = trace_start();
+    tree = parse(&cmdline_arena, tokens_read, tokens);
+    if (tracing)
+        trace_span("parse", NULL, start);
+    if (!tree) {
+        if (tokens_read == 0)
+            *status = 0;
+        return NULL;
+    }
+#ifdef DEBUG_PARSER
+    print_tree(tree);
+#endif
+
+    start = trace_start();
+    plan = compile(arena, tree);
+    if (tracing)
+        trace_span("compile", NULL, start);
+#ifdef DEBUG_PLAN
+    print_plan(plan);
+#endif
+    return plan;
+}
+
+/* See above */
+static int run_buffer(char *buf, size_t len, bool terminated)
+{
+    struct Heredocs heredocs = {NULL, NULL, 0, 0, 0};
+    char *p = buf, *end = buf + len;
+    int status = 0;
+
+    while (p < end) {
+        char *newline = memchr(p, '\n', end - p);
+
+        /* The texts of heredocs are kept with their command line */
+        if (newline && find_heredocs(&heredocs, p, newline - p)) {
+            bool ended = false;
+
+            while (!ended && newline && newline + 1 < end) {
+                char *next = newline + 1;
+                newline = memchr(next, '\n', end - next);
+                ended = heredoc_line(&heredocs, next,
+                                     (newline ? newline : end) - next);
+            }
+            /* Otherwise they run to the end of the buffer */
+            if (!ended)
+                newline = NULL;
+        }
+
+        if (newline) {
+            *newline = '\0';
+            status = run_line(p);
+            p = newline + 1;
+        } else if (terminated) {
+            *end = '\0';
+            status = run_line(p);
+            break;
+        } else {
+            /* There is nowhere to put the null terminator of the last line */
+            char *last = strndup(p, end - p);
+            if (!last)
+                error(1, errno, "fatal error");
+            status = run_line(last);
+            free(last);
+            break;
+        }
+    }
+    free(heredocs.copy);
+    free(heredocs.tokens);
+    return status;
+}
+
+/* See above */
+static void prompt(void)
+{
+    printf("%s", PS1);
+    fflush(stdout);
+    /* A terminal gives a line per read, so nothing is left in stdin's buffer */
+    jobs_wait_input(STDIN_FILENO);
+}
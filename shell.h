@@ -0,0 +1,33 @@
+#ifndef SHELL_H
+#define SHELL_H
+
+/**
+ * Tokenize, parse, and execute a single command line, which is modified in
+ * place. The texts of its heredocs, if any, follow it on the next lines
+ * @return The exit status of the command line, or 2 if it could not be parsed
+ */
+int run_line(char *line);
+
+/**
+ * Read and execute command lines from standard input until end of file,
+ * printing a prompt before each line if standard input is a terminal
+ * @return The exit status of the last command line
+ */
+int run_stdin(void);
+
+/**
+ * Execute each line of a string as a command line, modifying the string in
+ * place
+ * @return The exit status of the last command line
+ */
+int run_string(char *str);
+
+/**
+ * Execute each line of a script file as a command line. A regular file is
+ * mapped into memory rather than read line by line, while any other file (such
+ * as a pipe) is read like standard input
+ * @return The exit status of the last command line
+ */
+int run_file(const char *path);
+
+#endif /* SHELL_H */
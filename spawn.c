@@ -0,0 +1,362 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "error.h"
+#include "path.h"
+#include "spawn.h"
+#include "trace.h"
+#include "vars.h"
+
+#ifndef DEFAULT_SPAWN_BACKEND
+#define DEFAULT_SPAWN_BACKEND "posix_spawn"
+#endif
+
+/**
+ * The size of the stack of a process launched by the vfork backend, not
+ * counting the room for the arguments, which execvp may copy onto the stack if
+ * it falls back to searching PATH
+ */
+#define VFORK_STACK_SIZE (64 * 1024)
+
+/**
+ * A function launching a command, given the path of its executable and its
+ * arguments, in a new process
+ */
+typedef pid_t (*spawn_function)(const char *, char **,
+                                const struct SpawnAction *, size_t);
+
+/** The arguments passed to a process launched by the vfork backend */
+struct VforkArgs {
+    /** The path of the executable and the arguments given to spawn */
+    const char *path;
+    char **argv;
+    const struct SpawnAction *actions;
+    size_t num_actions;
+
+    /** The signal mask of the shell, to be restored in the new process */
+    sigset_t mask;
+
+    /**
+     * Set by the new process to the error number if the command couldn't be
+     * executed, which the shell sees because their memory is shared
+     */
+    int err;
+};
+
+/** Launch a command with fork and then execve */
+static pid_t spawn_fork(const char *path, char **argv,
+                        const struct SpawnAction *actions,
+                        size_t num_actions);
+
+/**
+ * Launch a command with clone, sharing the memory of the shell and suspending
+ * the shell until the command is executed, like vfork
+ */
+static pid_t spawn_vfork(const char *path, char **argv,
+                         const struct SpawnAction *actions,
+                         size_t num_actions);
+
+/** Launch a command with posix_spawn */
+static pid_t spawn_posix(const char *path, char **argv,
+                         const struct SpawnAction *actions,
+                         size_t num_actions);
+
+/**
+ * Launch a script without a #! line with /bin/sh, as execvp does for a file
+ * the kernel can't execute, which posix_spawn leaves to its caller
+ * @return Zero on success, or the error number
+ */
+static int spawn_script(pid_t *pid, const char *path, char **argv,
+                        const posix_spawn_file_actions_t *file_actions);
+
+/**
+ * Select the default backend and then launch the command with it (used as the
+ * initial value of spawn_impl)
+ */
+static pid_t spawn_resolve(const char *path, char **argv,
+                           const struct SpawnAction *actions,
+                           size_t num_actions);
+
+/** The function run by a process launched by the vfork backend */
+static int vfork_child(void *arg);
+
+/**
+ * Apply actions to the file descriptors of the current process
+ * @return Zero on success, -1 with errno set on failure
+ */
+static int apply_actions(const struct SpawnAction *actions,
+                         size_t num_actions);
+
+/**
+ * Execute a command at the path it was hashed at, or leave it to execvp if
+ * it's no longer there or is a script to be run by /bin/sh
+ * @return -1 with errno set, if the command couldn't be executed
+ */
+static int exec_command(const char *path, char **argv);
+
+/** Print an error message for a command which couldn't be executed */
+static void exec_failed(const char *name, int err);
+
+/** The backends, by name */
+static const struct {
+    const char *name;
+    spawn_function func;
+} backends[] = {
+    {"fork", spawn_fork},
+    {"vfork", spawn_vfork},
+    {"posix_spawn", spawn_posix},
+};
+
+/** The backend in use */
+static spawn_function spawn_impl = spawn_resolve;
+
+/* See spawn.h */
+pid_t spawn(char **argv, const struct SpawnAction *actions,
+            size_t num_actions)
+{
+    const char *path = path_lookup(argv[0]);
+    uint64_t start = trace_start();
+    pid_t pid;
+
+    if (!path) {
+        exec_failed(argv[0], ENOENT);
+        errno = ENOENT;
+        return -1;
+    }
+    /* The backends pass environ, which may not be rebuilt in a vfork child */
+    vars_environ();
+    pid = spawn_impl(path, argv, actions, num_actions);
+    if (tracing && pid != -1) {
+        trace_span("spawn", argv[0], start);
+        trace_child(pid, argv[0]);
+    }
+    return pid;
+}
+
+/* See spawn.h */
+void spawn_exec(char **argv)
+{
+    const char *path = path_lookup(argv[0]);
+    int err = ENOENT;
+
+    if (path) {
+        if (tracing)
+            trace_exec(argv[0]);
+        vars_environ();
+        exec_command(path, argv);
+        err = errno;
+    }
+    exec_failed(argv[0], err);
+    exit(err);
+}
+
+/* See spawn.h */
+int spawn_select(const char *name)
+{
+    for (int i = 0; i < sizeof(backends) / sizeof(*backends); ++i) {
+        if (strcmp(backends[i].name, name) == 0) {
+            spawn_impl = backends[i].func;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* See above */
+static pid_t spawn_resolve(const char *path, char **argv,
+                           const struct SpawnAction *actions,
+                           size_t num_actions)
+{
+    if (spawn_select(DEFAULT_SPAWN_BACKEND) == -1)
+        spawn_impl = spawn_posix;
+    return spawn_impl(path, argv, actions, num_actions);
+}
+
+/* See above */
+static pid_t spawn_fork(const char *path, char **argv,
+                        const struct SpawnAction *actions,
+                        size_t num_actions)
+{
+    pid_t pid;
+
+    fflush(stdout);
+    if ((pid = fork()) == -1)
+        error(errno, errno, "error");
+    if (pid == 0) {
+        int err;
+        if (apply_actions(actions, num_actions) == 0)
+            exec_command(path, argv);
+        err = errno;
+        exec_failed(argv[0], err);
+        /* The exit handlers of the shell must not run in the child */
+        _exit(err);
+    }
+    return pid;
+}
+
+/* See above */
+static pid_t spawn_vfork(const char *path, char **argv,
+                         const struct SpawnAction *actions,
+                         size_t num_actions)
+{
+    static char *stack = NULL;
+    static size_t stack_size = 0;
+    struct VforkArgs args = {path, argv, actions, num_actions};
+    size_t argc = 0, size;
+    sigset_t all;
+    pid_t pid;
+
+    /* The stack is reused and only grows for commands with many arguments */
+    while (argv[argc])
+        ++argc;
+    size = VFORK_STACK_SIZE + sizeof(char *) * (argc + 1);
+    if (size > stack_size) {
+        if (stack)
+            munmap(stack, stack_size);
+        stack = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if (stack == MAP_FAILED)
+            error(1, errno, "fatal error");
+        stack_size = size;
+    }
+
+    /*
+     * Signals are blocked until the new process has reset the handlers, which
+     * must never run in it because it shares the memory of the shell
+     */
+    sigfillset(&all);
+    sigprocmask(SIG_BLOCK, &all, &args.mask);
+    pid = clone(vfork_child, stack + stack_size,
+                CLONE_VM | CLONE_VFORK | SIGCHLD, &args);
+    if (pid == -1)
+        error(errno, errno, "error");
+    sigprocmask(SIG_SETMASK, &args.mask, NULL);
+
+    if (args.err) {
+        waitpid(pid, NULL, 0);
+        exec_failed(argv[0], args.err);
+        errno = args.err;
+        return -1;
+    }
+    return pid;
+}
+
+/* See above */
+static int vfork_child(void *arg)
+{
+    struct VforkArgs *args = arg;
+    struct sigaction sa;
+
+    for (int sig = 1; sig < NSIG; ++sig) {
+        if (sigaction(sig, NULL, &sa) == 0 && sa.sa_handler != SIG_DFL &&
+            sa.sa_handler != SIG_IGN) {
+            signal(sig, SIG_DFL);
+        }
+    }
+    sigprocmask(SIG_SETMASK, &args->mask, NULL);
+
+    if (apply_actions(args->actions, args->num_actions) == 0)
+        exec_command(args->path, args->argv);
+    args->err = errno;
+    _exit(127);
+}
+
+/* See above */
+static pid_t spawn_posix(const char *path, char **argv,
+                         const struct SpawnAction *actions,
+                         size_t num_actions)
+{
+    posix_spawn_file_actions_t file_actions;
+    char *moved = NULL;
+    pid_t pid;
+    int err;
+
+    posix_spawn_file_actions_init(&file_actions);
+    for (size_t i = 0; i < num_actions; ++i) {
+        if (actions[i].type == SPAWN_DUP2) {
+            posix_spawn_file_actions_adddup2(&file_actions, actions[i].fd,
+                                             actions[i].newfd);
+        } else
+            posix_spawn_file_actions_addclose(&file_actions, actions[i].fd);
+    }
+    err = posix_spawn(&pid, path, &file_actions, NULL, argv, environ);
+    if (err == ENOENT && path != argv[0]) {
+        /* The command has moved since it was hashed */
+        if ((path = moved = path_search(argv[0])))
+            err = posix_spawn(&pid, path, &file_actions, NULL, argv, environ);
+    }
+    if (err == ENOEXEC)
+        err = spawn_script(&pid, path, argv, &file_actions);
+    posix_spawn_file_actions_destroy(&file_actions);
+    free(moved);
+
+    if (err) {
+        exec_failed(argv[0], err);
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+/* See above */
+static int spawn_script(pid_t *pid, const char *path, char **argv,
+                        const posix_spawn_file_actions_t *file_actions)
+{
+    size_t argc = 0;
+    char **sh_argv;
+    int err;
+
+    while (argv[argc])
+        ++argc;
+    if (!(sh_argv = malloc(sizeof(*sh_argv) * (argc + 2))))
+        error(1, errno, "fatal error");
+    sh_argv[0] = "/bin/sh";
+    sh_argv[1] = (char *)path;
+    /* The rest of the arguments, along with the terminating NULL */
+    memcpy(&sh_argv[2], &argv[1], sizeof(*argv) * argc);
+    err = posix_spawn(pid, sh_argv[0], file_actions, NULL, sh_argv, environ);
+    free(sh_argv);
+    return err;
+}
+
+/* See above */
+static int apply_actions(const struct SpawnAction *actions,
+                         size_t num_actions)
+{
+    for (size_t i = 0; i < num_actions; ++i) {
+        if (actions[i].type == SPAWN_DUP2) {
+            if (dup2(actions[i].fd, actions[i].newfd) == -1)
+                return -1;
+        } else
+            close(actions[i].fd);
+    }
+    return 0;
+}
+
+/* See above */
+static int exec_command(const char *path, char **argv)
+{
+    execve(path, argv, environ);
+    if ((errno == ENOENT && path != argv[0]) || errno == ENOEXEC)
+        execvp(argv[0], argv);
+    return -1;
+}
+
+/* See above */
+static void exec_failed(const char *name, int err)
+{
+    if (err == ENOENT)
+        error(0, 0, "command not found: %s", name);
+    else
+        error(0, err, "error");
+}
@@ -0,0 +1,57 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <stddef.h>
+
+#include <sys/types.h>
+
+/** Constants for the types of actions on file descriptors */
+enum SpawnActionType {
+    SPAWN_DUP2, /**< Duplicate fd onto newfd */
+    SPAWN_CLOSE /**< Close fd */
+};
+
+/**
+ * An action on the file descriptors of a new process, applied in order before
+ * the command is executed
+ */
+struct SpawnAction {
+    /** The type of action */
+    enum SpawnActionType type;
+
+    /** The file descriptor to act on */
+    int fd;
+
+    /** The file descriptor to duplicate onto for SPAWN_DUP2 */
+    int newfd;
+};
+
+/**
+ * Launch an external command, looking it up in the hash table of commands, in
+ * a new process whose file descriptors are first changed by the given actions.
+ * If the command can't be executed, an error message is printed, either by the
+ * new process, which then exits with the error number as its status, or by the
+ * shell
+ * @return The process ID of the new process, or -1 with errno set if no
+ * process was left running
+ */
+pid_t spawn(char **argv, const struct SpawnAction *actions,
+            size_t num_actions);
+
+/**
+ * Replace the current process with an external command, looking it up like
+ * spawn. If the command can't be executed, an error message is printed and
+ * the process exits with the error number as its status
+ */
+void spawn_exec(char **argv) __attribute__((noreturn));
+
+/**
+ * Select the way new processes are launched by name: "fork" (fork then exec),
+ * "vfork" (clone sharing the memory of the shell until the exec), or
+ * "posix_spawn". The default is DEFAULT_SPAWN_BACKEND, which may be given at
+ * build time, and otherwise "posix_spawn"
+ * @return Zero on success, -1 if there is no such backend
+ */
+int spawn_select(const char *name);
+
+#endif /* SPAWN_H */
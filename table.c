@@ -0,0 +1,66 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "table.h"
+
+/** The initial number of slots in a table */
+#define INITIAL_SLOTS 64
+
+/** Return the home slot of a hash */
+static inline size_t home_slot(const struct Table *table, uint64_t hash);
+
+/* See table.h */
+void table_reserve(struct Table *table, bool (*is_full)(const void *slot))
+{
+    char *old_slots = table->slots;
+    size_t old_num_slots = table->num_slots;
+
+    if (2 * (table->num_full + 1) <= table->num_slots)
+        return;
+    table->num_slots = old_num_slots ? 2 * old_num_slots : INITIAL_SLOTS;
+    if (!(table->slots = calloc(table->num_slots, table->slot_size)))
+        error(1, errno, "fatal error");
+
+    /* The keys are all different, so each goes to the first empty slot */
+    for (size_t i = 0; i < old_num_slots; ++i) {
+        const char *slot = old_slots + i * table->slot_size;
+        size_t mask = table->num_slots - 1, j;
+
+        if (!is_full(slot))
+            continue;
+        for (j = home_slot(table, *(const uint64_t *)slot);
+             is_full(table_slot(table, j)); j = (j + 1) & mask)
+            ;
+        memcpy(table_slot(table, j), slot, table->slot_size);
+    }
+    free(old_slots);
+}
+
+/* See table.h */
+void table_remove(struct Table *table, void *slot,
+                  bool (*is_full)(const void *slot))
+{
+    size_t mask = table->num_slots - 1;
+    size_t hole = ((char *)slot - (char *)table->slots) / table->slot_size;
+
+    for (size_t i = (hole + 1) & mask; is_full(table_slot(table, i));
+         i = (i + 1) & mask) {
+        /* The slot can fill the hole if its home isn't after the hole */
+        const void *next = table_slot(table, i);
+        size_t home = home_slot(table, *(const uint64_t *)next);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            memcpy(table_slot(table, hole), next, table->slot_size);
+            hole = i;
+        }
+    }
+    memset(table_slot(table, hole), 0, table->slot_size);
+    --table->num_full;
+}
+
+/* See above */
+static inline size_t home_slot(const struct Table *table, uint64_t hash)
+{
+    return hash & (table->num_slots - 1);
+}
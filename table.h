@@ -0,0 +1,73 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A hash table which is open-addressed with linear probing and kept at most
+ * half full. Its slots are structs starting with the uint64_t hash of their
+ * key, and an empty slot is all zeros. Its functions take a function telling
+ * whether a slot is full, which can be inlined into table_find
+ */
+struct Table {
+    /** The slots */
+    void *slots;
+
+    /** The size of a slot */
+    size_t slot_size;
+
+    /** The number of slots (zero or a power of two) */
+    size_t num_slots;
+
+    /**
+     * The number of full slots, which the user counts up when filling an
+     * empty one
+     */
+    size_t num_full;
+};
+
+/** Return the slot with a given index */
+static inline void *table_slot(const struct Table *table, size_t index)
+{
+    return (char *)table->slots + index * table->slot_size;
+}
+
+/**
+ * Find the slot of a key, or the empty slot where it would be inserted if it
+ * isn't in the table, which must have slots
+ * @param matches Return whether a full slot with the hash of the key holds
+ * the key
+ */
+static inline void *table_find(const struct Table *table, uint64_t hash,
+                               bool (*is_full)(const void *slot),
+                               bool (*matches)(const void *slot,
+                                               const void *key),
+                               const void *key)
+{
+    size_t mask = table->num_slots - 1;
+
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        void *slot = table_slot(table, i);
+        if (!is_full(slot) ||
+            (*(const uint64_t *)slot == hash && matches(slot, key)))
+            return slot;
+    }
+}
+
+/**
+ * Make room for one more slot to be filled, doubling the number of slots if
+ * the table would be more than half full
+ */
+void table_reserve(struct Table *table, bool (*is_full)(const void *slot));
+
+/**
+ * Empty a full slot, moving the slots after it in its run of full slots back
+ * so that none of them is cut off from its home slot (which makes tombstones
+ * unnecessary)
+ */
+void table_remove(struct Table *table, void *slot,
+                  bool (*is_full)(const void *slot));
+
+#endif /* TABLE_H */
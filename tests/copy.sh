@@ -0,0 +1,29 @@
+#!/bin/sh
+#
+# Tests of the cat and tee built-ins, run by `make check'. Each scratch
+# directory holds a file named big (a few MiB of random data, more than a pipe
+# holds at once), and the copies are compared with cmp, so the cases expect no
+# output.
+
+. "$(dirname "$0")/lib.sh"
+head -c 5000000 /dev/urandom > "$top/big"
+
+setup() {
+    ln "$top/big" "$dir/big"
+}
+
+check "cat between files" 'cat big > a; cmp big a' ''
+check "cat of several files" \
+    'cat big big > a; /bin/cat big big > b; cmp a b' ''
+check "cat into a pipe" 'cat big | /bin/cat > a; cmp big a' ''
+check "cat out of a pipe" 'cat < big | cat > a; cmp big a' ''
+check "tee out of a pipe into files" \
+    '/bin/cat big | tee a b > c; cmp big a && cmp big b && cmp big c' ''
+check "tee out of a pipe into a pipe" \
+    '/bin/cat big | tee a b | /bin/cat > c; cmp big a && cmp big b &&'\
+' cmp big c' ''
+check "tee appending" \
+    'echo x > a; /bin/cat big | tee -a a > b; echo x > c; /bin/cat big >> c;'\
+' cmp a c' ''
+
+finish
@@ -0,0 +1,53 @@
+#!/bin/sh
+#
+# Glob tests, run by `make check'. Each scratch directory holds the files a.c,
+# b.c, ab.c, abc, B.h, .hidden, [x and d1/f, the empty directory d2 and a
+# link l to d1, plus the names in $sorted, which share prefixes of more than
+# eight bytes so that they are sorted by several keys.
+
+. "$(dirname "$0")/lib.sh"
+
+sorted='longprefix_a longprefix_ab longprefix_b longprefixes longprefix
+longprefix_0123456789 longprefix_0123456789a longprefix_012345678
+longprefix_01234567890123 longprefix_0123456789012 longprefix_Z
+longprefix_z longprefix_0 longprefix_abcdefgh longprefix_abcdefg
+longprefix_abcdefghi longprefix_~ longprefix_-1 longprefix_.x
+longprefix_0123456789012345678901 longprefix_01234567890123456789012
+longprefix_é'
+
+setup() {
+    (cd "$dir" && touch a.c b.c ab.c abc B.h .hidden '[x' $sorted &&
+        mkdir d1 d2 && touch d1/f && ln -s d1 l)
+}
+
+check "star" 'echo *.c' 'a.c ab.c b.c'
+check "star in the middle" 'echo a*c' 'a.c ab.c abc'
+check "stars" 'echo **.* *b*c' 'B.h a.c ab.c b.c longprefix_.x ab.c abc b.c'
+check "question mark" 'echo ?.? a??' 'B.h a.c b.c a.c abc'
+check "range" 'echo [a-b].c [A-Z].*' 'a.c b.c B.h'
+check "bracket expression" 'echo [ab]b[.c]* [.a]*' 'ab.c abc a.c ab.c abc'
+check "negated bracket expression" 'echo [^a].c [^ab]*.?' \
+    'b.c B.h longprefix_.x'
+check "bracket first in a bracket expression" 'touch ]; echo []] [^]]?c' \
+    '] a.c abc b.c'
+check "unclosed bracket" 'echo [x [' '[x ['
+check "dotfiles" 'echo *hid* .h* .*' '*hid* .hidden .hidden'
+check "trailing slash" 'echo */ d*/' 'd1/ d2/ l/ d1/ d2/'
+check "no match" 'echo *.o [z]* z?' '*.o [z]* z?'
+check "quoted patterns" "echo '*.c' \"?.c\"" '*.c ?.c'
+check "literal component after a magic one" 'echo d*/f */f x*/f' \
+    'd1/f d1/f l/f x*/f'
+check "missing literal component" 'echo d*/g' 'd*/g'
+check "magic component after a literal one" 'echo d1/* ./d*' \
+    'd1/f ./d1 ./d2'
+check "several directories" 'touch d2/g; echo */? d?/*' \
+    'd1/f d2/g l/f d1/f d2/g'
+check "cached listings" 'set -g on; echo *.c; touch c.c; echo *.c' \
+    'a.c ab.c b.c
+a.c ab.c b.c c.c'
+check "sort order" 'echo longprefix*' \
+    "$(printf '%s\n' $sorted | LC_ALL=C sort | tr '\n' ' ' | sed 's/ $//')"
+check "sort order of paths" 'touch d2/longprefix_a; echo */longprefix* l*_a' \
+    'd2/longprefix_a longprefix_a'
+
+finish
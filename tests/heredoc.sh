@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# Heredoc tests, run by `make check'. Each case runs a script both with
+# `osh -c' and on the standard input of osh, which reads heredocs differently.
+
+. "$(dirname "$0")/lib.sh"
+
+# check NAME SCRIPT EXPECTED, both with -c and on standard input
+check() {
+    scratch
+    verdict "$1 (-c)" "$(cd "$dir" && "$OSH" -c "$2" 2>&1)" "$3"
+    scratch
+    verdict "$1 (stdin)" "$(cd "$dir" && printf '%s\n' "$2" | "$OSH" 2>&1)" \
+        "$3"
+}
+
+check "heredoc" 'cat <<EOF
+one
+two
+EOF
+echo after' 'one
+two
+after'
+check "heredocs of one line" 'cat <<A; cat <<B
+one
+A
+two
+B' 'one
+two'
+check "heredoc into a pipeline" 'cat <<EOF | cat
+x
+EOF' 'x'
+check "here-string" 'cat <<< "a b"' 'a b'
+check "errors are reported once" 'echo "a <<b
+echo after' 'osh: error: Unclosed quote
+after'
+check "bad substitution is reported once" 'echo ${ <<b
+echo after' 'osh: error: Bad substitution
+after'
+
+finish
@@ -0,0 +1,66 @@
+#!/bin/sh
+#
+# Job limit tests, run by `make check'. Each case runs a command line with
+# `osh -j 2 -c' (serving a jobserver with two slots) and compares its output,
+# and then the file log once the shell has exited, with the expected text.
+
+. "$(dirname "$0")/lib.sh"
+
+# check NAME LINE EXPECTED [EXPECTED_LOG], in a jobserver with two slots
+check() {
+    scratch
+    actual=$(cd "$dir" && "$OSH" -j 2 -c "$2" 2>&1)
+    # Jobs started as the shell exits may still be running
+    sleep 0.5
+    verdict "$1" "$actual
+log: $(cat "$dir/log" 2>/dev/null)" "$3
+log: $4"
+}
+
+check "jobs on one line are limited" \
+    'set -j 2; sleep 1 & sleep 1 & sleep 1 & sleep 1 & jobs; disown %1 %2' \
+    '[1]  Running    sleep 1
+[2]  Running    sleep 1
+[3]  Queued     sleep 1
+[4]+ Queued     sleep 1'
+check "separators apply to the command before them" \
+    'set -j 1; echo a > log; sh -c "sleep 0.2; echo b >> log" & jobs' \
+    '[1]+ Running    sh -c sleep 0.2; echo b >> log' 'a
+b'
+check "queued jobs start during a foreground command" \
+    'set -j 1
+sleep 0.2 &
+echo queued > log &
+sleep 1; cat log' 'queued' 'queued'
+check "queued jobs start before the shell exits" \
+    'set -j 1
+sh -c "sleep 0.2; echo a >> log" &
+sh -c "echo b >> log" &' '' 'a
+b'
+check "queued jobs keep the state they were queued with" \
+    'set -j 1; export FOO=a; sleep 0.3 & echo queued & pwd >> log &
+printenv FOO >> log & cd /; export FOO=leak; wait > /dev/null' \
+    'queued' "$top/$((count + 1))
+a"
+check "nested jobs take tokens from the jobserver" \
+    'set -j 0; sleep 1 & (sleep 1 & sleep 1 & jobs; disown %1 %2) & wait' \
+    '[1]  Queued     sleep 1
+[2]+ Queued     sleep 1'
+check "unlimited" 'set -j 0; sleep 1 & sleep 1 & jobs; disown %1 %2' \
+    '[1]  Running    sleep 1
+[2]+ Running    sleep 1'
+check "killed command fails" \
+    "sh -c 'kill -9 \$\$' && echo x; sh -c 'kill -9 \$\$' || echo failed" \
+    'failed'
+check "killed jobs" \
+    "sh -c 'kill -9 \$\$' & sh -c 'kill -SEGV \$\$' & sleep 0.3; jobs" \
+    '[1]  Killed     sh -c kill -9 $$
+[2]+ Segmentation fault sh -c kill -SEGV $$'
+check "waiting for a killed job fails" \
+    "sh -c 'sleep 0.1; kill -9 \$\$' & wait %1 || echo failed" 'failed'
+check "foreground job killed" \
+    "sh -c 'sleep 0.1; kill -9 \$\$' & fg %1 || echo failed" \
+    'sh -c sleep 0.1; kill -9 $$
+failed'
+
+finish
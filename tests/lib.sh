@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# The harness shared by the tests, which each script in tests/ sources before
+# its cases. A case runs in a scratch directory of its own under a temporary
+# directory which is removed on exit, and compares everything the shell under
+# test (OSH, set by `make check') writes with the expected text. A script may
+# define setup to fill each scratch directory, and ends with finish.
+
+OSH=${OSH:-$(pwd)/build/osh}
+top=$(mktemp -d) || exit 1
+trap 'rm -rf "$top"' EXIT
+failed=0
+count=0
+
+# Fill the scratch directory dir of a case, which scripts may redefine
+setup() {
+    :
+}
+
+# Create the scratch directory of the next case and set dir to it
+scratch() {
+    count=$((count + 1))
+    dir=$top/$count
+    mkdir "$dir" && setup
+}
+
+# verdict NAME ACTUAL EXPECTED: report whether the output of a case matched
+verdict() {
+    if [ "$2" = "$3" ]; then
+        echo "PASS: $1"
+    else
+        echo "FAIL: $1"
+        printf 'expected:\n%s\nactual:\n%s\n' "$3" "$2"
+        failed=$((failed + 1))
+    fi
+}
+
+# check NAME LINE EXPECTED: run a line with `osh -c' in a scratch directory
+check() {
+    scratch
+    verdict "$1" "$(cd "$dir" && "$OSH" -c "$2" 2>&1)" "$3"
+}
+
+# check_sh NAME COMMAND EXPECTED: run a command with sh in a scratch directory,
+# for cases which need more than `osh -c'
+check_sh() {
+    scratch
+    verdict "$1" "$(cd "$dir" && eval "$2" 2>&1)" "$3"
+}
+
+# Report how many cases passed, and fail if any didn't
+finish() {
+    echo "$((count - failed)) of $count passed"
+    [ "$failed" -eq 0 ]
+}
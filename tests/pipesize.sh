@@ -0,0 +1,83 @@
+#!/bin/sh
+#
+# Pipe capacity tests, run by `make check'. The cases build a command which
+# writes the capacity of the pipe on its standard input to a file (after
+# sleeping for a number of seconds if given one) and then drains the pipe.
+# They assume pages of 4 KiB, so that the kernel's default capacity is 64 KiB.
+
+. "$(dirname "$0")/lib.sh"
+
+capacity=$top/capacity
+
+cat > "$top/capacity.c" << 'EOF'
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+int main(int argc, char **argv)
+{
+    char buf[65536];
+    FILE *file;
+
+    if (argc > 2)
+        usleep(atof(argv[2]) * 1000000);
+    if (argc < 2 || !(file = fopen(argv[1], "w")))
+        return 1;
+    fprintf(file, "%d\n", fcntl(STDIN_FILENO, F_GETPIPE_SZ));
+    fclose(file);
+    while (read(STDIN_FILENO, buf, sizeof(buf)) > 0)
+        ;
+    return 0;
+}
+EOF
+${CC:-cc} -o "$capacity" "$top/capacity.c" || exit 1
+
+check "default capacity" "true | $capacity p; cat p" '65536'
+check "pipesize" "pipesize 256k true | $capacity p; cat p" '262144'
+check "pipesize in bytes and MiB" \
+    "pipesize 131072,1m true | $capacity p1 | $capacity p2; cat p1 p2" \
+    '131072
+1048576'
+check "last pipesize applies to the rest" \
+    "pipesize 0,128k true | $capacity p1 | $capacity p2 | $capacity p3
+cat p1 p2 p3" '65536
+131072
+131072'
+check "pipesize rounded up to pages" "pipesize 5000 true | $capacity p; cat p" \
+    '8192'
+check "pipesize only applies to its pipeline" \
+    "pipesize 256k true | $capacity p1 && true | $capacity p2; cat p1 p2" \
+    '262144
+65536'
+check "invalid pipesize" 'pipesize 12q true | true' \
+    "osh: parse error near \`pipesize'"
+check "set -p" "set -p 512k; true | $capacity p1; set | grep -e -p
+pipesize 128k true | $capacity p2; cat p1 p2" 'set -p 524288
+524288
+131072'
+check "set -p auto" 'set -p auto; set -p 1q; set > log; grep -e -p log' \
+    'osh: set: invalid pipe capacity: 1q
+set -p auto'
+check_sh "pipesize auto grows a full pipe" \
+    "\"\$OSH\" -c 'pipesize auto head -c 4m /dev/zero | $capacity p 1'
+[ \$(cat p) -gt 65536 ] && echo grown" 'grown'
+check_sh "set -p auto grows a full pipe" \
+    "\"\$OSH\" -c 'set -p auto; head -c 4m /dev/zero | $capacity p 1'
+[ \$(cat p) -gt 65536 ] && echo grown" 'grown'
+check_sh "pipesize auto with a reader exiting early" \
+    "timeout 10 \"\$OSH\" -c 'pipesize auto yes | head -1'; echo \$?" 'y
+0'
+check_sh "set -p auto with a reader exiting early" \
+    "timeout 10 \"\$OSH\" -c 'set -p auto; yes | head -1; yes | cat | head -2'
+echo \$?" 'y
+y
+y
+0'
+check_sh "reader exiting before the pipe fills" \
+    "timeout 10 \"\$OSH\" -c 'set -p auto; set | grep -e -p'; echo \$?" \
+    'set -p auto
+0'
+
+finish
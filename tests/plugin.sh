@@ -0,0 +1,100 @@
+#!/bin/sh
+#
+# Plugin tests, run by `make check'. The cases build the example plugin and
+# one with built-ins which the shell must refuse, load them with `enable -f'
+# and remove them with `enable -d'.
+
+. "$(dirname "$0")/lib.sh"
+
+src=$(cd "$(dirname "$0")/.." && pwd)
+probe=$top/probe.so
+plugin=$top/test.so
+version=$(sed -n 's/^#define OSH_PLUGIN_ABI_VERSION //p' "$src/plugin.h")
+
+cat > "$top/test.c" << 'EOF'
+#include <stdio.h>
+
+#include "plugin.h"
+
+static int greet(int argc, char **argv)
+{
+    printf("hello from %s\n", argv[0]);
+    return 0;
+}
+
+const struct OshBuiltin osh_builtin_greet = {
+    OSH_PLUGIN_ABI_VERSION, "greet", greet
+};
+
+const struct OshBuiltin osh_builtin_hello = {
+    OSH_PLUGIN_ABI_VERSION, "hello", greet
+};
+
+const struct OshBuiltin osh_builtin_cd = {
+    OSH_PLUGIN_ABI_VERSION, "cd", greet
+};
+
+const struct OshBuiltin osh_builtin_future = {
+    OSH_PLUGIN_ABI_VERSION + 1, "future", greet
+};
+
+const struct OshBuiltin osh_builtin_old = {0, "old", greet};
+
+const struct OshBuiltin osh_builtin_misnamed = {
+    OSH_PLUGIN_ABI_VERSION, "other", greet
+};
+EOF
+for lib in "$probe $src/bench/plugin_probe.c" "$plugin $top/test.c"; do
+    set -- $lib
+    ${CC:-cc} -shared -fPIC -I"$src" -o "$1" "$2" || exit 1
+done
+
+check "enable -f" "enable -f $probe probe; probe . && echo found
+probe missing || echo missing" 'found
+missing'
+check "loaded built-ins are listed" "enable -f $probe probe; enable | tail -1" \
+    "enable -f $probe probe"
+check "built-in not in the plugin" \
+    "enable -f $probe nosuch probe || echo failed; probe . && echo found" \
+    "osh: enable: nosuch: not found in $probe
+failed
+found"
+check "plugin which can't be opened" "enable -f $top/none.so x || echo failed" \
+    "osh: enable: $top/none.so: cannot open shared object file: No such file \
+or directory
+failed"
+check "loaded built-ins replace each other" \
+    "enable -f $plugin greet; enable -f $plugin greet; greet
+enable | grep -c ' greet\$'" \
+    'hello from greet
+1'
+check "enable -d" "enable -f $probe probe; enable -d probe; probe ." \
+    'osh: command not found: probe'
+check "enable -d keeps the other built-ins" \
+    "enable -f $plugin greet hello; enable -f $probe probe; enable -d greet
+hello; probe . && echo found; greet" 'hello from hello
+found
+osh: command not found: greet'
+check "enable -d of a compiled-in built-in" "enable -d cd || echo failed; cd /
+pwd" 'osh: enable: cd: not a loaded builtin
+failed
+/'
+check "compiled-in built-ins can't be replaced" \
+    "enable -f $plugin cd || echo failed; cd /; pwd" \
+    'osh: enable: cd: is a compiled-in builtin
+failed
+/'
+check "newer plugin version" "enable -f $plugin future || echo failed; future" \
+    "osh: enable: future: unsupported plugin version $((version + 1))
+failed
+osh: command not found: future"
+check "plugin version 0" "enable -f $plugin old greet || echo failed; greet" \
+    'osh: enable: old: unsupported plugin version 0
+failed
+hello from greet'
+check "built-in named unlike its symbol" \
+    "enable -f $plugin misnamed || echo failed" \
+    "osh: enable: misnamed: invalid builtin in $plugin
+failed"
+
+finish
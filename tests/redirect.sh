@@ -0,0 +1,77 @@
+#!/bin/sh
+#
+# Redirection tests, run by `make check'. Each scratch directory holds a file
+# named in (containing "hello"). Built-ins run in the shell itself, so the
+# cases check that they redirect like external commands do and that the
+# shell's own file descriptors come back afterwards.
+
+. "$(dirname "$0")/lib.sh"
+
+setup() {
+    echo hello > "$dir/in"
+}
+
+# check_closed NAME FD LINE FILE EXPECTED: run with a file descriptor of the
+# shell closed and compare a file the line writes
+check_closed() {
+    scratch
+    (cd "$dir" && eval '"$OSH" -c "$3" 2>/dev/null' "$2<&-")
+    verdict "$1" "$(cat "$dir/$4" 2>&1)" "$5"
+}
+
+# Nested redirections
+check "built-in output" 'cd . > log; cat log; pwd > log; cat log' "$top/1"
+check "built-in input" 'cat < in' 'hello'
+check "built-in changes the shell" 'cd / > log && pwd' '/'
+check "descriptors restored" 'cat < in > out; echo after; cat out' \
+    'after
+hello'
+check "subshell inside redirection" \
+    '(echo inner > a; cat < in) > b; cat a; cat b' 'inner
+hello'
+check "built-in inside redirected subshell" \
+    '(cat < in > a; pwd) > b; cat a' 'hello'
+check "repeated redirections like external commands" \
+    'cat < in > a > b; /bin/cat < in > c > d; cmp a c && cmp b d && echo same' \
+    'same'
+check "last stage of a pipeline" 'echo hi | cat > out; cat < out' 'hi'
+check "pipeline into a redirected built-in" \
+    'cat < in | cat | cat > out; cat out' 'hello'
+
+# Files which can't be opened
+check "missing input file" 'cat < missing || echo failed; echo next' \
+    'osh: error: No such file or directory
+failed
+next'
+check "missing input file leaves the built-in unrun" \
+    'cd / < missing; pwd' "osh: error: No such file or directory
+$top/$((count + 1))"
+check "missing input file of an external command" \
+    '/bin/cat < missing || echo failed' \
+    'osh: error: No such file or directory
+failed'
+check "unwritable output file" 'cd / > /; pwd' "osh: error: Is a directory
+$top/$((count + 1))"
+check "output into a missing directory" \
+    'cat < in > nodir/out || echo failed; cat < in' \
+    'osh: error: No such file or directory
+failed
+hello'
+if [ "$(id -u)" != 0 ]; then
+    check "read-only output file" \
+        'cat < in > ro; chmod a-w ro; cat < in > ro || echo failed' \
+        'osh: error: Permission denied
+failed'
+fi
+
+# Standard file descriptors closed in the shell
+check_closed "closed output restored as closed" 1 \
+    'cd . > a; pwd > b; pwd' a ''
+check_closed "closed output redirected again" 1 \
+    'cd . > a; pwd > b' b "$top/$((count + 1))"
+check_closed "closed input" 0 \
+    'cat < in > a; cat a > b' b 'hello'
+check_closed "closed output is a bad file descriptor" 1 \
+    'cat < in; cat < in > out' out 'hello'
+
+finish
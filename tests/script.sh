@@ -0,0 +1,28 @@
+#!/bin/sh
+#
+# Script file tests, run by `make check'. Each case runs a command with sh in
+# a scratch directory holding a script named script (which echoes its lines),
+# so that osh can be given a file of any kind.
+
+. "$(dirname "$0")/lib.sh"
+
+setup() {
+    printf 'echo one\ncat <<EOF\ntwo\nEOF\n' > "$dir/script"
+}
+
+check_sh "regular file" '"$OSH" script' 'one
+two'
+check_sh "empty file" ': > empty; "$OSH" empty && echo ok' 'ok'
+check_sh "standard input as a path" '"$OSH" /dev/stdin < script' 'one
+two'
+check_sh "pipe as a path" 'cat script | "$OSH" /dev/stdin' 'one
+two'
+check_sh "named pipe" 'mkfifo fifo; cat script > fifo & "$OSH" fifo' 'one
+two'
+check_sh "missing file" '"$OSH" missing; echo $?' \
+    'osh: missing: No such file or directory
+127'
+check_sh "directory" '"$OSH" .; echo $?' 'osh: .: Is a directory
+126'
+
+finish
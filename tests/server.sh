@@ -0,0 +1,44 @@
+#!/bin/sh
+#
+# Server mode tests, run by `make check'. A server with a single worker runs
+# in the background on the socket $sock, so that every request goes to the
+# same worker, and each case runs clients with `osh --client' through sh.
+
+. "$(dirname "$0")/lib.sh"
+sock=$top/sock
+"$OSH" --server "$sock" 1 &
+server=$!
+trap 'kill $server; rm -rf "$top"' EXIT
+while [ ! -S "$sock" ]; do
+    sleep 0.1
+done
+
+# client LINE: run a command line in the server
+client() {
+    "$OSH" --client "$sock" "$1"
+}
+
+check_sh "request" 'client "echo hi"' 'hi'
+check_sh "exit status" 'client "exit 3"; echo $?; client "echo next"' '3
+next'
+check_sh "standard input and error" \
+    'echo in | client "cat; cat < missing"' 'in
+osh: error: No such file or directory'
+check_sh "working directory of the client" \
+    'mkdir sub; cd sub && client pwd' "$top/$((count + 1))/sub"
+check_sh "cd doesn't carry over" 'client "cd /"; client pwd' \
+    "$top/$((count + 1))"
+check_sh "variables don't carry over" \
+    'client "export FOO=leak; X=1; unset HOME"
+client "printenv FOO; echo [\$X] \$HOME"' "[] $HOME"
+check_sh "options don't carry over" \
+    'client "set -j 7; set -g off"; client set' "$("$OSH" -c set)"
+check_sh "jobs don't carry over" \
+    'client "sleep 1 & jobs"; client "jobs; echo none"' \
+    '[1]+ Running    sleep 1
+none'
+check_sh "queued jobs start before the reply" \
+    'client "set -j 1; sleep 0.2 & echo queued > log &"; sleep 0.2; cat log' \
+    'queued'
+
+finish
@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# Process launch tests, run by `make check'. Every case runs under each backend
+# of spawn (selected with OSH_SPAWN), with a directory bin holding commands at
+# the front of PATH.
+
+. "$(dirname "$0")/lib.sh"
+
+setup() {
+    mkdir "$dir/bin" "$dir/moved"
+    printf '#!/bin/sh\necho shebang "$@"\n' > "$dir/bin/shebang"
+    printf 'echo plain "$@"\n' > "$dir/bin/plain"
+    chmod +x "$dir/bin/shebang" "$dir/bin/plain"
+}
+
+# check NAME LINE EXPECTED, under each backend
+check() {
+    for backend in fork vfork posix_spawn; do
+        scratch
+        verdict "$1 ($backend)" "$(cd "$dir" &&
+            PATH=$dir/bin:$dir/moved:$PATH OSH_SPAWN=$backend \
+            "$OSH" -c "$2" 2>&1)" "$3"
+    done
+}
+
+check "command with #!" 'shebang a b' 'shebang a b'
+check "script without #!" 'plain a b' 'plain a b'
+check "script without #! by path" 'bin/plain a b' 'plain a b'
+check "redirected script without #!" 'plain a > out; cat out' 'plain a'
+check "script without #! in a pipeline" 'plain a | cat' 'plain a'
+check "moved since it was hashed" \
+    'shebang; mv bin/shebang moved; shebang a' 'shebang
+shebang a'
+check "script without #! moved since it was hashed" \
+    'plain; mv bin/plain moved; plain a' 'plain
+plain a'
+check "missing command" 'missing || echo failed' \
+    'osh: command not found: missing
+failed'
+
+finish
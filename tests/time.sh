@@ -0,0 +1,73 @@
+#!/bin/sh
+#
+# Timing tests, run by `make check'. Reports vary from run to run, so the
+# cases either compare them with their numbers replaced by N (other than the
+# status in JSON) or compare single fields, such as the time taken by commands
+# which sleep, rounded down to tenths of a second.
+
+. "$(dirname "$0")/lib.sh"
+
+# check_format NAME LINE EXPECTED: run a line and compare its output with the
+# numbers in the reports replaced
+check_format() {
+    scratch
+    verdict "$1" "$(cd "$dir" && "$OSH" -c "$2" 2>&1 | sed -E \
+        -e '/^real /s/[0-9]+(\.[0-9]+)?/N/g' \
+        -e '/^\{/s/("[a-z_]+":)[0-9]+\.?[0-9]*,/\1N,/g')" "$3"
+}
+
+# check_field NAME LINE FIELD EXPECTED: run a line and compare the values of a
+# field in its JSON reports, with the ones with decimals rounded down to tenths
+check_field() {
+    scratch
+    verdict "$1" "$(cd "$dir" && "$OSH" -c "$2" 2>&1 |
+        sed -n -E "s/.*\"$3\":([0-9]+(\.[0-9])?).*/\1/p")" "$4"
+}
+
+report='real Ns user Ns sys Ns maxrss Nk faults N/N csw N/N'
+json='{"real":N,"user":N,"sys":N,"maxrss_kb":N,"minflt":N,"majflt":N,'
+json=$json'"nvcsw":N,"nivcsw":N,"status"'
+
+check_format "time" 'time true' "$report"
+check_format "time -j" 'time -j sh -c "exit 3"' "$json:3}"
+check_format "status of a timed list" \
+    'time -j false; time -j false || echo failed' "$json:1}
+failed
+$json:0}"
+check_format "output before the report" 'time echo a; echo b' "a
+$report
+b"
+check_format "repeated prefixes" 'time time -j time true' "$json:0}"
+check_format "skipped time" 'true || time -j true; echo done' 'done'
+check_format "time without a command" 'time' "osh: parse error near \`time'"
+
+check_field "time over &&" 'time -j sleep 0.2 && sleep 0.1' real '0.3'
+check_field "time over ||" 'time -j false || sleep 0.2' real '0.2'
+check_field "time over a pipeline" 'time -j sleep 0.1 | sleep 0.3' real '0.3'
+check_field "time over && and a pipeline" \
+    'time -j sleep 0.1 | sleep 0.2 && sleep 0.1 | true' real '0.3'
+check_field "time stops at ;" 'time -j sleep 0.1; sleep 0.2' real '0.1'
+check_field "time stops at &" 'time -j sleep 0.1 & sleep 0.2; wait' real '0.1'
+check_field "time after &&" 'sleep 0.1 && time -j sleep 0.2 && sleep 0.1' \
+    real '0.2'
+check_field "time in a pipeline" 'sleep 0.2 | time -j sleep 0.1' real '0.1'
+check_field "nested spans" \
+    'time -j sleep 0.1 && time -j sleep 0.2' real '0.2
+0.3'
+check_field "status of a pipeline" 'time -j false | sh -c "exit 4"' status \
+    '4'
+
+scratch
+rss=$(cd "$dir" && "$OSH" -c 'time -j head -c 32m /dev/zero | sort > /dev/null
+time -j true' 2>&1 | sed -n -E 's/.*"maxrss_kb":([0-9]+).*/\1/p')
+verdict "largest child in each span" \
+    "$(echo "$rss" | awk '{ print ($1 >= 16384 ? "large" : "small") }')" 'large
+small'
+scratch
+cpu=$(cd "$dir" && "$OSH" -c 'time -j timeout 0.5 sh -c "while :; do :; done"' \
+    2>&1 | sed -n -E 's/.*"user":([0-9.]+),"sys":([0-9.]+).*/\1 \2/p')
+verdict "CPU time of children" \
+    "$(echo "$cpu" | awk '{ print ($1 + $2 >= 0.25 ? "busy" : "idle") }')" \
+    'busy'
+
+finish
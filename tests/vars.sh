@@ -0,0 +1,30 @@
+#!/bin/sh
+#
+# Variable tests, run by `make check'. Variables are expanded as a line is
+# lexed, so the cases check that the words after an assignment or unset on the
+# same line see its effect.
+
+. "$(dirname "$0")/lib.sh"
+
+check "expansion" 'echo $HOME ${HOME}' "$HOME $HOME"
+check "assignment earlier on the line" 'X=hi; echo $X' 'hi'
+check "assignment before &&" 'X=a && echo "[$X]" b${X}c' '[a] bac'
+check "assignment in a later line" 'X=a
+echo $X' 'a'
+check "expansion before the assignment" 'X=a; echo $X; X=b; echo $X' 'a
+b'
+check "unset earlier on the line" 'X=a; unset X; echo [$X] "[$X]" $X end' \
+    '[] [] end'
+check "single quotes" "X=a; echo '\$X' \"'\$X'\"" "\$X 'a'"
+check "value with spaces" "X='a b'; echo \"\$X\" \$X" 'a b a b'
+check "value isn't a pattern" 'touch a.c; X=*.c; echo $X' '*.c'
+check "pattern around an expansion" 'touch a.c; X=a; echo $X*' 'a.c'
+check "command name" 'X=echo; $X hi | cat' 'hi'
+check "built-in name" 'X=cd; $X /; pwd' '/'
+check "command of nothing" 'X=; $X; echo ok' 'ok'
+check "redirection target" 'X=out; echo hi > $X; cat out' 'hi'
+check "here-string" 'X=hi; cat <<< $X' 'hi'
+check "background job" 'X=a; sh -c "echo $X" & wait' 'a'
+check "pipeline stage" 'X=a; echo $X | cat' 'a'
+
+finish
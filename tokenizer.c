@@ -1,26 +1,29 @@
-#include <ctype.h>
 #include <error.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "scan.h"
 #include "tokenizer.h"
+#include "vars.h"
 
-#define INITIAL_BUFFER_SIZE 256
-
-/** The special operator tokens */
-static const char *special_strings[] = {
-    "&&", "||", ">&", "<<", ">>", "&!", "|&"
+/** The strings of the operators, indexed by operator code */
+static const char *operator_strings[NUM_OPERATORS] = {
+#define X(code, string, level, node_type) [code] = string,
+    OPERATOR_TABLE(X)
+#undef X
 };
 
 /** Return whether a character is special (i.e., part of an operator) */
 static inline bool isspecial(char c)
 {
-    return c == '&' || c == '|' ||
-           c == '!' || c == '#' ||
-           c == '<' || c == '>' ||
-           c == '(' || c == ')' ||
-           c == ';';
+    return char_is(c, CHAR_SPECIAL);
+}
+
+/** Return whether a character is whitespace */
+static inline bool is_space(char c)
+{
+    return char_is(c, CHAR_SPACE);
 }
 
 /** Add a token to an array of tokens, expanding the array if necessary
@@ -29,23 +32,30 @@ static inline bool isspecial(char c)
  * @param n A pointer to the size of the array. If the array is resized, n is
  * updated to reflect the new size
  * @param i The index at which to add the token (must be the end)
- * @param offset The offset of the first character of the token from the
- * beginning of the token buffer
+ * @param start The first character of the token in the line
  * @param special Whether the token is special
  */
 static void add_token(struct Token **tokens, size_t *n, size_t i,
-                      ptrdiff_t offset, bool special);
+                      char *start, bool special);
 
 /**
- * Write a character to a dynamically-sized buffer
- * @param buffer A pointer to the buffer, which may be resized by realloc
- * @param n A pointer to the size of the buffer. If the buffer is resized, n is
- * updated to reflect the new size
- * @param p A pointer to the end of the buffer. If the buffer is resized, p is
- * updated
- * @param c The character to write
+ * Write the characters of a word in place over a run of len characters of the
+ * line starting at p. Words never grow, so the write head always trails p
+ * @param head The write head of the word
+ * @param c The first character of the run, which may already have been
+ * overwritten in the line by a null terminator
+ * @return The new write head
  */
-static void write_char(char **buffer, size_t *n, char **p, char c);
+static inline char *write_run(char *head, const char *p, char c, size_t len);
+
+/**
+ * Finish a special token of a given length by classifying it as an operator
+ * and pointing it to the static copy of the operator, which leaves the line
+ * free to be overwritten
+ * @param first The first character of the token, which may already have been
+ * overwritten in the line by a null terminator
+ */
+static void finish_special(struct Token *token, size_t len, char first);
 
 /**
  * Return whether we need to split upon encountering a special character
@@ -53,49 +63,178 @@ static void write_char(char **buffer, size_t *n, char **p, char c);
  */
 static inline bool need_split(char curr, char prev);
 
+/**
+ * Parse the expansion of a variable ($NAME or ${NAME}) at a dollar sign
+ * @param name Set to the name of the variable
+ * @param name_len Set to the length of the name
+ * @return The length of the expansion, zero if the dollar sign doesn't start
+ * one (and so is taken literally), or -1 if it is malformed
+ */
+static ssize_t parse_expansion(const char *p, const char *end,
+                               const char **name, size_t *name_len);
+
+/**
+ * Write the value of a variable to the current word. The value is written in
+ * place if it is no longer than what the word has consumed of the line, and
+ * otherwise the word moves out of the line into a buffer from the arena with
+ * room for the rest of the line, which may be moved again by a later value
+ * @param head The write head of the word
+ * @param limit The end of the buffer of the word, or NULL if it is the line
+ * @param next The character after the expansion in the line
+ * @return The new write head
+ */
+static char *expand(struct Arena *arena, struct Token *token, char *head,
+                    char **limit, const char *next, const char *end,
+                    const char *value);
+
+/**
+ * Return whether a word may change variables when it runs, being an assignment
+ * (NAME=value) or unset (the word need not be terminated yet)
+ */
+static inline bool changes_vars(const struct Token *token);
+
+/**
+ * Lex a string into an array of tokens, as described for tokenize
+ * @param quiet Whether to leave out the error message on error
+ */
+static ssize_t lex(struct Arena *arena, struct Token **tokens, size_t *n,
+                   char *line, bool quiet);
+
 /** Begin a new token */
-#define ENTER_TOKEN(a)                                 \
-    do {                                               \
-        add_token(tokens, n, i++, head - buffer, (a)); \
-        in_token = true;                               \
+#define ENTER_TOKEN(a)                              \
+    do {                                            \
+        add_token(tokens, n, i++, p, (a));          \
+        in_token = true;                            \
+        special = (a);                              \
+        head = p;                                   \
+        limit = NULL;                               \
+        first = c;                                  \
+        literal = false;                            \
+        word = opening ? opening : p;               \
+        opening = NULL;                             \
+        deferred = false;                           \
+    } while(0)
+
+/**
+ * End a token. Once a word which may change variables has ended, the rest of
+ * the line is copied, and the words after it with expansions keep their text
+ * from the copy (even if they expanded to nothing) to be expanded again
+ */
+#define LEAVE_TOKEN()                                              \
+    do {                                                           \
+        if (in_token) {                                            \
+            struct Token *token = &(*tokens)[i - 1];               \
+            if (special)                                           \
+                finish_special(token, p - token->token, first);    \
+            else if (!literal && !deferred && head == token->token) \
+                --i; /* Nothing but empty expansions */            \
+            else {                                                 \
+                token->len = head - token->token;                  \
+                if (deferred) {                                    \
+                    token->raw = rest + (word - rest_start);       \
+                    rest[p - rest_start] = '\0';                   \
+                } else if (!rest && changes_vars(token)) {         \
+                    /* Before the null may overwrite p */          \
+                    rest = arena_alloc(arena, end - p + 1);        \
+                    memcpy(rest, p, end - p + 1);                  \
+                    rest_start = p;                                \
+                }                                                  \
+                *head = '\0';                                      \
+            }                                                      \
+        }                                                          \
+        in_token = false;                                          \
+    } while(0)
+
+/** Write a character to the current token */
+#define WRITE_CHAR(c)                               \
+    do {                                            \
+        if (!special)                               \
+            *head++ = (c);                          \
     } while(0)
 
-/** End a token */
-#define LEAVE_TOKEN()                                  \
-    do {                                               \
-        write_char(&buffer, &buffer_len, &head, '\0'); \
-        in_token = false;                              \
+/**
+ * Write the run of len characters starting at p to the current token and
+ * leave p and c at the last character of the run
+ */
+#define WRITE_RUN(len)                              \
+    do {                                            \
+        head = write_run(head, p, c, (len));        \
+        p += (len) - 1;                             \
+        c = *p;                                     \
     } while(0)
 
-/** Write a character to the token buffer */
-#define WRITE_CHAR(c) write_char(&buffer, &buffer_len, &head, (c))
+/**
+ * Write the value of the variable of an expansion of length len at p to the
+ * current word and leave p and c at the last character of the expansion (c is
+ * read first, since the value may overwrite it)
+ */
+#define EXPAND(len)                                                      \
+    do {                                                                 \
+        const char *value = var_lookup(name, name_len);                  \
+        if (!in_token)                                                   \
+            ENTER_TOKEN(false);                                          \
+        deferred = rest != NULL;                                         \
+        c = p[(len) - 1];                                                \
+        if (value)                                                       \
+            head = expand(arena, &(*tokens)[i - 1], head, &limit,        \
+                          p + (len), end, value);                        \
+        p += (len) - 1;                                                  \
+    } while(0)
 
 /* See tokenizer.h */
-ssize_t tokenize(struct Token **tokens, size_t *n, char *line)
+ssize_t tokenize(struct Arena *arena, struct Token **tokens, size_t *n,
+                 char *line)
 {
-    static char *buffer = NULL;
-    static size_t buffer_len = INITIAL_BUFFER_SIZE;
+    return lex(arena, tokens, n, line, false);
+}
 
-    if (!buffer) {
-        buffer = malloc(INITIAL_BUFFER_SIZE * sizeof(char));
-        if (!buffer)
-            error(1, errno, "fatal error");
-    }
+/* See tokenizer.h */
+ssize_t tokenize_quietly(struct Arena *arena, struct Token **tokens,
+                         size_t *n, char *line)
+{
+    return lex(arena, tokens, n, line, true);
+}
 
-    char *head = buffer;
-    char prev = ' ', quote = '\0';
-    ssize_t i = 0;
-    bool in_token = false, escape = false;
+/* See above */
+static ssize_t lex(struct Arena *arena, struct Token **tokens, size_t *n,
+                   char *line, bool quiet)
+{
+    char *p, *head = line, *limit = NULL, *end = line + strlen(line);
+    char prev = ' ', quote = '\0', first = '\0';
+    char *word = NULL, *opening = NULL, *rest = NULL, *rest_start = NULL;
+    const char *name;
+    size_t name_len;
+    ssize_t i = 0, len;
+    bool in_token = false, escape = false, special = false, literal = false;
+    bool deferred = false;
 
-    for (char *p = line; *p; ++p) {
+    for (p = line; p < end; ++p) {
         char c = *p;
         if (quote) {
             if (!in_token)
                 ENTER_TOKEN(false);
             if (c == quote)
                 quote = '\0';
-            else
-                WRITE_CHAR(c);
+            else if (quote == '"' && c == '$' &&
+                     (len = parse_expansion(p, end, &name, &name_len))) {
+                if (len == -1)
+                    goto bad_expansion;
+                EXPAND(len);
+            } else {
+                /*
+                 * Everything up to the closing quote is taken literally,
+                 * except for expansions between double quotes
+                 */
+                const char *close = memchr(p, quote, end - p);
+                if (!close)
+                    close = end;
+                if (quote == '"') {
+                    const char *dollar = memchr(p + 1, '$', close - p - 1);
+                    if (dollar)
+                        close = dollar;
+                }
+                WRITE_RUN(close - p);
+            }
         } else if (escape) {
             if (!in_token)
                 ENTER_TOKEN(false);
@@ -104,8 +243,8 @@ ssize_t tokenize(struct Token **tokens, size_t *n, char *line)
         } else {
             if (isspecial(prev) && !isspecial(c))
                 LEAVE_TOKEN();
-            if (isspace(c)) {
-                if (!isspace(prev) && !isspecial(prev))
+            if (is_space(c)) {
+                if (!is_space(prev) && !isspecial(prev))
                     LEAVE_TOKEN();
             } else {
                 if (isspecial(c)) {
@@ -114,33 +253,57 @@ ssize_t tokenize(struct Token **tokens, size_t *n, char *line)
                     if (!in_token)
                         ENTER_TOKEN(true);
                 }
-                if (c == '\'' || c == '"')
+                if (c == '\'' || c == '"') {
+                    /* A word opening with a quote starts before its token */
+                    if (!in_token)
+                        opening = p;
                     quote = c;
-                else {
+                } else if (c == '$' &&
+                         (len = parse_expansion(p, end, &name, &name_len))) {
+                    if (len == -1)
+                        goto bad_expansion;
+                    /* Only an unquoted expansion leaves the word empty */
+                    EXPAND(len);
+                    prev = c;
+                    continue;
+                } else {
                     if (!in_token)
                         ENTER_TOKEN(false);
                     escape = c == '\\';
-                    if (!escape)
+                    /*
+                     * The word characters following an ordinary character
+                     * only extend the current token, so take them all at once
+                     */
+                    if (char_class(c) == CHAR_WORD)
+                        WRITE_RUN(1 + scan_word(p + 1, end));
+                    else if (!escape)
                         WRITE_CHAR(c);
+                    if (char_is(c, CHAR_GLOB))
+                        (*tokens)[i - 1].glob = true;
                 }
             }
         }
         prev = c;
+        literal = true;
     }
 
     if (quote) {
-        error(0, 0, "error: Unclosed quote");
+        if (!quiet)
+            error(0, 0, "error: Unclosed quote");
         return -1;
     }
 
-    for (ssize_t j = 0; j < i; ++j)
-        (*tokens)[j].token = buffer + (*tokens)[j].offset;
-
+    LEAVE_TOKEN();
     return i;
+
+bad_expansion:
+    if (!quiet)
+        error(0, 0, "error: Bad substitution");
+    return -1;
 }
 
 static void add_token(struct Token **tokens, size_t *n, size_t i,
-                      ptrdiff_t offset, bool special)
+                      char *start, bool special)
 {
     if (i >= *n) {
         struct Token *new_tokens;
@@ -149,51 +312,105 @@ static void add_token(struct Token **tokens, size_t *n, size_t i,
             error(1, errno, "fatal error");
         *tokens = new_tokens;
     }
-    (*tokens)[i].offset = offset;
-    (*tokens)[i].special = special;
+    (*tokens)[i].token = start;
+    (*tokens)[i].len = 0;
+    (*tokens)[i].glob = false;
+    (*tokens)[i].raw = NULL;
+    (*tokens)[i].op = special ? OP_UNKNOWN : OP_NONE;
 }
 
-static void write_char(char **buffer, size_t *n, char **p, char c)
+static inline bool changes_vars(const struct Token *token)
 {
-    ptrdiff_t d = *p - *buffer;
-    if (d >= *n) {
-        char *new_buffer;
-        *n = 2 * *n + 1;
-        if (!(new_buffer = realloc(*buffer, *n * sizeof(char))))
-            error(1, errno, "fatal error");
-        *buffer = new_buffer;
-        *p = new_buffer + d;
+    size_t len = var_name_len(token->token, token->token + token->len);
+
+    return (len && len < token->len && token->token[len] == '=') ||
+        (token->len == 5 && memcmp(token->token, "unset", 5) == 0);
+}
+
+static inline char *write_run(char *head, const char *p, char c, size_t len)
+{
+    *head = c;
+    if (head != p)
+        memmove(head + 1, p + 1, len - 1);
+    return head + len;
+}
+
+static void finish_special(struct Token *token, size_t len, char first)
+{
+    token->len = len;
+    for (enum Operator op = OP_NONE + 1; op < OP_UNKNOWN; ++op) {
+        const char *string = operator_strings[op];
+        if (string[0] == first && strlen(string) == len &&
+            (len == 1 || string[1] == token->token[1])) {
+            token->op = op;
+            token->token = (char *)string;
+            return;
+        }
     }
-    *((*p)++) = c;
+    /* Not an operator, so the token stays in the line for error messages */
+    token->token[0] = first;
 }
 
 static inline bool need_split(char curr, char prev)
 {
-    if (isspace(prev))
+    if (is_space(prev))
         return false;
     else {
-        for (int i = 0; i < sizeof(special_strings) / sizeof(*special_strings);
-                ++i) {
-            if (prev == special_strings[i][0] && curr == special_strings[i][1])
+        for (enum Operator op = OP_NONE + 1; op < OP_UNKNOWN; ++op) {
+            const char *string = operator_strings[op];
+            if (prev == string[0] && curr == string[1])
                 return false;
         }
     }
     return true;
 }
 
+static ssize_t parse_expansion(const char *p, const char *end,
+                               const char **name, size_t *name_len)
+{
+    const char *close;
+
+    if (p + 1 < end && p[1] == '{') {
+        *name = p + 2;
+        *name_len = var_name_len(*name, end);
+        close = *name + *name_len;
+        if (*name_len == 0 || close == end || *close != '}')
+            return -1;
+        return close + 1 - p;
+    }
+    *name = p + 1;
+    *name_len = var_name_len(*name, end);
+    return *name_len ? *name_len + 1 : 0;
+}
+
+static char *expand(struct Arena *arena, struct Token *token, char *head,
+                    char **limit, const char *next, const char *end,
+                    const char *value)
+{
+    size_t value_len = strlen(value), word_len = head - token->token;
+
+    /* The rest of the word is at most the rest of the line, and then a null */
+    if (*limit ? head + value_len + (end - next) + 1 > *limit :
+        head + value_len > next) {
+        size_t size = 2 * (word_len + value_len + (end - next) + 1);
+        char *buf = arena_alloc(arena, size);
+        memcpy(buf, token->token, word_len);
+        token->token = buf;
+        head = buf + word_len;
+        *limit = buf + size;
+    }
+    memcpy(head, value, value_len);
+    return head + value_len;
+}
+
 /* See tokenizer.h */
 void print_tokens(size_t num_tokens, struct Token *tokens)
 {
     printf("[");
-    if (num_tokens) {
-        printf("`%s'", tokens[0].token);
-        if (tokens[0].special)
+    for (int i = 0; i < num_tokens; ++i) {
+        printf("%s`%.*s'", i ? ", " : "", (int)tokens[i].len, tokens[i].token);
+        if (tokens[i].op != OP_NONE)
             printf("*");
-        for (int i = 1; i < num_tokens; ++i) {
-            printf(", `%s'", tokens[i].token);
-            if (tokens[i].special)
-                printf("*");
-        }
     }
     printf("]\n");
 }
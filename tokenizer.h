@@ -6,22 +6,69 @@
 #include <string.h>
 #include <unistd.h>
 
-/** A lexed token */
+#include "arena.h"
+#include "operators.h"
+
+/**
+ * A lexed token. Word tokens are slices of the line they were lexed from and
+ * operator tokens point to static strings; either way, the token is
+ * null-terminated unless it is an unknown special token
+ */
 struct Token {
-    /** Whether the token is special (e.g., an operator like `|') */
-    bool special;
+    /**
+     * The operator the token was classified as, or OP_NONE if it is a word
+     * rather than a special token (e.g., an operator like `|')
+     */
+    enum Operator op;
+
+    /** The actual token string */
+    char *token;
 
-    union {
-        /** The actual token string */
-        char *token;
+    /** The length of the token string */
+    size_t len;
 
-        /** Used internally */
-        ptrdiff_t offset;
-    };
+    /**
+     * Whether the token is a word with unquoted glob characters (`*', `?', or
+     * `[') and so is a pattern to expand into paths
+     */
+    bool glob;
+
+    /**
+     * The text of a word with expansions as it was on the line, if a word
+     * before it may have changed variables by the time it runs (e.g., in
+     * `X=1; echo $X'), so that it must be expanded again then, or NULL
+     */
+    char *raw;
 };
 
-/** Lex a string into an array of tokens */
-ssize_t tokenize(struct Token **tokens, size_t *n, char *line);
+/**
+ * Lex a string into an array of tokens. The line is modified in place to
+ * remove quotes and backslashes and to terminate words, and the returned
+ * tokens are only valid as long as the line is. Variables ($NAME or ${NAME})
+ * are expanded outside of single quotes, each value becoming part of its word
+ * as is, and a word of nothing but unquoted empty expansions is dropped. Once
+ * a word which may change variables (an assignment or unset) has been lexed,
+ * the words with expansions after it also keep their raw text, to be expanded
+ * again when they run, and aren't dropped. Words with glob characters are only
+ * marked, to be expanded when they are run
+ * @param arena The arena to allocate words from which grow longer than the
+ * part of the line they were lexed from, which must outlive the tokens too
+ * @param tokens A pointer to the array of tokens, which may be resized by
+ * realloc
+ * @param n A pointer to the size of the array, updated if it is resized
+ * @return The number of tokens, or -1 on error
+ */
+ssize_t tokenize(struct Arena *arena, struct Token **tokens, size_t *n,
+                 char *line);
+
+/**
+ * Lex a string into an array of tokens like tokenize, but without printing an
+ * error message on error, for looking ahead at a line which is tokenized again
+ * to run it
+ * @return The number of tokens, or -1 on error
+ */
+ssize_t tokenize_quietly(struct Arena *arena, struct Token **tokens,
+                         size_t *n, char *line);
 
 /** Print a list of tokens */
 void print_tokens(size_t num_tokens, struct Token *tokens);
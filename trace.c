@@ -0,0 +1,234 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "error.h"
+#include "trace.h"
+
+#ifndef TRACE_BUFFER_SIZE
+/** The size of the buffer of events of each process */
+#define TRACE_BUFFER_SIZE 65536
+#endif
+
+/** The most bytes of a string which are put into an event */
+#define MAX_STRING 256
+
+/**
+ * The most bytes an event takes: two strings, each character of which may be
+ * escaped as \u00XX, and the rest of the event
+ */
+#define MAX_EVENT (2 * 6 * MAX_STRING + 256)
+
+/* See trace.h */
+bool tracing = false;
+
+/** The file which events are appended to */
+static int trace_fd = -1;
+
+/**
+ * The events recorded by the current process which weren't written out yet.
+ * The buffer always ends between events, so each write appends whole events
+ * even when other processes are appending to the file too
+ */
+static char buffer[TRACE_BUFFER_SIZE];
+
+/** The number of bytes in the buffer */
+static size_t buffer_len = 0;
+
+/** Make room for an event in the buffer, writing it out if it's too full */
+static void reserve(void);
+
+/** Append formatted text to the buffer */
+static void put(const char *format, ...)
+    __attribute__((format(printf, 1, 2)));
+
+/** Append a string to the buffer as a JSON string, truncating it */
+static void put_string(const char *str);
+
+/**
+ * Append the fields which start an event: its phase (as in the trace event
+ * format), name, process and time
+ * @param name The name of the event, or NULL if it has none
+ */
+static void put_header(char phase, const char *name, pid_t pid, uint64_t ts);
+
+/**
+ * Append the argument of an event, if there is one, and end the event
+ * @param key The name of the argument
+ */
+static void put_footer(const char *key, const char *arg);
+
+/* See trace.h */
+void trace_init(void)
+{
+    const char *path = getenv("OSH_TRACE");
+    struct stat st;
+
+    if (!path || !*path)
+        return;
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (trace_fd == -1) {
+        error(0, errno, "OSH_TRACE: %s", path);
+        return;
+    }
+
+    /* The closing bracket is optional, so processes need only append */
+    if (fstat(trace_fd, &st) == 0 && st.st_size == 0)
+        put("[\n");
+    tracing = true;
+    atexit(trace_flush);
+
+    reserve();
+    put_header('M', "process_name", getpid(), 0);
+    put_footer("name", "osh");
+    trace_flush();
+}
+
+/* See trace.h */
+uint64_t trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* See trace.h */
+void trace_span(const char *name, const char *arg, uint64_t start)
+{
+    uint64_t now = trace_now();
+
+    reserve();
+    put_header('X', name, getpid(), start);
+    put(",\"dur\":%" PRIu64 ".%03u", (now - start) / 1000,
+        (unsigned)((now - start) % 1000));
+    put_footer("arg", arg);
+}
+
+/* See trace.h */
+void trace_begin(const char *name, const char *arg)
+{
+    reserve();
+    put_header('B', name, getpid(), trace_now());
+    put_footer("arg", arg);
+}
+
+/* See trace.h */
+void trace_end(void)
+{
+    reserve();
+    put_header('E', NULL, getpid(), trace_now());
+    put_footer(NULL, NULL);
+}
+
+/* See trace.h */
+void trace_child(pid_t pid, const char *name)
+{
+    uint64_t now = trace_now();
+
+    reserve();
+    put_header('M', "process_name", pid, 0);
+    put_footer("name", name);
+    put_header('B', name, pid, now);
+    put_footer(NULL, NULL);
+}
+
+/* See trace.h */
+void trace_child_exit(pid_t pid, int status)
+{
+    char arg[16];
+
+    snprintf(arg, sizeof(arg), "%d", status);
+    reserve();
+    put_header('E', NULL, pid, trace_now());
+    put_footer("status", arg);
+}
+
+/* See trace.h */
+void trace_exec(const char *name)
+{
+    reserve();
+    put_header('i', "exec", getpid(), trace_now());
+    put(",\"s\":\"p\"");
+    put_footer("arg", name);
+    trace_flush();
+}
+
+/* See trace.h */
+void trace_flush(void)
+{
+    size_t written = 0;
+
+    while (written < buffer_len) {
+        ssize_t ret = write(trace_fd, buffer + written, buffer_len - written);
+        if (ret == -1 && errno == EINTR)
+            continue;
+        else if (ret <= 0)
+            break;
+        written += ret;
+    }
+    buffer_len = 0;
+}
+
+/* See above */
+static void reserve(void)
+{
+    if (buffer_len + MAX_EVENT > sizeof(buffer))
+        trace_flush();
+}
+
+/* See above */
+static void put(const char *format, ...)
+{
+    va_list ap;
+
+    va_start(ap, format);
+    buffer_len += vsnprintf(buffer + buffer_len, sizeof(buffer) - buffer_len,
+                            format, ap);
+    va_end(ap);
+}
+
+/* See above */
+static void put_string(const char *str)
+{
+    buffer[buffer_len++] = '"';
+    for (size_t i = 0; str[i] && i < MAX_STRING; ++i) {
+        unsigned char c = str[i];
+        if (c == '"' || c == '\\') {
+            buffer[buffer_len++] = '\\';
+            buffer[buffer_len++] = c;
+        } else if (c < 0x20 || c == 0x7f)
+            put("\\u%04x", c);
+        else
+            buffer[buffer_len++] = c;
+    }
+    buffer[buffer_len++] = '"';
+}
+
+/* See above */
+static void put_header(char phase, const char *name, pid_t pid, uint64_t ts)
+{
+    put("{\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,\"ts\":%" PRIu64 ".%03u",
+        phase, (int)pid, (int)pid, ts / 1000, (unsigned)(ts % 1000));
+    if (name) {
+        put(",\"name\":");
+        put_string(name);
+    }
+}
+
+/* See above */
+static void put_footer(const char *key, const char *arg)
+{
+    if (arg) {
+        put(",\"args\":{\"%s\":", key);
+        put_string(arg);
+        put("}");
+    }
+    put("},\n");
+}
@@ -0,0 +1,70 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+
+/**
+ * Whether the shell is tracing, as set by trace_init. Events are only recorded
+ * by callers which checked it, so tracing costs nothing more when it's off
+ */
+extern bool tracing;
+
+/**
+ * Start tracing into the file named by OSH_TRACE, if it is set. Events are
+ * written in the trace event format read by chrome://tracing and Perfetto, as
+ * a JSON array which each process (the shell, its subshells, and any shells
+ * it runs which inherit OSH_TRACE) appends its buffered events to, so the
+ * file is extended rather than replaced and should be removed to start over
+ */
+void trace_init(void);
+
+/** Return the current time in nanoseconds, for timestamping events */
+uint64_t trace_now(void);
+
+/** Return the time a span starts at if tracing, or zero otherwise */
+static inline uint64_t trace_start(void)
+{
+    return tracing ? trace_now() : 0;
+}
+
+/**
+ * Record a span of the current process from a start time until now
+ * @param arg An argument shown with the span (e.g., a command), or NULL
+ */
+void trace_span(const char *name, const char *arg, uint64_t start);
+
+/**
+ * Record the beginning of a span of the current process which is ended by
+ * trace_end, for spans which contain others
+ */
+void trace_begin(const char *name, const char *arg);
+
+/** Record the end of the innermost span begun by trace_begin */
+void trace_end(void);
+
+/**
+ * Record the start of a child, which is traced as a process of its own from
+ * now until it is reaped
+ * @param name The name to show for the child (e.g., its command)
+ */
+void trace_child(pid_t pid, const char *name);
+
+/** Record that a child was reaped after exiting with a status */
+void trace_child_exit(pid_t pid, int status);
+
+/**
+ * Record that the current process is about to be replaced by a command, and
+ * write out the events buffered by it, which would otherwise be lost
+ */
+void trace_exec(const char *name);
+
+/**
+ * Write out the events buffered by the current process. This must be done
+ * before forking, or the child would write them out again
+ */
+void trace_flush(void);
+
+#endif /* TRACE_H */
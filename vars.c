@@ -0,0 +1,342 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "hash.h"
+#include "table.h"
+#include "vars.h"
+
+/** A slot of the hash table of variables */
+struct Var {
+    /** The hash of the name */
+    uint64_t hash;
+
+    /**
+     * The variable as NAME=value (or just NAME if it is exported without a
+     * value), which is also its string in the environment, or NULL if the
+     * slot is empty
+     */
+    char *entry;
+
+    /** The length of the name */
+    size_t len;
+
+    /** Whether the variable is exported */
+    bool exported;
+
+    /**
+     * Whether the variable has a value, which saves looking at the string
+     * when building the environment
+     */
+    bool has_value;
+};
+
+/** The name of a variable being looked up in the hash table */
+struct Key {
+    /** The name, which needn't be terminated */
+    const char *name;
+
+    /** The length of the name */
+    size_t len;
+};
+
+/* See vars.h */
+uint64_t vars_generation = 1;
+
+/** Whether the environment has been imported */
+static bool initialized = false;
+
+/** The environment built from the exported variables and its capacity */
+static char **envp = NULL;
+static size_t envp_capacity = 0;
+
+/** Whether an exported variable has changed since envp was built */
+static bool envp_stale = true;
+
+/**
+ * The strings of exported variables which were replaced or unset since envp
+ * was built, which it may still point to, to be freed when it is rebuilt
+ */
+static char **retired = NULL;
+static size_t num_retired = 0, retired_capacity = 0;
+
+/** The copies of the variables saved by vars_save and their number */
+static struct Var *saved = NULL;
+static size_t num_saved = 0;
+
+/** The generation of the variables as they were saved or last restored */
+static uint64_t saved_generation = 0;
+
+/** Return whether a character may be part of the name of a variable */
+static inline bool is_name_char(char c, bool first);
+
+/** Return whether a slot of the hash table holds a variable */
+static bool is_full(const void *slot);
+
+/** Return whether a variable has the name of a struct Key */
+static bool matches(const void *slot, const void *key);
+
+/**
+ * Find the slot of a variable, or the empty slot where it would be inserted if
+ * it isn't in the hash table
+ */
+static struct Var *find_slot(const char *name, size_t len, uint64_t hash);
+
+/**
+ * Free the string of a variable, or keep it until envp is rebuilt if it may
+ * be in it
+ */
+static void retire(struct Var *var);
+
+/** The hash table of variables, whose slots are struct Var */
+static struct Table table = {NULL, sizeof(struct Var), 0, 0};
+
+/* See vars.h */
+void vars_init(void)
+{
+    initialized = true;
+    for (char **env = environ; *env; ++env) {
+        const char *equals = strchr(*env, '=');
+
+        /* As with getenv, the first of several definitions wins */
+        if (equals && equals != *env && !var_lookup(*env, equals - *env))
+            var_set(*env, equals - *env, equals + 1, true);
+    }
+    vars_environ();
+}
+
+/* See vars.h */
+size_t var_name_len(const char *str, const char *end)
+{
+    const char *p = str;
+
+    while (p < end && is_name_char(*p, p == str))
+        ++p;
+    return p - str;
+}
+
+/* See vars.h */
+const char *var_lookup(const char *name, size_t len)
+{
+    struct Var *var;
+
+    if (!initialized)
+        vars_init();
+    if (!table.num_slots)
+        return NULL;
+    var = find_slot(name, len, hash_string(name, len));
+    if (!var->entry || !var->has_value)
+        return NULL;
+    return var->entry + len + 1;
+}
+
+/* See vars.h */
+const char *var_get(const char *name)
+{
+    return var_lookup(name, strlen(name));
+}
+
+/* See vars.h */
+void var_set(const char *name, size_t len, const char *value, bool export)
+{
+    uint64_t hash = hash_string(name, len);
+    struct Var *var;
+    char *entry;
+
+    if (!initialized)
+        vars_init();
+    table_reserve(&table, is_full);
+    var = find_slot(name, len, hash);
+
+    if (!var->entry) {
+        var->hash = hash;
+        var->len = len;
+        var->exported = false;
+        ++table.num_full;
+    } else if (!value) {
+        /* Exporting doesn't change the value */
+        if (!var->exported && var->has_value)
+            envp_stale = true;
+        var->exported = true;
+        return;
+    }
+
+    if (value) {
+        size_t value_len = strlen(value);
+        if (!(entry = malloc(len + value_len + 2)))
+            error(1, errno, "fatal error");
+        memcpy(entry, name, len);
+        entry[len] = '=';
+        memcpy(entry + len + 1, value, value_len + 1);
+    } else if (!(entry = strndup(name, len)))
+        error(1, errno, "fatal error");
+
+    if (var->entry)
+        retire(var);
+    var->entry = entry;
+    var->has_value = value;
+    var->exported |= export;
+    if (var->exported)
+        envp_stale = true;
+    ++vars_generation;
+}
+
+/* See vars.h */
+void var_unset(const char *name)
+{
+    size_t len = strlen(name);
+    struct Var *var;
+
+    if (!initialized)
+        vars_init();
+    if (!table.num_slots)
+        return;
+    var = find_slot(name, len, hash_string(name, len));
+    if (!var->entry)
+        return;
+    if (var->exported)
+        envp_stale = true;
+    retire(var);
+    table_remove(&table, var, is_full);
+    ++vars_generation;
+}
+
+/* See vars.h */
+char **vars_environ(void)
+{
+    size_t len = 0;
+
+    if (!initialized)
+        vars_init();
+    if (!envp_stale)
+        return envp;
+
+    if (envp_capacity < table.num_full + 1) {
+        envp_capacity = 2 * (table.num_full + 1);
+        free(envp);
+        if (!(envp = malloc(sizeof(*envp) * envp_capacity)))
+            error(1, errno, "fatal error");
+    }
+    for (size_t i = 0; i < table.num_slots; ++i) {
+        struct Var *var = table_slot(&table, i);
+        if (var->entry && var->exported && var->has_value)
+            envp[len++] = var->entry;
+    }
+    envp[len] = NULL;
+    environ = envp;
+
+    for (size_t i = 0; i < num_retired; ++i)
+        free(retired[i]);
+    num_retired = 0;
+    envp_stale = false;
+    return envp;
+}
+
+/* See vars.h */
+void vars_foreach(void (*func)(const char *entry, size_t len, bool exported))
+{
+    if (!initialized)
+        vars_init();
+    for (size_t i = 0; i < table.num_slots; ++i) {
+        struct Var *var = table_slot(&table, i);
+        if (var->entry)
+            func(var->entry, var->len, var->exported);
+    }
+}
+
+/* See vars.h */
+void vars_save(void)
+{
+    if (!initialized)
+        vars_init();
+    for (size_t i = 0; i < num_saved; ++i)
+        free(saved[i].entry);
+    free(saved);
+    if (!(saved = malloc(sizeof(*saved) * (table.num_full + 1))))
+        error(1, errno, "fatal error");
+    num_saved = 0;
+    for (size_t i = 0; i < table.num_slots; ++i) {
+        struct Var *var = table_slot(&table, i);
+        if (!var->entry)
+            continue;
+        saved[num_saved] = *var;
+        if (!(saved[num_saved++].entry = strdup(var->entry)))
+            error(1, errno, "fatal error");
+    }
+    saved_generation = vars_generation;
+}
+
+/* See vars.h */
+void vars_restore(void)
+{
+    if (vars_generation == saved_generation)
+        return;
+
+    /* The table is emptied and filled again, as it usually holds few */
+    for (size_t i = 0; i < table.num_slots; ++i) {
+        struct Var *var = table_slot(&table, i);
+        if (var->entry) {
+            retire(var);
+            memset(var, 0, sizeof(*var));
+        }
+    }
+    table.num_full = 0;
+    envp_stale = true;
+    for (size_t i = 0; i < num_saved; ++i) {
+        struct Var *var = &saved[i];
+        var_set(var->entry, var->len,
+                var->has_value ? var->entry + var->len + 1 : NULL,
+                var->exported);
+    }
+    saved_generation = vars_generation;
+}
+
+/* See above */
+static inline bool is_name_char(char c, bool first)
+{
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (!first && c >= '0' && c <= '9');
+}
+
+/* See above */
+static bool is_full(const void *slot)
+{
+    return ((const struct Var *)slot)->entry;
+}
+
+/* See above */
+static bool matches(const void *slot, const void *key)
+{
+    const struct Var *var = slot;
+    const struct Key *name = key;
+
+    return var->len == name->len &&
+        memcmp(var->entry, name->name, name->len) == 0;
+}
+
+/* See above */
+static struct Var *find_slot(const char *name, size_t len, uint64_t hash)
+{
+    struct Key key = {name, len};
+
+    return table_find(&table, hash, is_full, matches, &key);
+}
+
+/* See above */
+static void retire(struct Var *var)
+{
+    if (!var->exported) {
+        free(var->entry);
+        return;
+    }
+    if (num_retired >= retired_capacity) {
+        retired_capacity = retired_capacity ? 2 * retired_capacity : 16;
+        if (!(retired = realloc(retired,
+                                sizeof(*retired) * retired_capacity)))
+            error(1, errno, "fatal error");
+    }
+    retired[num_retired++] = var->entry;
+}
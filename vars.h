@@ -0,0 +1,78 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A number which changes whenever a variable is set or unset, so that
+ * anything derived from the values of variables (e.g., a command line they
+ * were expanded into) can tell whether it may be stale. It is never zero
+ */
+extern uint64_t vars_generation;
+
+/**
+ * Import the environment of the shell as exported variables, which is done by
+ * the first use of the variables otherwise. Afterwards, the environment
+ * should only be changed through the variables
+ */
+void vars_init(void);
+
+/**
+ * Return the length of the name of a variable at the start of a string which
+ * ends no later than end, or zero if it doesn't start with one. Names consist
+ * of letters, digits, and underscores, and don't start with a digit
+ */
+size_t var_name_len(const char *str, const char *end);
+
+/**
+ * Look up the value of a variable by a name of a given length
+ * @return The value, which is valid until the variable is next set or unset,
+ * or NULL if the variable is unset
+ */
+const char *var_lookup(const char *name, size_t len);
+
+/** Look up the value of a variable by its null-terminated name */
+const char *var_get(const char *name);
+
+/**
+ * Set a variable to a value, exporting it to the environment of commands if
+ * export is true (once exported, a variable stays exported until it is
+ * unset). The value may be NULL to only export the variable, which is then
+ * left out of the environment until it has a value
+ */
+void var_set(const char *name, size_t len, const char *value, bool export);
+
+/** Unset a variable of a null-terminated name */
+void var_unset(const char *name);
+
+/**
+ * Return the environment to execute commands with, which consists of the
+ * exported variables in the form NAME=value. It is only rebuilt when an
+ * exported variable has changed since the last call, and environ is kept
+ * pointing to it
+ */
+char **vars_environ(void);
+
+/**
+ * Call a function for every variable in no particular order with its name and
+ * value (NAME=value, or just NAME if it is exported without a value), the
+ * length of its name, and whether it is exported
+ */
+void vars_foreach(void (*func)(const char *entry, size_t len, bool exported));
+
+/**
+ * Save a copy of all of the variables, replacing any saved before, to be
+ * brought back by vars_restore
+ */
+void vars_save(void);
+
+/**
+ * Bring back the variables saved by vars_save, dropping the ones set since and
+ * setting the ones changed or unset since. Nothing is done if no variable has
+ * changed since they were saved or last restored
+ */
+void vars_restore(void);
+
+#endif /* VARS_H */